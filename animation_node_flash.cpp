@@ -61,6 +61,8 @@ String FlashMachine::get_configuration_warning() const {
 
 void FlashMachine::set_flash_player(const NodePath &p_player) {
     flash_player = p_player;
+    player_dirty = true;
+    _invalidate_clips();
 #ifdef TOOLS_ENABLED
     property_list_changed_notify();
     update_configuration_warning();
@@ -76,9 +78,129 @@ NodePath FlashMachine::get_flash_player() const {
     return flash_player;
 }
 
+FlashPlayer *FlashMachine::get_player() {
+    if (!player_dirty) {
+        FlashPlayer *cached = Object::cast_to<FlashPlayer>(ObjectDB::get_instance(player_id));
+        if (cached != NULL) return cached;
+        // player freed or not resolved yet, look it up again
+        player_dirty = true;
+    }
+    if (!is_inside_tree() || !has_node(flash_player)) return NULL;
+    FlashPlayer *fp = Object::cast_to<FlashPlayer>(get_node(flash_player));
+    FlashPlayer *prev = Object::cast_to<FlashPlayer>(ObjectDB::get_instance(player_id));
+    if (prev != NULL && prev != fp && prev->is_connected("resource_changed", this, "_invalidate_clips")) {
+        prev->disconnect("resource_changed", this, "_invalidate_clips");
+    }
+    if (fp != NULL && !fp->is_connected("resource_changed", this, "_invalidate_clips")) {
+        fp->connect("resource_changed", this, "_invalidate_clips");
+    }
+    player_id = fp != NULL ? fp->get_instance_id() : 0;
+    player_dirty = fp == NULL;
+    return fp;
+}
+
+void FlashMachine::_invalidate_clips() {
+    clip_handles.clear();
+    clip_handle_ids.clear();
+    pending_clips.clear();
+    handles_version++;
+}
+
+// Clip path is parsed and looked up once per resource, nodes keep
+// returned handle until `handles_version` changes
+int FlashMachine::resolve_clip(const StringName &p_clip) {
+    const int *existed = clip_handle_ids.getptr(p_clip);
+    if (existed != NULL) return *existed;
+    FlashPlayer *fp = get_player();
+    if (fp == NULL || !fp->get_resource().is_valid()) return -1;
+
+    FlashClipHandle handle;
+    handle.track_id = -1;
+    handle.clip_id = -1;
+    if (track == "[main]") {
+        Vector<String> clip_path = String(p_clip).split("/", true, 1);
+        handle.symbol = clip_path[0];
+        handle.symbol_clip = clip_path.size() == 2 ? clip_path[1] : "";
+        handle.duration = fp->get_duration(handle.symbol, handle.symbol_clip);
+    } else {
+        Ref<FlashDocument> doc = fp->get_resource();
+        handle.track_id = doc->find_clip_track(track);
+        if (handle.track_id >= 0) {
+            handle.clip_id = doc->find_clip(handle.track_id, p_clip);
+        }
+        handle.duration = 0.0;
+        if (handle.clip_id >= 0) {
+            Vector2 range = doc->get_clip_track(handle.track_id).ranges[handle.clip_id];
+            handle.duration = range.y - range.x;
+        }
+    }
+    int id = clip_handles.size();
+    clip_handles.push_back(handle);
+    clip_handle_ids[p_clip] = id;
+    return id;
+}
+
+void FlashMachine::queue_clip(int p_handle, float p_step, bool p_seek) {
+    PendingClip pending;
+    pending.handle = p_handle;
+    pending.step = p_step;
+    pending.seek = p_seek;
+    pending_clips.push_back(pending);
+    if (get_process_mode() == ANIMATION_PROCESS_MANUAL) {
+        _flush_clips();
+    }
+}
+
+// All clips requested during graph processing are applied to the player
+// at once, player coalesces them into single evaluation
+void FlashMachine::_flush_clips() {
+    if (pending_clips.size() == 0) return;
+    FlashPlayer *fp = get_player();
+    if (fp == NULL) {
+        pending_clips.clear();
+        return;
+    }
+    int main_pending = -1;
+    for (int i=0; i<pending_clips.size(); i++) {
+        const PendingClip &pending = pending_clips[i];
+        const FlashClipHandle &handle = clip_handles[pending.handle];
+        if (handle.track_id < 0 && track == "[main]") {
+            main_pending = i;
+        } else {
+            fp->advance_clip(handle.track_id, handle.clip_id, pending.step, pending.seek);
+        }
+    }
+    if (main_pending >= 0) {
+        const PendingClip &pending = pending_clips[main_pending];
+        const FlashClipHandle &handle = clip_handles[pending.handle];
+        if (fp->get_active_symbol() != handle.symbol) {
+            fp->set_active_symbol(handle.symbol);
+            fp->set_active_clip("[full]");
+        }
+        fp->set_active_clip(handle.symbol_clip);
+        fp->advance(pending.step, pending.seek, false);
+    }
+    pending_clips.clear();
+}
+
+void FlashMachine::_notification(int p_what) {
+    switch (p_what) {
+        case NOTIFICATION_INTERNAL_PROCESS:
+        case NOTIFICATION_INTERNAL_PHYSICS_PROCESS: {
+            // graph is already processed by AnimationTree at this point
+            _flush_clips();
+        } break;
+
+        case NOTIFICATION_EXIT_TREE: {
+            player_dirty = true;
+        } break;
+    }
+}
+
 void FlashMachine::_bind_methods() {
     ClassDB::bind_method(D_METHOD("set_flash_player", "flash_player"), &FlashMachine::set_flash_player);
 	ClassDB::bind_method(D_METHOD("get_flash_player"), &FlashMachine::get_flash_player);
+    ClassDB::bind_method(D_METHOD("_invalidate_clips"), &FlashMachine::_invalidate_clips);
 
     ADD_PROPERTY(PropertyInfo(Variant::NODE_PATH, "flash_player", PROPERTY_HINT_NODE_PATH_VALID_TYPES, "FlashPlayer"), "set_flash_player", "get_flash_player");
 }
@@ -87,6 +209,7 @@ void FlashMachine::_bind_methods() {
 bool FlashMachine::_set(const StringName &p_name, const Variant &p_value) {
     if (p_name == "track") {
         track = p_value;
+        _invalidate_clips();
         return true;
     }
     return false;
@@ -115,6 +238,9 @@ void FlashMachine::_get_property_list(List<PropertyInfo> *p_list) const {
 
 FlashMachine::FlashMachine() {
     track = "[main]";
+    player_id = 0;
+    player_dirty = true;
+    handles_version = 0;
 }
 
 
@@ -125,6 +251,7 @@ FlashMachine::FlashMachine() {
 bool AnimationNodeFlashClip::_set(const StringName &p_name, const Variant &p_value) {
     if (p_name == "clip") {
         clip = p_value;
+        resolved_machine = 0;
         return true;
     } else {
         return false;
@@ -207,9 +334,16 @@ float AnimationNodeFlashClip::process(float p_time, bool p_seek) {
 
     FlashMachine *fm = Object::cast_to<FlashMachine>(state->tree);
     ERR_FAIL_COND_V(!fm, 0);
-    FlashPlayer *fp = Object::cast_to<FlashPlayer>(fm->get_node(fm->get_flash_player()));
+    FlashPlayer *fp = fm->get_player();
     ERR_FAIL_COND_V(!fp, 0);
-    StringName track = fm->get_track();
+
+    if (resolved_machine != fm->get_instance_id() || resolved_version != fm->get_handles_version()) {
+        resolved_handle = fm->resolve_clip(clip);
+        resolved_machine = fm->get_instance_id();
+        resolved_version = fm->get_handles_version();
+    }
+    if (resolved_handle < 0) return 0.0;
+    const FlashClipHandle &handle = fm->get_clip_handle(resolved_handle);
 
 	float time = get_parameter(this->time);
 
@@ -221,29 +355,20 @@ float AnimationNodeFlashClip::process(float p_time, bool p_seek) {
 	} else {
 		time = MAX(0, time + p_time);
 	}
-    float elapsed;
-    float remaining;
-    if (track == "[main]") {
-        Vector<String> clip_path = String(clip).split("/", true, 1);
-        String s = clip_path[0];
-        String c = clip_path.size() == 2 ? clip_path[1] : "";
-        float anim_size = fp->get_duration(s, c) / fp->get_frame_rate();
-        if (time > anim_size) {
-		    elapsed = anim_size;
-	    } else {
-            elapsed = time;
-        }
-        remaining = anim_size - elapsed;
-        fp->set_active_symbol(s);
-        fp->set_active_clip(c);
-        fp->advance(step, p_seek, false);
-    } else {
-        fp->advance_clip_for_track(track, clip, step, p_seek, &elapsed, &remaining);
+    float anim_size = handle.duration / fp->get_frame_rate();
+    float elapsed = MIN(time, anim_size);
+    if (fp->is_loop() && handle.track_id >= 0 && anim_size > 0) {
+        elapsed = Math::fmod(time, anim_size);
     }
+    float remaining = anim_size - elapsed;
+    fm->queue_clip(resolved_handle, step, p_seek);
 	set_parameter(this->time, elapsed);
 	return remaining;
 }
 
 AnimationNodeFlashClip::AnimationNodeFlashClip() {
 	time = "time";
-}
\ No newline at end of file
+    resolved_machine = 0;
+    resolved_version = 0;
+    resolved_handle = -1;
+}
@@ -26,13 +26,41 @@
 
 #include "scene/animation/animation_tree.h"
 
+class FlashPlayer;
+
+// clip of AnimationNodeFlashClip resolved against player's resource
+struct FlashClipHandle {
+	String symbol;
+	String symbol_clip;
+	int track_id;
+	int clip_id;
+	float duration;
+};
+
 class FlashMachine: public AnimationTree {
 	GDCLASS(FlashMachine, AnimationTree);
 
+	struct PendingClip {
+		int handle;
+		float step;
+		bool seek;
+	};
+
 	NodePath flash_player;
 	String track;
+	ObjectID player_id;
+	bool player_dirty;
+
+	Vector<FlashClipHandle> clip_handles;
+	HashMap<StringName, int> clip_handle_ids;
+	uint32_t handles_version;
+	Vector<PendingClip> pending_clips;
+
+	void _invalidate_clips();
+	void _flush_clips();
 
 protected:
+	void _notification(int p_what);
 	static void _bind_methods();
 	bool _set(const StringName &p_name, const Variant &p_value);
 	bool _get(const StringName &p_name, Variant &r_ret) const;
@@ -44,6 +72,11 @@ public:
 	void set_flash_player(const NodePath &p_player);
 	NodePath get_flash_player() const;
 	String get_track() const { return track; }
+	FlashPlayer *get_player();
+	int resolve_clip(const StringName &p_clip);
+	const FlashClipHandle &get_clip_handle(int p_handle) const { return clip_handles[p_handle]; }
+	uint32_t get_handles_version() const { return handles_version; }
+	void queue_clip(int p_handle, float p_step, bool p_seek);
 
 	FlashMachine();
 };
@@ -57,6 +90,11 @@ class AnimationNodeFlashClip: public AnimationRootNode {
     StringName clip;
 	StringName time;
 
+	// handle resolved by FlashMachine, valid while its version matches
+	ObjectID resolved_machine;
+	uint32_t resolved_version;
+	int resolved_handle;
+
 protected:
 	bool _set(const StringName &p_name, const Variant &p_value);
 	bool _get(const StringName &p_name, Variant &r_ret) const;
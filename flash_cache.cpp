@@ -0,0 +1,90 @@
+// MIT License
+
+// Copyright (c) 2021 Yakov Borevich, Funexpected LLC
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "flash_cache.h"
+
+int FlashCachedGeometry::get_memory_usage() const {
+    return
+        points.size() * sizeof(Vector2) +
+        uvs.size() * sizeof(Vector2) +
+        mults.size() * sizeof(Color) +
+        adds.size() * sizeof(Color) +
+        texture_indices.size() * sizeof(int) +
+        indices.size() * sizeof(int);
+}
+
+FlashCacheKey FlashGeometryCache::make_key(const FlashTimeline *p_symbol, float p_frame, uint64_t p_state) {
+    // only subtrees without tweens are cached, they change on whole
+    // frames only, so fractional frames share same cached geometry
+    return FlashCacheKey(p_symbol, Math::floor(p_frame), p_state);
+}
+
+const FlashCachedGeometry *FlashGeometryCache::lookup(const FlashCacheKey &p_key) {
+    Map<FlashCacheKey, FlashCachedGeometry>::Element *E = entries.find(p_key);
+    if (E == NULL) {
+        misses++;
+        return NULL;
+    }
+    hits++;
+    E->get().last_used = tick;
+    return &E->get();
+}
+
+bool FlashGeometryCache::store(const FlashCacheKey &p_key, const FlashCachedGeometry &p_geometry) {
+    int size = p_geometry.get_memory_usage();
+    if (size > memory_limit) return false;
+
+    Map<FlashCacheKey, FlashCachedGeometry>::Element *E = entries.find(p_key);
+    if (E != NULL) {
+        memory_usage -= E->get().get_memory_usage();
+        entries.erase(E);
+    }
+    _evict(size);
+    E = entries.insert(p_key, p_geometry);
+    E->get().last_used = tick;
+    memory_usage += size;
+    return true;
+}
+
+void FlashGeometryCache::_evict(int p_required) {
+    while (entries.size() > 0 && memory_usage + p_required > memory_limit) {
+        Map<FlashCacheKey, FlashCachedGeometry>::Element *oldest = entries.front();
+        for (Map<FlashCacheKey, FlashCachedGeometry>::Element *E = entries.front(); E; E = E->next()) {
+            if (E->get().last_used < oldest->get().last_used) {
+                oldest = E;
+            }
+        }
+        memory_usage -= oldest->get().get_memory_usage();
+        entries.erase(oldest);
+        evictions++;
+    }
+}
+
+void FlashGeometryCache::clear() {
+    entries.clear();
+    memory_usage = 0;
+}
+
+void FlashGeometryCache::set_memory_limit(int p_limit) {
+    memory_limit = MAX(0, p_limit);
+    _evict(0);
+}
@@ -0,0 +1,110 @@
+// MIT License
+
+// Copyright (c) 2021 Yakov Borevich, Funexpected LLC
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef FLASH_CACHE_H
+#define FLASH_CACHE_H
+
+#include <core/map.h>
+#include <core/vector.h>
+#include <core/color.h>
+#include <core/math/transform_2d.h>
+
+class FlashTimeline;
+
+// Geometry of a single symbol subtree evaluated in its own local space
+// (identity transform and color effect), ready to be replayed many times.
+struct FlashCachedGeometry {
+    Vector<Vector2> points;
+    Vector<Vector2> uvs;
+    Vector<Color> mults;
+    Vector<Color> adds;
+    Vector<int> texture_indices;
+    Vector<int> indices;
+    uint64_t last_used;
+
+    FlashCachedGeometry(): last_used(0) {}
+    int get_memory_usage() const;
+};
+
+struct FlashCacheKey {
+    const FlashTimeline *symbol;
+    float frame;
+    uint64_t state;
+
+    FlashCacheKey():
+        symbol(NULL),
+        frame(0),
+        state(0) {}
+
+    FlashCacheKey(const FlashTimeline *p_symbol, float p_frame, uint64_t p_state):
+        symbol(p_symbol),
+        frame(p_frame),
+        state(p_state) {}
+
+    inline bool operator<(const FlashCacheKey &p_key) const {
+        if (symbol != p_key.symbol) return symbol < p_key.symbol;
+        if (frame != p_key.frame) return frame < p_key.frame;
+        return state < p_key.state;
+    }
+};
+
+// Cache of evaluated symbol geometry with a memory cap and
+// least-recently-used eviction. Has no scene dependencies, so
+// can be driven from anywhere (including headless runs).
+class FlashGeometryCache {
+    Map<FlashCacheKey, FlashCachedGeometry> entries;
+    int memory_limit;
+    int memory_usage;
+    uint64_t tick;
+    int hits;
+    int misses;
+    int evictions;
+
+    void _evict(int p_required);
+
+public:
+    FlashGeometryCache():
+        memory_limit(1024*1024),
+        memory_usage(0),
+        tick(0),
+        hits(0),
+        misses(0),
+        evictions(0) {}
+
+    static FlashCacheKey make_key(const FlashTimeline *p_symbol, float p_frame, uint64_t p_state);
+
+    const FlashCachedGeometry *lookup(const FlashCacheKey &p_key);
+    bool store(const FlashCacheKey &p_key, const FlashCachedGeometry &p_geometry);
+    void clear();
+    void next_tick() { tick++; }
+
+    int get_memory_limit() const { return memory_limit; }
+    void set_memory_limit(int p_limit);
+    int get_memory_usage() const { return memory_usage; }
+    int get_entries_count() const { return entries.size(); }
+    int get_hits() const { return hits; }
+    int get_misses() const { return misses; }
+    int get_evictions() const { return evictions; }
+    void reset_stats() { hits = 0; misses = 0; evictions = 0; }
+};
+
+#endif
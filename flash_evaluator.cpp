@@ -0,0 +1,236 @@
+// MIT License
+
+// Copyright (c) 2021 Yakov Borevich, Funexpected LLC
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "flash_evaluator.h"
+#include "flash_resources.h"
+#include "flash_player.h"
+
+#include <core/math/geometry.h>
+
+float FlashPlayerState::get_symbol_frame(const FlashTimeline *p_symbol, float p_default) const {
+    if (p_symbol == NULL) {
+        return p_default;
+    }
+
+    int track_id = p_symbol->get_clips_track_id();
+    if (get_clip_id(track_id) >= 0) {
+        const Vector3 &clip = clips_state[track_id];
+        return clip.x + clip.z;
+    }
+
+    if (p_symbol->get_variation_idx() < 0) {
+        return p_default;
+    }
+
+    float frame = frame_overrides[p_symbol->get_variation_idx()];
+    return frame < 0 ? p_default : frame;
+}
+
+bool FlashPlayerState::is_symbol_driven_by_clip(const FlashTimeline *p_symbol) const {
+    return p_symbol != NULL && get_clip_id(p_symbol->get_clips_track_id()) >= 0;
+}
+
+bool FlashPlayerState::has_symbol_frame_override(const FlashTimeline *p_symbol) const {
+    if (p_symbol == NULL || p_symbol->get_variation_idx() < 0) return false;
+    return frame_overrides[p_symbol->get_variation_idx()] >= 0;
+}
+
+int FlashPlayerState::get_clip_id(int p_track) const {
+    if (p_track < 0 || p_track >= active_clips.size()) return -1;
+    return active_clips[p_track];
+}
+
+void FlashOutputBuffers::clear() {
+    points.resize(0);
+    uvs.resize(0);
+    colors.resize(0);
+    indices.resize(0);
+    events.clear();
+    masks.clear();
+    mask_stack.clear();
+    clipping_cache.clear();
+    clipping_items.clear();
+    current_mask = 0;
+    deferred_clipping.resize(0);
+    deferred_events.clear();
+}
+
+void FlashOutputBuffers::add_event(const String &p_event, bool p_reversed) {
+    if (deferred) {
+        deferred_events.push_back(Pair<String, bool>(p_event, p_reversed));
+        return;
+    }
+    if (events.find(p_event) == NULL) {
+        if (p_reversed) {
+            events.push_front(p_event);
+        } else {
+            events.push_back(p_event);
+        }
+    }
+}
+
+void FlashOutputBuffers::add_vertex(const Vector2 &p_point, const Color &p_color, const Vector2 &p_uv, int p_clipping_id, int p_clipping_size_with_tex_idx) {
+    points.push_back(p_point);
+    colors.push_back(p_color);
+    if (deferred) {
+        uvs.push_back(p_uv);
+        deferred_clipping.push_back(p_clipping_id);
+        deferred_clipping.push_back(p_clipping_size_with_tex_idx);
+    } else {
+        uvs.push_back(p_uv + Vector2(p_clipping_id, p_clipping_size_with_tex_idx));
+    }
+}
+
+// Merges output of a parallel task as if it was evaluated right here.
+// Task must start and end with balanced clipping.
+void FlashOutputBuffers::append(const FlashOutputBuffers &p_other) {
+    ERR_FAIL_COND(deferred || !p_other.deferred);
+    int offset = points.size();
+    int indices_offset = indices.size();
+    int count = p_other.points.size();
+    int clipping_id = clipping_cache.size();
+    int clipping_size = clipping_items.size() << 8;
+
+    indices.resize(indices_offset + p_other.indices.size());
+    int *iw = indices.ptrw();
+    const int *ir = p_other.indices.ptr();
+    for (int i=0; i<p_other.indices.size(); i++) {
+        iw[indices_offset + i] = ir[i] + offset;
+    }
+
+    points.resize(offset + count);
+    colors.resize(offset + count);
+    uvs.resize(offset + count);
+    Vector2 *pw = points.ptrw();
+    Color *cw = colors.ptrw();
+    Vector2 *uw = uvs.ptrw();
+    const int *clipping = p_other.deferred_clipping.ptr();
+    for (int i=0; i<count; i++) {
+        pw[offset + i] = p_other.points[i];
+        cw[offset + i] = p_other.colors[i];
+        uw[offset + i] = p_other.uvs[i] + Vector2(clipping_id + clipping[i*2], clipping_size + clipping[i*2+1]);
+    }
+
+    for (const List<FlashMaskItem>::Element *E = p_other.clipping_cache.front(); E; E = E->next()) {
+        clipping_cache.push_back(E->get());
+    }
+    for (const List<Pair<String, bool> >::Element *E = p_other.deferred_events.front(); E; E = E->next()) {
+        add_event(E->get().first, E->get().second);
+    }
+}
+
+void FlashEvaluator::add_polygon(const Vector<Vector2> &p_points, const FlashColorEffect &p_effect, const Vector<Vector2> &p_uvs, int p_texture_idx) {
+    Vector<int> local_indices = Geometry::triangulate_polygon(p_points);
+    if (player != NULL && player->is_cache_capturing()) {
+        player->cache_add_polygon(p_points, local_indices, p_effect, p_uvs, p_texture_idx);
+        return;
+    }
+    int offset = output->points.size();
+    for (int i=0; i<local_indices.size(); i++){
+        output->indices.push_back(local_indices[i] + offset);
+    }
+    Color color = flash_encode_color_effect(p_effect.mult, p_effect.add);
+    int clipping_id = output->clipping_cache.size();
+    int clipping_size_with_tex_idx = (output->clipping_items.size() << 8) | (p_texture_idx & 0xff);
+    for (int i=0; i<p_points.size(); i++) {
+        output->add_vertex(p_points[i], color, p_uvs[i] * 0.5, clipping_id, clipping_size_with_tex_idx);
+    }
+}
+
+void FlashEvaluator::mask_begin(int mask_id) {
+    if (!output->current_mask) output->current_mask = mask_id;
+    output->masks.set(output->current_mask, List<FlashMaskItem>());
+    output->mask_stack.push_back(mask_id);
+}
+void FlashEvaluator::mask_end(int mask_id) {
+    if (output->current_mask == mask_id) {
+        output->mask_stack.pop_front();
+        if (output->mask_stack.size() > 0) {
+            output->current_mask = output->mask_stack.back()->get();
+        } else {
+            output->current_mask = 0;
+        }
+    }
+}
+void FlashEvaluator::mask_add(Transform2D p_transform, Rect2i p_texture_region, int p_texture_idx) {
+    FlashMaskItem item;
+    item.texture_idx = p_texture_idx;
+    item.texture_region = p_texture_region;
+    item.transform = p_transform;
+    if (!output->masks.has(output->current_mask)) {
+        output->masks.set(output->current_mask, List<FlashMaskItem>());
+    }
+    output->masks[output->current_mask].push_back(item);
+}
+void FlashEvaluator::clip_begin(int mask_id) {
+    if (!output->masks.has(mask_id)) {
+        print_line("No flash mask found, id=" + itos(mask_id));
+        return;
+    }
+    for (List<FlashMaskItem>::Element *E = output->clipping_items.front(); E; E = E->next()) {
+        output->clipping_cache.push_back(E->get());
+    }
+    for (List<FlashMaskItem>::Element *E = output->masks[mask_id].front(); E; E = E->next()) {
+        output->clipping_items.push_back(E->get());
+    }
+}
+void FlashEvaluator::clip_end(int mask_id) {
+    if (!output->masks.has(mask_id)) return;
+    for (List<FlashMaskItem>::Element *E = output->clipping_items.front(); E; E = E->next()) {
+        output->clipping_cache.push_back(E->get());
+    }
+    for (List<FlashMaskItem>::Element *E = output->masks[mask_id].front(); E; E = E->next()) {
+        output->clipping_items.pop_back();
+    }
+}
+
+void FlashEvaluator::record_bitmap(const Transform2D &p_transform, const FlashColorEffect &p_effect, const Vector2 &p_size, const Rect2 &p_region, int p_texture_idx) {
+    ERR_FAIL_COND(output->draw_recorder == NULL);
+    FlashDrawItem item;
+    item.transform = p_transform;
+    item.size = p_size;
+    item.texture_region = p_region;
+    item.texture_idx = p_texture_idx;
+    item.mult = p_effect.mult;
+    item.add = p_effect.add;
+    output->draw_recorder->push_back(item);
+}
+
+bool FlashEvaluator::is_cached_as_bitmap(bool p_cache_as_bitmap, FlashTimeline *p_symbol) {
+    if (player == NULL || is_masking() || is_recording()) return false;
+    return player->is_cached_as_bitmap(p_cache_as_bitmap, p_symbol);
+}
+
+bool FlashEvaluator::cache_replay(FlashTimeline *p_symbol, float p_frame, const Transform2D &p_transform, const FlashColorEffect &p_effect) {
+    ERR_FAIL_COND_V(player == NULL, false);
+    return player->cache_replay(p_symbol, p_frame, p_transform, p_effect, *output);
+}
+
+void FlashEvaluator::cache_begin() {
+    ERR_FAIL_COND(player == NULL);
+    player->cache_begin();
+}
+
+void FlashEvaluator::cache_end(FlashTimeline *p_symbol, float p_frame, const Transform2D &p_transform, const FlashColorEffect &p_effect) {
+    ERR_FAIL_COND(player == NULL);
+    player->cache_end(p_symbol, p_frame, p_transform, p_effect, *output);
+}
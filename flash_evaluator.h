@@ -0,0 +1,152 @@
+// MIT License
+
+// Copyright (c) 2021 Yakov Borevich, Funexpected LLC
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef FLASH_EVALUATOR_H
+#define FLASH_EVALUATOR_H
+
+#include <core/hash_map.h>
+#include <core/list.h>
+#include <core/pair.h>
+#include <core/vector.h>
+#include <core/ustring.h>
+#include <core/color.h>
+#include <core/math/transform_2d.h>
+#include <core/math/vector3.h>
+
+class FlashPlayer;
+class FlashTimeline;
+struct FlashColorEffect;
+
+struct FlashMaskItem {
+    Transform2D transform;
+    Rect2 texture_region;
+    int texture_idx;
+};
+
+// bitmap drawn by evaluation, used for baking symbols at import time
+struct FlashDrawItem {
+    Transform2D transform;
+    Vector2 size;
+    Rect2 texture_region;
+    int texture_idx;
+    Color mult;
+    Color add;
+};
+
+static _FORCE_INLINE_ Color flash_encode_color_effect(const Color &p_mult, const Color &p_add) {
+    Color color = p_mult * 0.5;
+    color.r += floor(p_add.r * 255);
+    color.g += floor(p_add.g * 255);
+    color.b += floor(p_add.b * 255);
+    color.a += floor(p_add.a * 255);
+    return color;
+}
+
+// Per-player inputs of evaluation, only read while evaluating.
+struct FlashPlayerState {
+    Vector<int> frame_overrides;
+    // indexed by document clip track id, active clip is -1 for default
+    Vector<Vector3> clips_state;
+    Vector<int> active_clips;
+
+    float get_symbol_frame(const FlashTimeline *p_symbol, float p_default) const;
+    bool is_symbol_driven_by_clip(const FlashTimeline *p_symbol) const;
+    bool has_symbol_frame_override(const FlashTimeline *p_symbol) const;
+    int get_clip_id(int p_track) const;
+};
+
+// Everything evaluation produces: geometry, masks and fired events.
+struct FlashOutputBuffers {
+    Vector<Vector2> points;
+    Vector<Vector2> uvs;
+    Vector<Color> colors;
+    Vector<int> indices;
+    List<String> events;
+
+    HashMap<int, List<FlashMaskItem>> masks;
+    List<int> mask_stack;
+    List<FlashMaskItem> clipping_cache;
+    List<FlashMaskItem> clipping_items;
+    int current_mask;
+
+    Vector<FlashDrawItem> *draw_recorder;
+
+    // buffers of parallel tasks keep clipping ids and events raw,
+    // they are resolved by `append` when merged in paint order
+    bool deferred;
+    Vector<int> deferred_clipping;
+    List<Pair<String, bool> > deferred_events;
+
+    FlashOutputBuffers():
+        current_mask(0),
+        draw_recorder(NULL),
+        deferred(false) {}
+
+    void clear();
+    void add_event(const String &p_event, bool p_reversed=false);
+    void add_vertex(const Vector2 &p_point, const Color &p_color, const Vector2 &p_uv, int p_clipping_id, int p_clipping_size_with_tex_idx);
+    void append(const FlashOutputBuffers &p_other);
+};
+
+// Single evaluation pass. Document is never written during evaluation,
+// so any number of evaluators may walk the same document concurrently
+// as long as each one has its own output buffers. Player is optional,
+// it adds geometry cache which is bound to the player.
+class FlashEvaluator {
+    const FlashPlayerState *state;
+    FlashOutputBuffers *output;
+    FlashPlayer *player;
+
+public:
+    FlashEvaluator(const FlashPlayerState *p_state, FlashOutputBuffers *p_output, FlashPlayer *p_player=NULL):
+        state(p_state),
+        output(p_output),
+        player(p_player) {}
+
+    _FORCE_INLINE_ const FlashPlayerState *get_state() const { return state; }
+    _FORCE_INLINE_ FlashOutputBuffers *get_output() const { return output; }
+
+    float get_symbol_frame(const FlashTimeline *p_symbol, float p_default) const { return state->get_symbol_frame(p_symbol, p_default); }
+    bool is_symbol_driven_by_clip(const FlashTimeline *p_symbol) const { return state->is_symbol_driven_by_clip(p_symbol); }
+    bool has_symbol_frame_override(const FlashTimeline *p_symbol) const { return state->has_symbol_frame_override(p_symbol); }
+
+    void add_polygon(const Vector<Vector2> &p_points, const FlashColorEffect &p_effect, const Vector<Vector2> &p_uvs, int p_texture_idx);
+    void queue_animation_event(const String &p_name, bool p_reversed=false) { output->add_event(p_name, p_reversed); }
+
+    bool is_masking() const { return output->current_mask > 0; }
+    void mask_begin(int layer);
+    void mask_add(Transform2D p_transform, Rect2i p_texture_region, int p_texture_idx);
+    void mask_end(int layer);
+
+    void clip_begin(int layer);
+    void clip_end(int layer);
+
+    bool is_recording() const { return output->draw_recorder != NULL; }
+    void record_bitmap(const Transform2D &p_transform, const FlashColorEffect &p_effect, const Vector2 &p_size, const Rect2 &p_region, int p_texture_idx);
+
+    bool is_cached_as_bitmap(bool p_cache_as_bitmap, FlashTimeline *p_symbol);
+    bool cache_replay(FlashTimeline *p_symbol, float p_frame, const Transform2D &p_transform, const FlashColorEffect &p_effect);
+    void cache_begin();
+    void cache_end(FlashTimeline *p_symbol, float p_frame, const Transform2D &p_transform, const FlashColorEffect &p_effect);
+};
+
+#endif
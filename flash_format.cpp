@@ -0,0 +1,1166 @@
+// MIT License
+
+// Copyright (c) 2021 Yakov Borevich, Funexpected LLC
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "flash_format.h"
+#include "flash_resources.h"
+
+#include <core/io/compression.h>
+#include <core/io/marshalls.h>
+#include <core/os/file_access.h>
+#include <core/os/thread.h>
+#include <core/project_settings.h>
+#include <core/safe_refcount.h>
+
+static const char *FLASH_DOCUMENT_MAGIC = "FDOC";
+
+class FlashDocumentWriter {
+    Vector<String> strings;
+    HashMap<String, uint32_t> string_ids;
+
+public:
+    Vector<uint8_t> data;
+
+    void put_u8(uint8_t p_value) {
+        data.push_back(p_value);
+    }
+    void put_u32(uint32_t p_value) {
+        int pos = data.size();
+        data.resize(pos + 4);
+        encode_uint32(p_value, data.ptrw() + pos);
+    }
+    void put_i32(int32_t p_value) {
+        put_u32((uint32_t)p_value);
+    }
+    void put_float(float p_value) {
+        int pos = data.size();
+        data.resize(pos + 4);
+        encode_float(p_value, data.ptrw() + pos);
+    }
+    void put_vector2(const Vector2 &p_value) {
+        put_float(p_value.x);
+        put_float(p_value.y);
+    }
+    void put_rect2(const Rect2 &p_value) {
+        put_vector2(p_value.position);
+        put_vector2(p_value.size);
+    }
+    void put_color(const Color &p_value) {
+        put_float(p_value.r);
+        put_float(p_value.g);
+        put_float(p_value.b);
+        put_float(p_value.a);
+    }
+    void put_transform(const Transform2D &p_value) {
+        put_vector2(p_value[0]);
+        put_vector2(p_value[1]);
+        put_vector2(p_value[2]);
+    }
+    void put_color_effect(const FlashColorEffect &p_value) {
+        put_color(p_value.add);
+        put_color(p_value.mult);
+    }
+    void put_string(const String &p_value) {
+        const uint32_t *id = string_ids.getptr(p_value);
+        if (id != NULL) {
+            put_u32(*id);
+            return;
+        }
+        uint32_t new_id = strings.size();
+        string_ids.set(p_value, new_id);
+        strings.push_back(p_value);
+        put_u32(new_id);
+    }
+    void put_variant(const Variant &p_value) {
+        int len = 0;
+        Error err = encode_variant(p_value, NULL, len);
+        ERR_FAIL_COND(err != OK);
+        put_u32(len);
+        int pos = data.size();
+        data.resize(pos + len);
+        encode_variant(p_value, data.ptrw() + pos, len);
+    }
+    // size prefixed block, returns position to pass to `end_block`
+    int begin_block() {
+        put_u32(0);
+        return data.size();
+    }
+    void end_block(int p_start) {
+        encode_uint32(data.size() - p_start, data.ptrw() + p_start - 4);
+    }
+
+    // string table followed by element data
+    Vector<uint8_t> get_payload() const {
+        FlashDocumentWriter table;
+        table.put_u32(strings.size());
+        for (int i=0; i<strings.size(); i++) {
+            CharString utf8 = strings[i].utf8();
+            table.put_u32(utf8.length());
+            int pos = table.data.size();
+            table.data.resize(pos + utf8.length());
+            copymem(table.data.ptrw() + pos, utf8.get_data(), utf8.length());
+        }
+        Vector<uint8_t> payload = table.data;
+        int pos = payload.size();
+        payload.resize(pos + data.size());
+        copymem(payload.ptrw() + pos, data.ptr(), data.size());
+        return payload;
+    }
+};
+
+class FlashDocumentReader {
+    const uint8_t *data;
+    int size;
+    int pos;
+    uint32_t base;
+    Vector<String> strings;
+
+public:
+    bool failed;
+
+    // `p_base` is offset of data in payload, blocks read on their own
+    // still report positions in payload
+    FlashDocumentReader(const uint8_t *p_data, int p_size, uint32_t p_base=0):
+        data(p_data),
+        size(p_size),
+        pos(0),
+        base(p_base),
+        failed(false) {}
+
+    uint32_t get_position() const { return base + pos; }
+    void skip(int p_bytes) {
+        if (has(p_bytes)) pos += p_bytes;
+    }
+    const Vector<String> &get_strings() const { return strings; }
+    void set_strings(const Vector<String> &p_strings) { strings = p_strings; }
+
+    bool has(int p_bytes) {
+        if (failed || p_bytes < 0 || pos + p_bytes > size) {
+            failed = true;
+            return false;
+        }
+        return true;
+    }
+    uint8_t get_u8() {
+        if (!has(1)) return 0;
+        return data[pos++];
+    }
+    uint32_t get_u32() {
+        if (!has(4)) return 0;
+        uint32_t value = decode_uint32(data + pos);
+        pos += 4;
+        return value;
+    }
+    int32_t get_i32() {
+        return (int32_t)get_u32();
+    }
+    // count of items taking at least `p_item_size` bytes each
+    int get_count(int p_item_size=1) {
+        uint32_t count = get_u32();
+        if (failed || (uint64_t)count * p_item_size > (uint64_t)(size - pos)) {
+            failed = true;
+            return 0;
+        }
+        return count;
+    }
+    float get_float() {
+        if (!has(4)) return 0;
+        float value = decode_float(data + pos);
+        pos += 4;
+        return value;
+    }
+    Vector2 get_vector2() {
+        float x = get_float();
+        float y = get_float();
+        return Vector2(x, y);
+    }
+    Rect2 get_rect2() {
+        Vector2 position = get_vector2();
+        Vector2 size = get_vector2();
+        return Rect2(position, size);
+    }
+    Color get_color() {
+        float r = get_float();
+        float g = get_float();
+        float b = get_float();
+        float a = get_float();
+        return Color(r, g, b, a);
+    }
+    Transform2D get_transform() {
+        Vector2 x = get_vector2();
+        Vector2 y = get_vector2();
+        Vector2 o = get_vector2();
+        return Transform2D(x.x, x.y, y.x, y.y, o.x, o.y);
+    }
+    FlashColorEffect get_color_effect() {
+        FlashColorEffect effect;
+        effect.add = get_color();
+        effect.mult = get_color();
+        return effect;
+    }
+    String get_string() {
+        uint32_t id = get_u32();
+        if (failed || id >= (uint32_t)strings.size()) {
+            failed = true;
+            return String();
+        }
+        return strings[id];
+    }
+    Variant get_variant() {
+        int len = get_count();
+        if (failed) return Variant();
+        Variant value;
+        if (decode_variant(value, data + pos, len) != OK) {
+            failed = true;
+            return Variant();
+        }
+        pos += len;
+        return value;
+    }
+    void read_strings() {
+        int count = get_count(4);
+        strings.resize(count);
+        String *w = strings.ptrw();
+        for (int i=0; i<count && !failed; i++) {
+            int len = get_count();
+            if (failed) break;
+            w[i].parse_utf8((const char *)data + pos, len);
+            pos += len;
+        }
+    }
+};
+
+void FlashDocumentFormat::_write_timeline(FlashDocumentWriter &w, const FlashTimeline *p_timeline, int p_chunk_size) {
+    w.put_u32(p_timeline->get_eid());
+    w.put_string(p_timeline->token);
+    w.put_string(p_timeline->local_path);
+    w.put_string(p_timeline->clips_header);
+    w.put_i32(p_timeline->duration);
+    w.put_i32(p_timeline->variation_idx);
+    w.put_i32(p_timeline->symbol_id);
+    w.put_i32(p_timeline->clips_track_id);
+    w.put_variant(p_timeline->clips);
+    w.put_variant(p_timeline->events);
+    w.put_variant(p_timeline->variants);
+    w.put_u32(p_timeline->layers.size());
+    for (const List<Ref<FlashLayer>>::Element *E = p_timeline->layers.front(); E; E = E->next()) {
+        _write_layer(w, E->get().ptr(), p_chunk_size);
+    }
+    w.put_u32(p_timeline->masks.size());
+    for (const List<Ref<FlashLayer>>::Element *E = p_timeline->masks.front(); E; E = E->next()) {
+        _write_layer(w, E->get().ptr(), p_chunk_size);
+    }
+}
+
+void FlashDocumentFormat::_write_layer(FlashDocumentWriter &w, const FlashLayer *p_layer, int p_chunk_size) {
+    w.put_u32(p_layer->get_eid());
+    w.put_i32(p_layer->index);
+    w.put_string(p_layer->layer_name);
+    w.put_string(p_layer->get_type());
+    w.put_i32(p_layer->duration);
+    w.put_i32(p_layer->mask_id);
+    w.put_color(p_layer->color);
+    if (p_chunk_size <= 0 || p_layer->duration <= p_chunk_size) {
+        w.put_u32(p_layer->frames.size());
+        for (const List<Ref<FlashFrame>>::Element *E = p_layer->frames.front(); E; E = E->next()) {
+            _write_frame(w, E->get().ptr());
+        }
+        w.put_u32(0);
+        return;
+    }
+    // chunks start at keyframes, so no frame spans two chunks
+    Vector<const List<Ref<FlashFrame>>::Element*> starts;
+    for (const List<Ref<FlashFrame>>::Element *E = p_layer->frames.front(); E; E = E->next()) {
+        if (starts.size() == 0 || E->get()->index - starts[starts.size() - 1]->get()->index >= p_chunk_size) {
+            starts.push_back(E);
+        }
+    }
+    w.put_u32(0);
+    w.put_u32(starts.size());
+    for (int i=0; i<starts.size(); i++) {
+        const List<Ref<FlashFrame>>::Element *to = i + 1 < starts.size() ? starts[i + 1] : NULL;
+        int end = to != NULL ? to->get()->index : MAX(p_layer->duration, p_layer->frames.back()->get()->index + p_layer->frames.back()->get()->duration);
+        _write_chunk(w, starts[i], to, end);
+    }
+}
+
+void FlashDocumentFormat::_write_chunk(FlashDocumentWriter &w, const List<Ref<FlashFrame>>::Element *p_from, const List<Ref<FlashFrame>>::Element *p_to, int p_end) {
+    bool has_tweens = false;
+    bool has_cached = false;
+    Set<String> symbols;
+    Set<String> bitmaps;
+    int frames_count = 0;
+    for (const List<Ref<FlashFrame>>::Element *E = p_from; E != p_to; E = E->next()) {
+        const FlashFrame *frame = E->get().ptr();
+        if (frame->tweens.size() > 0) has_tweens = true;
+        for (int i=0; i<frame->drawings.size(); i++) {
+            const FlashDrawingData &drawing = frame->drawings[i];
+            if (drawing.kind == FlashDrawingData::KIND_INSTANCE) symbols.insert(drawing.token);
+            if (drawing.kind == FlashDrawingData::KIND_INSTANCE && drawing.cache_as_bitmap) has_cached = true;
+            if (drawing.kind == FlashDrawingData::KIND_BITMAP) bitmaps.insert(drawing.token);
+        }
+        frames_count++;
+    }
+    w.put_i32(p_from->get()->index);
+    w.put_i32(p_end);
+    w.put_u8(has_tweens | (has_cached << 1));
+    w.put_u32(symbols.size());
+    for (Set<String>::Element *E = symbols.front(); E; E = E->next()) {
+        w.put_string(E->get());
+    }
+    w.put_u32(bitmaps.size());
+    for (Set<String>::Element *E = bitmaps.front(); E; E = E->next()) {
+        w.put_string(E->get());
+    }
+    int block = w.begin_block();
+    w.put_u32(frames_count);
+    for (const List<Ref<FlashFrame>>::Element *E = p_from; E != p_to; E = E->next()) {
+        _write_frame(w, E->get().ptr());
+    }
+    w.end_block(block);
+}
+
+void FlashDocumentFormat::_collect_instanced(const FlashTimeline *p_timeline, Set<String> &r_tokens) {
+    for (int l=0; l<2; l++) {
+        const List<Ref<FlashLayer>> &list = l == 0 ? p_timeline->layers : p_timeline->masks;
+        for (const List<Ref<FlashLayer>>::Element *L = list.front(); L; L = L->next()) {
+            for (const List<Ref<FlashFrame>>::Element *F = L->get()->frames.front(); F; F = F->next()) {
+                const Vector<FlashDrawingData> &drawings = F->get()->drawings;
+                for (int i=0; i<drawings.size(); i++) {
+                    if (drawings[i].kind == FlashDrawingData::KIND_INSTANCE) r_tokens.insert(drawings[i].token);
+                }
+            }
+        }
+    }
+}
+
+void FlashDocumentFormat::_write_frame(FlashDocumentWriter &w, const FlashFrame *p_frame) {
+    w.put_u32(p_frame->get_eid());
+    w.put_i32(p_frame->index);
+    w.put_i32(p_frame->duration);
+    w.put_string(p_frame->frame_name);
+    w.put_string(p_frame->get_label_type());
+    w.put_string(p_frame->keymode);
+    w.put_string(p_frame->get_tween_type());
+    w.put_color_effect(p_frame->color_effect);
+    w.put_u32(p_frame->drawings.size());
+    for (int i=0; i<p_frame->drawings.size(); i++) {
+        _write_drawing(w, p_frame->drawings[i]);
+    }
+    w.put_u32(p_frame->tweens.size());
+    for (const List<Ref<FlashTween>>::Element *E = p_frame->tweens.front(); E; E = E->next()) {
+        const FlashTween *tween = E->get().ptr();
+        w.put_u32(tween->get_eid());
+        w.put_string(tween->get_target());
+        w.put_i32(tween->get_method());
+        w.put_float(tween->get_intensity());
+        PoolVector2Array points = tween->get_points();
+        PoolVector2Array::Read pr = points.read();
+        w.put_u32(points.size());
+        for (int i=0; i<points.size(); i++) {
+            w.put_vector2(pr[i]);
+        }
+    }
+}
+
+void FlashDocumentFormat::_write_drawing(FlashDocumentWriter &w, const FlashDrawingData &p_drawing) {
+    w.put_u8(p_drawing.kind);
+    w.put_u32(p_drawing.eid);
+    w.put_transform(p_drawing.transform);
+    if (p_drawing.kind == FlashDrawingData::KIND_INSTANCE) {
+        w.put_i32(p_drawing.first_frame);
+        w.put_u8(p_drawing.loop);
+        w.put_string(p_drawing.token);
+        w.put_u8(p_drawing.cache_as_bitmap);
+        w.put_color_effect(p_drawing.color_effect);
+    } else if (p_drawing.kind == FlashDrawingData::KIND_BITMAP) {
+        w.put_string(p_drawing.token);
+    } else if (p_drawing.kind == FlashDrawingData::KIND_GROUP) {
+        w.put_u32(p_drawing.members_count);
+    }
+}
+
+void FlashDocumentFormat::_write_baked_track(FlashDocumentWriter &w, const FlashBakedTrack *p_track) {
+    PoolVector2Array points = p_track->get_points();
+    PoolVector2Array uvs = p_track->get_uvs();
+    PoolColorArray colors = p_track->get_colors();
+    PoolIntArray indices = p_track->get_indices();
+    PoolIntArray vertex_offsets = p_track->get_vertex_offsets();
+    PoolIntArray index_offsets = p_track->get_index_offsets();
+    PoolRealArray clipping = p_track->get_clipping();
+    PoolIntArray clipping_offsets = p_track->get_clipping_offsets();
+
+    w.put_u32(points.size());
+    PoolVector2Array::Read pr = points.read();
+    PoolVector2Array::Read ur = uvs.read();
+    PoolColorArray::Read cr = colors.read();
+    for (int i=0; i<points.size(); i++) {
+        w.put_vector2(pr[i]);
+        w.put_vector2(ur[i]);
+        w.put_color(cr[i]);
+    }
+    const PoolIntArray *int_arrays[] = { &indices, &vertex_offsets, &index_offsets, &clipping_offsets };
+    for (int a=0; a<4; a++) {
+        PoolIntArray::Read ir = int_arrays[a]->read();
+        w.put_u32(int_arrays[a]->size());
+        for (int i=0; i<int_arrays[a]->size(); i++) {
+            w.put_i32(ir[i]);
+        }
+    }
+    PoolRealArray::Read rr = clipping.read();
+    w.put_u32(clipping.size());
+    for (int i=0; i<clipping.size(); i++) {
+        w.put_float(rr[i]);
+    }
+    w.put_variant(p_track->get_events());
+}
+
+Error FlashDocumentFormat::save(const String &p_path, const Ref<FlashDocument> &p_document, Compression p_compression) {
+    ERR_FAIL_COND_V(p_document.is_null(), ERR_INVALID_PARAMETER);
+    // blobs and chunks refer to string table of the file they came from
+    p_document->load_all_symbols();
+    p_document->load_all_frames();
+    const FlashDocument *doc = p_document.ptr();
+    FlashDocumentWriter w;
+
+    w.put_string(doc->document_path);
+    w.put_float(doc->frame_size);
+    w.put_u32(doc->last_eid);
+    w.put_u32(doc->variated_symbols_count);
+    w.put_i32(doc->frame_chunk_size);
+    String atlas_path = doc->atlas.is_valid() ? doc->atlas->get_path() : String();
+    if (doc->residency.is_valid()) atlas_path = doc->residency->get_path();
+    w.put_string(atlas_path);
+    w.put_variant(doc->variants);
+    w.put_variant(doc->import_report);
+
+    w.put_u32(doc->bitmaps.size());
+    for (int i=0; i<doc->bitmaps.size(); i++) {
+        Ref<FlashBitmapItem> item = doc->bitmaps.get_value_at_index(i);
+        ERR_FAIL_COND_V(item.is_null(), ERR_INVALID_DATA);
+        w.put_string(doc->bitmaps.get_key_at_index(i));
+        w.put_u32(item->get_eid());
+        w.put_string(item->name);
+        w.put_string(item->bitmap_path);
+        Ref<FlashTextureRect> texture = item->get_texture();
+        w.put_u8(texture.is_valid());
+        if (texture.is_valid()) {
+            w.put_i32(texture->get_index());
+            w.put_rect2(texture->get_region());
+            w.put_rect2(texture->get_margin());
+            w.put_vector2(texture->get_original_size());
+        }
+    }
+
+    Vector<const FlashTimeline*> symbols;
+    Vector<String> tokens;
+    for (int i=0; i<doc->symbols.size(); i++) {
+        Ref<FlashTimeline> timeline = doc->symbols.get_value_at_index(i);
+        if (timeline.is_null()) continue;
+        symbols.push_back(timeline.ptr());
+        tokens.push_back(doc->symbols.get_key_at_index(i));
+    }
+    // players start instanced symbols at arbitrary frames, so only
+    // timelines nothing instances get chunks
+    Set<String> instanced;
+    if (doc->frame_chunk_size > 0) {
+        for (int i=0; i<symbols.size(); i++) {
+            _collect_instanced(symbols[i], instanced);
+        }
+        for (const List<Ref<FlashTimeline>>::Element *E = doc->timelines.front(); E; E = E->next()) {
+            _collect_instanced(E->get().ptr(), instanced);
+        }
+    }
+
+    w.put_u32(symbols.size());
+    for (int i=0; i<symbols.size(); i++) {
+        w.put_string(tokens[i]);
+        w.put_i32(symbols[i]->symbol_id);
+        w.put_i32(symbols[i]->variation_idx);
+        w.put_string(symbols[i]->local_path);
+        // own block per symbol, so it can be read on demand
+        int block = w.begin_block();
+        _write_timeline(w, symbols[i], instanced.has(tokens[i]) ? 0 : doc->frame_chunk_size);
+        w.end_block(block);
+    }
+
+    w.put_u32(doc->timelines.size());
+    for (const List<Ref<FlashTimeline>>::Element *E = doc->timelines.front(); E; E = E->next()) {
+        _write_timeline(w, E->get().ptr(), doc->frame_chunk_size);
+    }
+
+    w.put_u32(doc->clip_tracks.size());
+    for (int i=0; i<doc->clip_tracks.size(); i++) {
+        const FlashClipTrack &track = doc->clip_tracks[i];
+        w.put_string(track.name);
+        w.put_u32(track.clips.size());
+        PoolStringArray::Read cr = track.clips.read();
+        for (int j=0; j<track.clips.size(); j++) {
+            w.put_string(cr[j]);
+            w.put_vector2(track.ranges[j]);
+        }
+    }
+
+    w.put_u32(doc->baked_tracks.size());
+    for (int i=0; i<doc->baked_tracks.size(); i++) {
+        Ref<FlashBakedTrack> track = doc->baked_tracks.get_value_at_index(i);
+        ERR_FAIL_COND_V(track.is_null(), ERR_INVALID_DATA);
+        w.put_string(doc->baked_tracks.get_key_at_index(i));
+        _write_baked_track(w, track.ptr());
+    }
+
+    Vector<uint8_t> payload = w.get_payload();
+    Vector<uint8_t> stored;
+    if (p_compression == COMPRESSION_NONE) {
+        stored = payload;
+    } else {
+        Compression::Mode mode =
+            p_compression == COMPRESSION_FASTLZ  ? Compression::MODE_FASTLZ :
+            p_compression == COMPRESSION_DEFLATE ? Compression::MODE_DEFLATE :
+                                                   Compression::MODE_ZSTD;
+        stored.resize(Compression::get_max_compressed_buffer_size(payload.size(), mode));
+        int stored_size = Compression::compress(stored.ptrw(), payload.ptr(), payload.size(), mode);
+        ERR_FAIL_COND_V(stored_size < 0, ERR_CANT_CREATE);
+        stored.resize(stored_size);
+    }
+
+    Error err;
+    FileAccess *f = FileAccess::open(p_path, FileAccess::WRITE, &err);
+    ERR_FAIL_COND_V_MSG(err != OK, err, "Can't write " + p_path);
+    f->store_buffer((const uint8_t *)FLASH_DOCUMENT_MAGIC, 4);
+    f->store_32(FORMAT_VERSION);
+    f->store_32(p_compression);
+    f->store_32(payload.size());
+    f->store_32(stored.size());
+    f->store_buffer(stored.ptr(), stored.size());
+    f->close();
+    memdelete(f);
+    return OK;
+}
+
+Ref<FlashTimeline> FlashDocumentFormat::_read_timeline(FlashDocumentReader &r, FlashDocument *p_document, FlashElement *p_parent) {
+    Ref<FlashTimeline> timeline;
+    timeline.instance();
+    timeline->set_eid(r.get_u32());
+    timeline->set_document(p_document);
+    timeline->set_parent(p_parent);
+    timeline->token = r.get_string();
+    timeline->local_path = r.get_string();
+    timeline->clips_header = r.get_string();
+    timeline->duration = r.get_i32();
+    timeline->variation_idx = r.get_i32();
+    timeline->symbol_id = r.get_i32();
+    timeline->clips_track_id = r.get_i32();
+    timeline->clips = r.get_variant();
+    timeline->events = r.get_variant();
+    timeline->variants = r.get_variant();
+    int layers_count = r.get_count();
+    for (int i=0; i<layers_count && !r.failed; i++) {
+        timeline->layers.push_back(_read_layer(r, p_document, timeline.ptr()));
+    }
+    int masks_count = r.get_count();
+    for (int i=0; i<masks_count && !r.failed; i++) {
+        timeline->masks.push_back(_read_layer(r, p_document, timeline.ptr()));
+    }
+    return timeline;
+}
+
+Ref<FlashLayer> FlashDocumentFormat::_read_layer(FlashDocumentReader &r, FlashDocument *p_document, FlashElement *p_parent) {
+    Ref<FlashLayer> layer;
+    layer.instance();
+    layer->set_eid(r.get_u32());
+    layer->set_document(p_document);
+    layer->set_parent(p_parent);
+    layer->index = r.get_i32();
+    layer->layer_name = r.get_string();
+    layer->set_type(r.get_string());
+    layer->duration = r.get_i32();
+    layer->mask_id = r.get_i32();
+    layer->color = r.get_color();
+    int frames_count = r.get_count();
+    for (int i=0; i<frames_count && !r.failed; i++) {
+        layer->frames.push_back(_read_frame(r, p_document, layer.ptr()));
+    }
+    // chunk frames are read by `FlashLayer::stream`
+    int chunks_count = r.get_count();
+    layer->chunks.resize(chunks_count);
+    if (chunks_count > 0) layer->frames_lock = RWLock::create();
+    for (int i=0; i<chunks_count && !r.failed; i++) {
+        FlashFrameChunk &chunk = layer->chunks.write[i];
+        chunk.start = r.get_i32();
+        chunk.end = r.get_i32();
+        uint8_t chunk_flags = r.get_u8();
+        chunk.has_tweens = chunk_flags & 1;
+        chunk.has_cached = chunk_flags & 2;
+        int symbols_count = r.get_count(4);
+        for (int j=0; j<symbols_count && !r.failed; j++) {
+            chunk.symbols.push_back(r.get_string());
+        }
+        int bitmaps_count = r.get_count(4);
+        for (int j=0; j<bitmaps_count && !r.failed; j++) {
+            chunk.bitmaps.push_back(r.get_string());
+        }
+        chunk.size = r.get_count();
+        chunk.offset = r.get_position();
+        r.skip(chunk.size);
+        if (chunk.start >= chunk.end || (i > 0 && chunk.start != layer->chunks[i - 1].end)) {
+            r.failed = true;
+        }
+    }
+    return layer;
+}
+
+Ref<FlashFrame> FlashDocumentFormat::_read_frame(FlashDocumentReader &r, FlashDocument *p_document, FlashElement *p_parent) {
+    Ref<FlashFrame> frame;
+    frame.instance();
+    frame->set_eid(r.get_u32());
+    frame->set_document(p_document);
+    frame->set_parent(p_parent);
+    frame->index = r.get_i32();
+    frame->duration = r.get_i32();
+    frame->frame_name = r.get_string();
+    frame->set_label_type(r.get_string());
+    frame->keymode = r.get_string();
+    frame->set_tween_type(r.get_string());
+    frame->color_effect = r.get_color_effect();
+    int drawings_count = r.get_count();
+    frame->drawings.resize(drawings_count);
+    for (int i=0; i<drawings_count && !r.failed; i++) {
+        _read_drawing(r, frame->drawings.write[i]);
+        // group members follow the group entry
+        const FlashDrawingData &drawing = frame->drawings[i];
+        if (drawing.kind == FlashDrawingData::KIND_GROUP && (drawing.members_count < 0 || drawing.members_count >= drawings_count - i)) {
+            r.failed = true;
+        }
+    }
+    int tweens_count = r.get_count();
+    for (int i=0; i<tweens_count && !r.failed; i++) {
+        Ref<FlashTween> tween;
+        tween.instance();
+        tween->set_eid(r.get_u32());
+        tween->set_document(p_document);
+        tween->set_parent(frame.ptr());
+        tween->set_target(r.get_string());
+        tween->set_method((FlashTween::Method)r.get_i32());
+        tween->set_intensity(r.get_float());
+        PoolVector2Array points;
+        points.resize(r.get_count(8));
+        {
+            PoolVector2Array::Write pw = points.write();
+            for (int j=0; j<points.size(); j++) {
+                pw[j] = r.get_vector2();
+            }
+        }
+        tween->set_points(points);
+        frame->tweens.push_back(tween);
+    }
+    return frame;
+}
+
+void FlashDocumentFormat::_read_drawing(FlashDocumentReader &r, FlashDrawingData &r_drawing) {
+    r_drawing.kind = r.get_u8();
+    if (r_drawing.kind > FlashDrawingData::KIND_GROUP) {
+        r.failed = true;
+        return;
+    }
+    r_drawing.eid = r.get_u32();
+    r_drawing.transform = r.get_transform();
+    if (r_drawing.kind == FlashDrawingData::KIND_INSTANCE) {
+        r_drawing.first_frame = r.get_i32();
+        r_drawing.loop = r.get_u8();
+        r_drawing.token = r.get_string();
+        r_drawing.cache_as_bitmap = r.get_u8();
+        r_drawing.color_effect = r.get_color_effect();
+    } else if (r_drawing.kind == FlashDrawingData::KIND_BITMAP) {
+        r_drawing.token = r.get_string();
+    } else if (r_drawing.kind == FlashDrawingData::KIND_GROUP) {
+        r_drawing.members_count = r.get_i32();
+    }
+}
+
+Ref<FlashBakedTrack> FlashDocumentFormat::_read_baked_track(FlashDocumentReader &r) {
+    Ref<FlashBakedTrack> track;
+    track.instance();
+    int vertices_count = r.get_count(32);
+    PoolVector2Array points;
+    PoolVector2Array uvs;
+    PoolColorArray colors;
+    points.resize(vertices_count);
+    uvs.resize(vertices_count);
+    colors.resize(vertices_count);
+    {
+        PoolVector2Array::Write pw = points.write();
+        PoolVector2Array::Write uw = uvs.write();
+        PoolColorArray::Write cw = colors.write();
+        for (int i=0; i<vertices_count; i++) {
+            pw[i] = r.get_vector2();
+            uw[i] = r.get_vector2();
+            cw[i] = r.get_color();
+        }
+    }
+    PoolIntArray int_arrays[4];
+    for (int a=0; a<4; a++) {
+        int_arrays[a].resize(r.get_count(4));
+        PoolIntArray::Write iw = int_arrays[a].write();
+        for (int i=0; i<int_arrays[a].size(); i++) {
+            iw[i] = r.get_i32();
+        }
+    }
+    PoolRealArray clipping;
+    clipping.resize(r.get_count(4));
+    {
+        PoolRealArray::Write cw = clipping.write();
+        for (int i=0; i<clipping.size(); i++) {
+            cw[i] = r.get_float();
+        }
+    }
+    track->set_points(points);
+    track->set_uvs(uvs);
+    track->set_colors(colors);
+    track->set_indices(int_arrays[0]);
+    track->set_vertex_offsets(int_arrays[1]);
+    track->set_index_offsets(int_arrays[2]);
+    track->set_clipping_offsets(int_arrays[3]);
+    track->set_clipping(clipping);
+    track->set_events(r.get_variant());
+    return track;
+}
+
+Ref<FlashDocument> FlashDocumentFormat::read(const String &p_path, String &r_atlas_path, Error *r_error) {
+    if (r_error) *r_error = ERR_FILE_CORRUPT;
+    Error err;
+    FileAccess *f = FileAccess::open(p_path, FileAccess::READ, &err);
+    if (err != OK) {
+        if (r_error) *r_error = err;
+        ERR_FAIL_V_MSG(Ref<FlashDocument>(), "Can't open " + p_path);
+    }
+    uint8_t magic[4];
+    f->get_buffer(magic, 4);
+    uint32_t version = f->get_32();
+    uint32_t stored_compression = f->get_32();
+    uint32_t payload_size = f->get_32();
+    uint32_t stored_size = f->get_32();
+    uint64_t stored_offset = f->get_position();
+    if (memcmp(magic, FLASH_DOCUMENT_MAGIC, 4) != 0 || version != FORMAT_VERSION || stored_size > f->get_len() - f->get_position()) {
+        memdelete(f);
+        if (r_error) *r_error = ERR_FILE_UNRECOGNIZED;
+        ERR_FAIL_V_MSG(Ref<FlashDocument>(), "Unsupported flash document format: " + p_path);
+    }
+    if (stored_compression > COMPRESSION_ZSTD) {
+        memdelete(f);
+        ERR_FAIL_V_MSG(Ref<FlashDocument>(), "Unknown flash document compression " + itos(stored_compression) + ": " + p_path);
+    }
+    Compression compression = (Compression)stored_compression;
+    Vector<uint8_t> stored;
+    stored.resize(stored_size);
+    f->get_buffer(stored.ptrw(), stored_size);
+    memdelete(f);
+
+    Vector<uint8_t> payload;
+    if (compression == COMPRESSION_NONE) {
+        payload = stored;
+    } else {
+        Compression::Mode mode =
+            compression == COMPRESSION_FASTLZ  ? Compression::MODE_FASTLZ :
+            compression == COMPRESSION_DEFLATE ? Compression::MODE_DEFLATE :
+                                                 Compression::MODE_ZSTD;
+        payload.resize(payload_size);
+        int size = Compression::decompress(payload.ptrw(), payload_size, stored.ptr(), stored_size, mode);
+        ERR_FAIL_COND_V_MSG(size != (int)payload_size, Ref<FlashDocument>(), "Can't decompress " + p_path);
+    }
+
+    FlashDocumentReader r(payload.ptr(), payload.size());
+    r.read_strings();
+
+    Ref<FlashDocument> doc;
+    doc.instance();
+    doc->set_document(doc.ptr());
+    doc->set_parent(NULL);
+    doc->document_path = r.get_string();
+    doc->frame_size = r.get_float();
+    doc->last_eid = r.get_u32();
+    doc->variated_symbols_count = r.get_u32();
+    doc->frame_chunk_size = r.get_i32();
+    r_atlas_path = r.get_string();
+    doc->variants = r.get_variant();
+    doc->import_report = r.get_variant();
+
+    int bitmaps_count = r.get_count();
+    for (int i=0; i<bitmaps_count && !r.failed; i++) {
+        String key = r.get_string();
+        Ref<FlashBitmapItem> item;
+        item.instance();
+        item->set_eid(r.get_u32());
+        item->set_document(doc.ptr());
+        item->set_parent(doc.ptr());
+        item->name = r.get_string();
+        item->bitmap_path = r.get_string();
+        if (r.get_u8()) {
+            Ref<FlashTextureRect> texture;
+            texture.instance();
+            texture->set_index(r.get_i32());
+            texture->set_region(r.get_rect2());
+            texture->set_margin(r.get_rect2());
+            texture->set_original_size(r.get_vector2());
+            item->set_texture(texture);
+        }
+        doc->bitmaps[key] = item;
+    }
+
+    int symbols_count = r.get_count();
+    doc->symbols_by_id.resize(symbols_count);
+    for (int i=0; i<symbols_count; i++) {
+        doc->symbols_by_id.write[i] = NULL;
+    }
+    for (int i=0; i<symbols_count && !r.failed; i++) {
+        String token = r.get_string();
+        FlashSymbolBlob blob;
+        blob.symbol_id = r.get_i32();
+        blob.variation_idx = r.get_i32();
+        blob.local_path = r.get_string();
+        blob.size = r.get_count();
+        blob.offset = r.get_position();
+        r.skip(blob.size);
+        if (blob.symbol_id < 0 || blob.symbol_id >= symbols_count) {
+            r.failed = true;
+            break;
+        }
+        doc->symbol_blobs[token] = blob;
+    }
+
+    int timelines_count = r.get_count();
+    for (int i=0; i<timelines_count && !r.failed; i++) {
+        doc->timelines.push_back(_read_timeline(r, doc.ptr(), doc.ptr()));
+    }
+
+    int tracks_count = r.get_count();
+    for (int i=0; i<tracks_count && !r.failed; i++) {
+        FlashClipTrack track;
+        track.name = r.get_string();
+        int clips_count = r.get_count(12);
+        for (int j=0; j<clips_count && !r.failed; j++) {
+            track.clips.push_back(r.get_string());
+            track.ranges.push_back(r.get_vector2());
+        }
+        doc->clip_track_ids[track.name] = doc->clip_tracks.size();
+        doc->clip_track_names.push_back(track.name);
+        doc->clip_tracks.push_back(track);
+    }
+
+    int baked_count = r.get_count();
+    for (int i=0; i<baked_count && !r.failed; i++) {
+        String key = r.get_string();
+        doc->baked_tracks[key] = _read_baked_track(r);
+    }
+
+    ERR_FAIL_COND_V_MSG(r.failed, Ref<FlashDocument>(), "Corrupted flash document: " + p_path);
+
+    // symbol blobs and frame chunks are read later, see `FlashDocument::get_symbol`
+    // and `FlashLayer::stream`; stored payload is read back from file as is
+    if (compression == COMPRESSION_NONE) {
+        doc->payload_path = p_path;
+        doc->payload_file_offset = stored_offset;
+    } else {
+        doc->payload = payload;
+    }
+    doc->payload_strings = r.get_strings();
+    bool lazy = GLOBAL_GET("flash/loading/lazy_symbols");
+    if (!lazy) {
+        const String *key = NULL;
+        while ((key = doc->symbol_blobs.next(key))) {
+            Ref<FlashTimeline> timeline = read_symbol(doc.ptr(), doc->symbol_blobs[*key]);
+            ERR_FAIL_COND_V_MSG(timeline.is_null(), Ref<FlashDocument>(), "Corrupted flash document: " + p_path);
+            doc->symbols_by_id.write[timeline->symbol_id] = timeline.ptr();
+            doc->symbols[*key] = timeline;
+            doc->symbols_loads++;
+        }
+    }
+    if (r_error) *r_error = OK;
+    return doc;
+}
+
+const uint8_t *FlashDocumentFormat::_get_block(const FlashDocument *p_document, uint32_t p_offset, uint32_t p_size, Vector<uint8_t> &r_buffer) {
+    if (p_document->payload_path == String()) {
+        const Vector<uint8_t> &payload = p_document->payload;
+        ERR_FAIL_COND_V(p_size == 0 || uint64_t(p_offset) + p_size > uint64_t(payload.size()), NULL);
+        return payload.ptr() + p_offset;
+    }
+    Error err;
+    FileAccess *f = FileAccess::open(p_document->payload_path, FileAccess::READ, &err);
+    ERR_FAIL_COND_V_MSG(err != OK, NULL, "Can't open " + p_document->payload_path);
+    f->seek(p_document->payload_file_offset + p_offset);
+    r_buffer.resize(p_size);
+    int size = f->get_buffer(r_buffer.ptrw(), p_size);
+    memdelete(f);
+    ERR_FAIL_COND_V(p_size == 0 || size != (int)p_size, NULL);
+    return r_buffer.ptr();
+}
+
+Ref<FlashTimeline> FlashDocumentFormat::read_symbol(FlashDocument *p_document, const FlashSymbolBlob &p_blob) {
+    Vector<uint8_t> buffer;
+    const uint8_t *data = _get_block(p_document, p_blob.offset, p_blob.size, buffer);
+    ERR_FAIL_COND_V(data == NULL, Ref<FlashTimeline>());
+    FlashDocumentReader r(data, p_blob.size, p_blob.offset);
+    r.set_strings(p_document->payload_strings);
+    Ref<FlashTimeline> timeline = _read_timeline(r, p_document, p_document);
+    ERR_FAIL_COND_V(r.failed || timeline->symbol_id != p_blob.symbol_id, Ref<FlashTimeline>());
+    return timeline;
+}
+
+Error FlashDocumentFormat::read_chunk(FlashDocument *p_document, FlashLayer *p_layer, const FlashFrameChunk &p_chunk, List<Ref<FlashFrame>> &r_frames) {
+    Vector<uint8_t> buffer;
+    const uint8_t *data = _get_block(p_document, p_chunk.offset, p_chunk.size, buffer);
+    ERR_FAIL_COND_V(data == NULL, ERR_FILE_CANT_READ);
+    FlashDocumentReader r(data, p_chunk.size, p_chunk.offset);
+    r.set_strings(p_document->payload_strings);
+    int frames_count = r.get_count();
+    for (int i=0; i<frames_count && !r.failed; i++) {
+        r_frames.push_back(_read_frame(r, p_document, p_layer));
+    }
+    ERR_FAIL_COND_V(r.failed, ERR_FILE_CORRUPT);
+    return OK;
+}
+
+Ref<FlashDocument> FlashDocumentFormat::load(const String &p_path, Error *r_error) {
+    String atlas_path;
+    Ref<FlashDocument> doc = read(p_path, atlas_path, r_error);
+    if (doc.is_null()) return doc;
+
+    if (atlas_path != String()) {
+        // over budget atlas keeps only layers in use, see `FlashAtlasResidency`
+        uint64_t budget = FlashAtlasResidency::get_budget();
+        if (budget > 0 && atlas_path.get_extension() == "ftex") {
+            doc->residency = FlashAtlasResidency::open(atlas_path, budget);
+        }
+        if (doc->residency.is_valid()) {
+            doc->atlas = doc->residency->get_texture();
+        } else {
+            doc->atlas = ResourceLoader::load(atlas_path);
+        }
+    }
+    doc->resolve();
+    if (r_error) *r_error = OK;
+    return doc;
+}
+
+FlashDocumentInteractiveLoader::FlashDocumentInteractiveLoader():
+    translation_remapped(false),
+    thread(NULL),
+    stage(STAGE_READING),
+    decoded_layers(0),
+    decoding_layers(0),
+    worker_done(false),
+    cancelled(false),
+    error(OK),
+    atlas_chunked(false),
+    atlas_resident(false),
+    uploaded_layers(0) {}
+
+FlashDocumentInteractiveLoader::~FlashDocumentInteractiveLoader() {
+    if (thread != NULL) {
+        cancelled = true;
+        Thread::wait_to_finish(thread);
+        memdelete(thread);
+    }
+}
+
+void FlashDocumentInteractiveLoader::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("get_load_stage"), &FlashDocumentInteractiveLoader::get_load_stage);
+
+    BIND_ENUM_CONSTANT(STAGE_READING);
+    BIND_ENUM_CONSTANT(STAGE_RESOLVING);
+    BIND_ENUM_CONSTANT(STAGE_DECODING);
+    BIND_ENUM_CONSTANT(STAGE_UPLOADING);
+    BIND_ENUM_CONSTANT(STAGE_DONE);
+}
+
+Error FlashDocumentInteractiveLoader::start(const String &p_path) {
+    ERR_FAIL_COND_V(thread != NULL, ERR_ALREADY_IN_USE);
+    ERR_FAIL_COND_V_MSG(!FileAccess::exists(p_path), ERR_FILE_NOT_FOUND, "Can't open " + p_path);
+    path = p_path;
+    local_path = p_path;
+    thread = Thread::create(_worker, this);
+    return thread != NULL ? OK : ERR_CANT_CREATE;
+}
+
+void FlashDocumentInteractiveLoader::_worker(void *p_userdata) {
+    FlashDocumentInteractiveLoader *loader = (FlashDocumentInteractiveLoader *)p_userdata;
+    loader->_work();
+    loader->worker_done = true;
+}
+
+void FlashDocumentInteractiveLoader::_work() {
+    document = FlashDocumentFormat::read(path, atlas_path, &error);
+    if (document.is_null()) return;
+
+    stage = STAGE_RESOLVING;
+    FileAccess *f = atlas_path != String() ? FileAccess::open(atlas_path, FileAccess::READ) : NULL;
+    if (f != NULL && ResourceFormatLoaderFlashTexture::read_header(f, atlas_header) == OK) {
+        atlas_chunked = true;
+        atlas_resident = FlashAtlasResidency::is_needed(atlas_header, FlashAtlasResidency::get_budget());
+        // layers are placed by uvs only, so document may be resolved before upload
+        document->resolve(Vector2(atlas_header.width, atlas_header.height));
+    }
+
+    // resident atlas reads its layers on demand
+    if (atlas_chunked && !atlas_resident) {
+        layers.resize(atlas_header.get_layers());
+        decoding_layers = layers.size();
+        stage = STAGE_DECODING;
+        for (int i=0; i<layers.size() && !cancelled; i++) {
+            layers.write[i] = ResourceFormatLoaderFlashTexture::read_layer(f, atlas_header, i);
+            if (layers[i].is_null()) {
+                error = ERR_FILE_CORRUPT;
+                break;
+            }
+            atomic_increment(&decoded_layers);
+        }
+    }
+    if (f != NULL) memdelete(f);
+}
+
+Error FlashDocumentInteractiveLoader::poll() {
+    if (stage == STAGE_DONE) return ERR_FILE_EOF;
+    if (thread != NULL) {
+        if (!worker_done) return OK;
+        Error err = _join();
+        if (err != OK || stage == STAGE_UPLOADING) return err;
+    }
+    if (error != OK) return error;
+    if (stage == STAGE_UPLOADING && uploaded_layers < layers.size()) {
+        atlas->set_layer_data(layers[uploaded_layers], uploaded_layers);
+        layers.write[uploaded_layers].unref();
+        uploaded_layers++;
+        return OK;
+    }
+    error = _finish();
+    ERR_FAIL_COND_V_MSG(error != OK, error, "Can't load flash document " + path);
+    stage = STAGE_DONE;
+    return ERR_FILE_EOF;
+}
+
+// Blocking loads join worker instead of polling it in a loop
+Error FlashDocumentInteractiveLoader::wait() {
+    if (thread != NULL) {
+        Error err = _join();
+        if (err != OK) return err;
+    }
+    Error err = poll();
+    while (err == OK) {
+        err = poll();
+    }
+    return err;
+}
+
+Error FlashDocumentInteractiveLoader::_join() {
+    Thread::wait_to_finish(thread);
+    memdelete(thread);
+    thread = NULL;
+    ERR_FAIL_COND_V_MSG(error != OK, error, "Can't load flash document " + path);
+    // atlas loaded elsewhere meanwhile is reused in `_finish`
+    if (layers.size() > 0 && !ResourceCache::has(atlas_path)) {
+        atlas.instance();
+        atlas->create(atlas_header.width, atlas_header.height, layers.size(), atlas_header.format, atlas_header.flags);
+        stage = STAGE_UPLOADING;
+    }
+    return OK;
+}
+
+Error FlashDocumentInteractiveLoader::_finish() {
+    layers.clear();
+    if (atlas_path != String()) {
+        if (ResourceCache::has(atlas_path)) {
+            document->atlas = RES(ResourceCache::get(atlas_path));
+        } else if (atlas_resident) {
+            document->residency = FlashAtlasResidency::open(atlas_path, FlashAtlasResidency::get_budget());
+            if (document->residency.is_valid()) document->atlas = document->residency->get_texture();
+        } else if (atlas.is_valid()) {
+            atlas->set_path(atlas_path);
+            document->atlas = atlas;
+        }
+        // legacy atlas files are loaded in one go
+        if (document->atlas.is_null()) document->atlas = ResourceLoader::load(atlas_path);
+        ERR_FAIL_COND_V(document->atlas.is_null(), ERR_FILE_MISSING_DEPENDENCIES);
+    }
+    if (!atlas_chunked) document->resolve();
+    if (local_path != String() && !ResourceCache::has(local_path)) document->set_path(local_path);
+    if (translation_remapped) document->set_as_translation_remapped(true);
+    return OK;
+}
+
+Ref<Resource> FlashDocumentInteractiveLoader::get_resource() {
+    return stage == STAGE_DONE ? document : Ref<FlashDocument>();
+}
+
+int FlashDocumentInteractiveLoader::get_stage() const {
+    switch (stage) {
+        case STAGE_READING: return 0;
+        case STAGE_RESOLVING: return 1;
+        case STAGE_DECODING: return 2 + decoded_layers;
+        case STAGE_UPLOADING: return 2 + decoding_layers + uploaded_layers;
+        default: return get_stage_count();
+    }
+}
+
+int FlashDocumentInteractiveLoader::get_stage_count() const {
+    // layers count is known once atlas header is read
+    return 3 + decoding_layers * 2;
+}
+
+Ref<ResourceInteractiveLoader> ResourceFormatLoaderFlashDocument::load_interactive(const String &p_path, const String &p_original_path, Error *r_error) {
+    Ref<FlashDocumentInteractiveLoader> loader;
+    loader.instance();
+    Error err = loader->start(p_path);
+    if (r_error) *r_error = err;
+    if (err != OK) return Ref<ResourceInteractiveLoader>();
+    if (p_original_path != String()) loader->set_local_path(p_original_path);
+    return loader;
+}
+
+RES ResourceFormatLoaderFlashDocument::load(const String &p_path, const String &p_original_path, Error *r_error) {
+    return FlashDocumentFormat::load(p_path, r_error);
+}
+void ResourceFormatLoaderFlashDocument::get_recognized_extensions(List<String> *p_extensions) const {
+    p_extensions->push_back("fdoc");
+}
+bool ResourceFormatLoaderFlashDocument::handles_type(const String &p_type) const {
+    return p_type == "FlashDocument";
+}
+String ResourceFormatLoaderFlashDocument::get_resource_type(const String &p_path) const {
+    if (p_path.get_extension().to_lower() == "fdoc")
+        return "FlashDocument";
+    return "";
+}
+
+Error ResourceFormatSaverFlashDocument::save(const String &p_path, const RES &p_resource, uint32_t p_flags) {
+    Ref<FlashDocument> doc = p_resource;
+    ERR_FAIL_COND_V(doc.is_null(), ERR_INVALID_PARAMETER);
+    FlashDocumentFormat::Compression compression = (p_flags & ResourceSaver::FLAG_COMPRESS) ? FlashDocumentFormat::COMPRESSION_ZSTD : FlashDocumentFormat::COMPRESSION_NONE;
+    return FlashDocumentFormat::save(p_path, doc, compression);
+}
+bool ResourceFormatSaverFlashDocument::recognize(const RES &p_resource) const {
+    return Object::cast_to<FlashDocument>(*p_resource) != NULL;
+}
+void ResourceFormatSaverFlashDocument::get_recognized_extensions(const RES &p_resource, List<String> *p_extensions) const {
+    if (Object::cast_to<FlashDocument>(*p_resource)) {
+        p_extensions->push_back("fdoc");
+    }
+}
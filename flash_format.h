@@ -0,0 +1,174 @@
+// MIT License
+
+// Copyright (c) 2021 Yakov Borevich, Funexpected LLC
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef FLASH_FORMAT_H
+#define FLASH_FORMAT_H
+
+#include <core/io/resource_loader.h>
+#include <core/io/resource_saver.h>
+#include <core/set.h>
+
+#include "flash_residency.h"
+
+class FlashDocument;
+class FlashTimeline;
+class FlashLayer;
+class FlashFrame;
+struct FlashDrawingData;
+struct FlashSymbolBlob;
+struct FlashFrameChunk;
+class FlashElement;
+class FlashBakedTrack;
+class FlashDocumentWriter;
+class FlashDocumentReader;
+class Thread;
+
+// Flat binary layout of imported FlashDocument. Elements are written
+// depth first, each followed by its children count and children (frame
+// drawings are written as stored, groups flattened), all
+// strings go to a single table and are referred by index. Variant and
+// clip tables are stored as computed on import, so loading doesn't
+// need to run `setup` again. Every library symbol is a size prefixed
+// block, only indexed on load and read on first use. Long layers of
+// timelines not instanced anywhere are split at keyframes into size
+// prefixed frame chunks, see `FlashDocument::set_frame_chunk_size`.
+class FlashDocumentFormat {
+    static void _write_timeline(FlashDocumentWriter &w, const FlashTimeline *p_timeline, int p_chunk_size=0);
+    static void _write_layer(FlashDocumentWriter &w, const FlashLayer *p_layer, int p_chunk_size);
+    static void _write_chunk(FlashDocumentWriter &w, const List<Ref<FlashFrame>>::Element *p_from, const List<Ref<FlashFrame>>::Element *p_to, int p_end);
+    static void _collect_instanced(const FlashTimeline *p_timeline, Set<String> &r_tokens);
+    static void _write_frame(FlashDocumentWriter &w, const FlashFrame *p_frame);
+    static void _write_drawing(FlashDocumentWriter &w, const FlashDrawingData &p_drawing);
+    static void _write_baked_track(FlashDocumentWriter &w, const FlashBakedTrack *p_track);
+
+    static Ref<FlashTimeline> _read_timeline(FlashDocumentReader &r, FlashDocument *p_document, FlashElement *p_parent);
+    static Ref<FlashLayer> _read_layer(FlashDocumentReader &r, FlashDocument *p_document, FlashElement *p_parent);
+    static Ref<FlashFrame> _read_frame(FlashDocumentReader &r, FlashDocument *p_document, FlashElement *p_parent);
+    static void _read_drawing(FlashDocumentReader &r, FlashDrawingData &r_drawing);
+    static Ref<FlashBakedTrack> _read_baked_track(FlashDocumentReader &r);
+    static const uint8_t *_get_block(const FlashDocument *p_document, uint32_t p_offset, uint32_t p_size, Vector<uint8_t> &r_buffer);
+
+public:
+    enum {
+        FORMAT_VERSION = 5
+    };
+
+    enum Compression {
+        COMPRESSION_NONE,
+        COMPRESSION_FASTLZ,
+        COMPRESSION_DEFLATE,
+        COMPRESSION_ZSTD
+    };
+
+    static Error save(const String &p_path, const Ref<FlashDocument> &p_document, Compression p_compression=COMPRESSION_NONE);
+    // document without atlas and not resolved yet, safe to call off main thread
+    static Ref<FlashDocument> read(const String &p_path, String &r_atlas_path, Error *r_error=NULL);
+    static Ref<FlashTimeline> read_symbol(FlashDocument *p_document, const FlashSymbolBlob &p_blob);
+    static Error read_chunk(FlashDocument *p_document, FlashLayer *p_layer, const FlashFrameChunk &p_chunk, List<Ref<FlashFrame>> &r_frames);
+    static Ref<FlashDocument> load(const String &p_path, Error *r_error=NULL);
+};
+
+// Loads document on a worker thread: reads `.fdoc`, resolves it and
+// decodes atlas layers. `poll` never waits for the worker, once it is
+// done every call uploads a single atlas layer to the texture array,
+// so main thread pays for one layer upload per call at most. Stages
+// follow `Stage` order, decoding and uploading take one stage per layer.
+class FlashDocumentInteractiveLoader: public ResourceInteractiveLoader {
+    GDCLASS(FlashDocumentInteractiveLoader, ResourceInteractiveLoader);
+
+public:
+    enum Stage {
+        STAGE_READING,
+        STAGE_RESOLVING,
+        STAGE_DECODING,
+        STAGE_UPLOADING,
+        STAGE_DONE
+    };
+
+private:
+    String path;
+    String local_path;
+    bool translation_remapped;
+    Thread *thread;
+
+    // written by worker, main thread reads them only for progress
+    // until `worker_done` is set and thread is joined
+    volatile uint32_t stage;
+    volatile uint32_t decoded_layers;
+    volatile uint32_t decoding_layers;
+    volatile bool worker_done;
+    volatile bool cancelled;
+
+    Error error;
+    Ref<FlashDocument> document;
+    String atlas_path;
+    FlashTextureHeader atlas_header;
+    bool atlas_chunked;
+    bool atlas_resident;
+    Vector<Ref<Image>> layers;
+
+    Ref<TextureArray> atlas;
+    int uploaded_layers;
+
+    static void _worker(void *p_userdata);
+    void _work();
+    Error _join();
+    Error _finish();
+
+protected:
+    static void _bind_methods();
+
+public:
+    FlashDocumentInteractiveLoader();
+    ~FlashDocumentInteractiveLoader();
+
+    Error start(const String &p_path);
+    Stage get_load_stage() const { return (Stage)stage; }
+
+    virtual void set_local_path(const String &p_local_path) { local_path = p_local_path; }
+    virtual Ref<Resource> get_resource();
+    virtual Error poll();
+    virtual Error wait();
+    virtual int get_stage() const;
+    virtual int get_stage_count() const;
+    virtual void set_translation_remapped(bool p_remapped) { translation_remapped = p_remapped; }
+};
+
+VARIANT_ENUM_CAST(FlashDocumentInteractiveLoader::Stage);
+
+class ResourceFormatLoaderFlashDocument: public ResourceFormatLoader {
+public:
+    virtual Ref<ResourceInteractiveLoader> load_interactive(const String &p_path, const String &p_original_path = "", Error *r_error = NULL);
+    virtual RES load(const String &p_path, const String &p_original_path = "", Error *r_error = NULL);
+    virtual void get_recognized_extensions(List<String> *p_extensions) const;
+    virtual bool handles_type(const String &p_type) const;
+    virtual String get_resource_type(const String &p_path) const;
+};
+
+class ResourceFormatSaverFlashDocument: public ResourceFormatSaver {
+public:
+    virtual Error save(const String &p_path, const RES &p_resource, uint32_t p_flags = 0);
+    virtual bool recognize(const RES &p_resource) const;
+    virtual void get_recognized_extensions(const RES &p_resource, List<String> *p_extensions) const;
+};
+
+#endif
@@ -22,6 +22,9 @@
 
 
 #include "flash_player.h"
+#include "flash_server.h"
+
+#include <core/os/os.h>
 
 #ifdef TOOLS_ENABLED
 #include <core/engine.h>
@@ -40,31 +43,39 @@ void FlashPlayer::_notification(int p_what) {
                 VisualServer::get_singleton()->material_set_param(flash_material, "CLIPPING_TEXTURE", clipping_texture);
             }
             if (resource.is_valid()) {
-                VisualServer::get_singleton()->material_set_param(flash_material, "ATLAS_SIZE", resource->get_atlas_size());
-                VisualServer::get_singleton()->material_set_param(flash_material, "ATLAS", resource->get_atlas());
+                _update_atlas_params();
             }
+            // READY fires only once, so re-entering players register here too
+            _update_processing();
         } break;
-        case NOTIFICATION_READY: {
-            set_process(true);
+
+        case NOTIFICATION_EXIT_TREE: {
+            set_process(false);
+            if (FlashServer::get_singleton() != NULL) {
+                FlashServer::get_singleton()->set_player_active(this, false);
+            }
+            _release_residency();
         } break;
 
         case NOTIFICATION_PROCESS: {
             performance_triangles_generated = 0;
+            if (geometry_stale) _check_geometry_needed();
             if (playing && active_symbol.is_valid()) {
                 advance(get_process_delta_time(), false, true);
             }
         } break;
 
         case NOTIFICATION_DRAW: {
-            if (active_symbol.is_valid() && points.size() > 0 && resource.is_valid()) {
+            _update_residency();
+            if (active_symbol.is_valid() && output.points.size() > 0 && resource.is_valid()) {
                 update_clipping_data();
                 VisualServer::get_singleton()->mesh_clear(mesh);
                 Array arrays;
                 arrays.resize(Mesh::ARRAY_MAX);
-                arrays[Mesh::ARRAY_VERTEX] = points;
-                arrays[Mesh::ARRAY_INDEX] = indices;
-                arrays[Mesh::ARRAY_COLOR] = colors;
-                arrays[Mesh::ARRAY_TEX_UV] = uvs;
+                arrays[Mesh::ARRAY_VERTEX] = output.points;
+                arrays[Mesh::ARRAY_INDEX] = output.indices;
+                arrays[Mesh::ARRAY_COLOR] = output.colors;
+                arrays[Mesh::ARRAY_TEX_UV] = output.uvs;
                 VisualServer::get_singleton()->mesh_add_surface_from_arrays(
                     mesh,
                     VisualServer::PRIMITIVE_TRIANGLES,
@@ -72,30 +83,82 @@ void FlashPlayer::_notification(int p_what) {
                     VisualServer::ARRAY_FLAG_USE_2D_VERTICES
                 );
                 VisualServer::get_singleton()->canvas_item_add_mesh(get_canvas_item(), mesh);
-                performance_triangles_drawn = indices.size() / 3;
+                performance_triangles_drawn = output.indices.size() / 3;
             }
         } break;
 
         case NOTIFICATION_VISIBILITY_CHANGED: {
             performance_triangles_drawn = 0;
             performance_triangles_generated = 0;
+            if (geometry_stale) _check_geometry_needed();
         } break;
     }
 };
+void FlashPlayer::_update_atlas_params() {
+    VisualServer *vs = VisualServer::get_singleton();
+    Ref<FlashAtlasResidency> residency = resource->get_residency();
+    vs->material_set_param(flash_material, "ATLAS_SIZE", resource->get_atlas_size());
+    vs->material_set_param(flash_material, "ATLAS", resource->get_atlas());
+    vs->material_set_param(flash_material, "ATLAS_RESIDENCY", residency.is_valid());
+    vs->material_set_param(flash_material, "ATLAS_SLOTS", residency.is_valid() ? residency->get_slots_texture() : Ref<ImageTexture>());
+}
+// Pins atlas layers of active symbol while player is drawn,
+// called on main thread only (layers are uploaded right away).
+void FlashPlayer::_update_residency() {
+    Ref<FlashTimeline> symbol = resource.is_valid() ? active_symbol : Ref<FlashTimeline>();
+    if (resident_document == resource && resident_symbol == symbol) return;
+    _release_residency();
+    if (symbol.is_null() || resource->get_residency().is_null()) return;
+    resident_document = resource;
+    resident_symbol = symbol;
+    resident_document->acquire_symbol(resident_symbol.ptr());
+}
+void FlashPlayer::_release_residency() {
+    if (resident_document.is_valid()) {
+        resident_document->release_symbol(resident_symbol.ptr());
+    }
+    resident_document.unref();
+    resident_symbol.unref();
+}
 void FlashPlayer::override_frame(String p_symbol, Variant p_value) {
     //ERR_FAIL_COND_MSG(resource.is_null(), "Can't override symbol without resource");
     if (resource.is_null()) return;
-    Ref<FlashTimeline> symbol = resource->get_symbols().get(p_symbol, Ref<FlashTimeline>());
-    if (symbol.is_null()) return;
-    if (symbol->get_variation_idx() < 0) return;
+    int variation_idx = resource->get_variation_idx(p_symbol);
+    if (variation_idx < 0) return;
     if (p_value.get_type() == Variant::NIL) {
-        frame_overrides.set(symbol->get_variation_idx(), -1);
+        state.frame_overrides.set(variation_idx, -1);
+        variants_version++;
+        tracks_dirty = true;
         queue_process();
     } else if (p_value.get_type() == Variant::REAL || p_value.get_type() == Variant::INT) {
-        frame_overrides.set(symbol->get_variation_idx(), p_value);
+        state.frame_overrides.set(variation_idx, p_value);
+        frames_overridden = true;
+        baked_track_dirty = true;
+        variants_version++;
+        tracks_dirty = true;
         queue_process();
     }
 }
+void FlashPlayer::queue_variant(const String &p_variant, const Variant &p_value) {
+    ERR_FAIL_COND(FlashServer::get_singleton() == NULL);
+    FlashServer::get_singleton()->post_command(get_instance_id(), FlashServer::COMMAND_SET_VARIANT, p_variant, p_value);
+}
+void FlashPlayer::queue_clip(const String &p_track, const Variant &p_clip) {
+    ERR_FAIL_COND(FlashServer::get_singleton() == NULL);
+    FlashServer::get_singleton()->post_command(get_instance_id(), FlashServer::COMMAND_SET_CLIP, p_track, p_clip);
+}
+void FlashPlayer::queue_frame_override(const String &p_symbol, const Variant &p_frame) {
+    ERR_FAIL_COND(FlashServer::get_singleton() == NULL);
+    FlashServer::get_singleton()->post_command(get_instance_id(), FlashServer::COMMAND_OVERRIDE_FRAME, p_symbol, p_frame);
+}
+void FlashPlayer::queue_active_clip(const String &p_clip) {
+    ERR_FAIL_COND(FlashServer::get_singleton() == NULL);
+    FlashServer::get_singleton()->post_command(get_instance_id(), FlashServer::COMMAND_SET_ACTIVE_CLIP, String(), p_clip);
+}
+void FlashPlayer::queue_advance(float p_delta) {
+    ERR_FAIL_COND(FlashServer::get_singleton() == NULL);
+    FlashServer::get_singleton()->post_command(get_instance_id(), FlashServer::COMMAND_ADVANCE, String(), p_delta);
+}
 void FlashPlayer::set_variant(String variant, Variant value) {
     if (value == Variant() || value == "[default]") {
         if(active_variants.has(variant)) active_variants.erase(variant);
@@ -110,70 +173,112 @@ void FlashPlayer::set_variant(String variant, Variant value) {
         if (symbols_by_variant.has(value)) {
             if (value == "[default]") {
                 for (int i=0; i<symbols_by_variant.size(); i++) {
-                    Ref<FlashTimeline> symbol = resource->get_symbols().get(symbols_by_variant.get_key_at_index(i), Variant());
-                    if (symbol.is_null() || symbol->get_variation_idx() < 0) continue;
-                    frame_overrides.set(symbol->get_variation_idx(), -1);
+                    int variation_idx = resource->get_variation_idx(symbols_by_variant.get_key_at_index(i));
+                    if (variation_idx < 0) continue;
+                    state.frame_overrides.set(variation_idx, -1);
                 }
             } else {
                 Dictionary frames_by_symbol = symbols_by_variant[value];
                 for (int i=0; i<frames_by_symbol.size(); i++) {
                     String token = frames_by_symbol.get_key_at_index(i);
-                    Ref<FlashTimeline> symbol = resource->get_symbols().get(token, Variant());
-                    if (symbol.is_null() || symbol->get_variation_idx() < 0) continue;
+                    int variation_idx = resource->get_variation_idx(token);
+                    if (variation_idx < 0) continue;
                     int frame = frames_by_symbol.get_value_at_index(i);
-                    frame_overrides.set(symbol->get_variation_idx(), frame);
+                    state.frame_overrides.set(variation_idx, frame);
                 }
             }
         }
     }
+    variants_version++;
+    baked_track_dirty = true;
+    tracks_dirty = true;
     queue_process();
 }
+Dictionary FlashPlayer::get_active_variants() const {
+    Dictionary result;
+    const String *key = NULL;
+    while ((key = active_variants.next(key))) {
+        result[*key] = active_variants[*key];
+    }
+    return result;
+}
+
+// Replaces all variants at once, overrides made by `override_frame` are reset
+void FlashPlayer::set_active_variants(const Dictionary &p_variants) {
+    if (!resource.is_valid()) return;
+    Vector<int> overrides;
+    resource->compile_variants(p_variants, overrides);
+    _apply_frame_overrides(p_variants, overrides);
+}
+
+void FlashPlayer::apply_skin_preset(const Ref<FlashSkinPreset> &p_preset) {
+    ERR_FAIL_COND(p_preset.is_null());
+    if (!resource.is_valid()) return;
+    _apply_frame_overrides(p_preset->get_variants(), p_preset->get_frame_overrides(resource.ptr()));
+}
+
+void FlashPlayer::_apply_frame_overrides(const Dictionary &p_variants, const Vector<int> &p_overrides) {
+    ERR_FAIL_COND(p_overrides.size() != state.frame_overrides.size());
+    if (state.frame_overrides.size() > 0) {
+        copymem(state.frame_overrides.ptrw(), p_overrides.ptr(), sizeof(int) * p_overrides.size());
+    }
+    active_variants.clear();
+    for (int i=0; i<p_variants.size(); i++) {
+        String value = p_variants.get_value_at_index(i);
+        if (value == String() || value == "[default]") continue;
+        active_variants[p_variants.get_key_at_index(i)] = value;
+    }
+    frames_overridden = false;
+    variants_version++;
+    baked_track_dirty = true;
+    tracks_dirty = true;
+    queue_process();
+    _change_notify();
+}
+
 String FlashPlayer::get_variant(String variant) const {
     return active_variants.has(variant) ? active_variants[variant] : "[default]";
 }
 
 void FlashPlayer::set_clip(String clip, Variant value) {
     if (!resource.is_valid()) return;
+    int track_id = resource->find_clip_track(clip);
+    if (track_id < 0) return;
     if (value == Variant() || value == "[default]") {
-        if(clips_state.has(clip)) clips_state.erase(clip);
-        if(active_clips.has(clip)) active_clips.erase(clip);
+        set_clip_by_id(track_id, -1);
     } else {
-        String *track_clip = active_clips.getptr(clip);
-        if (track_clip == NULL || *track_clip == value) return;
-        active_clips[clip] = value;
-        Array timelines = resource->get_symbols().values();
-        for (int i=0; i<timelines.size(); i++) {
-            Ref<FlashTimeline> tl = timelines[i];
-            if (clip != tl->get_clips_header()) continue;
-            Vector2 clip_data = tl->get_clips()[value];
-            clips_state[clip] = Vector3(clip_data.x, clip_data.y, 0.0);
-            break;
-        }
+        set_clip_by_id(track_id, resource->find_clip(track_id, value));
     }
-    tracks_dirty = true;
-    queue_process();
 }
 
 String FlashPlayer::get_clip(String clip) const {
-    return active_clips.has(clip) ? active_clips[clip] : "[default]";
+    if (!resource.is_valid()) return "[default]";
+    int track_id = resource->find_clip_track(clip);
+    int clip_id = get_clip_id(track_id);
+    if (clip_id < 0) return "[default]";
+    return resource->get_clip_track(track_id).clips[clip_id];
 }
 
-float FlashPlayer::get_symbol_frame(FlashTimeline* p_symbol, float p_default) {
-    if (p_symbol == NULL) {
-        return p_default;
-    }
-
-    Vector3 *clip = clips_state.getptr(p_symbol->get_clips_header());
-    if (clip != NULL) {
-        return clip->x + clip->z;        
-    }
-
-    if (p_symbol->get_variation_idx() < 0) {
-        return p_default;
+void FlashPlayer::set_clip_by_id(int p_track, int p_clip) {
+    ERR_FAIL_INDEX(p_track, state.active_clips.size());
+    if (state.active_clips[p_track] == p_clip) return;
+    const FlashClipTrack &track = resource->get_clip_track(p_track);
+    ERR_FAIL_COND(p_clip >= track.ranges.size());
+    if (state.active_clips[p_track] >= 0) active_clips_count--;
+    if (p_clip >= 0) {
+        Vector2 clip_data = track.ranges[p_clip];
+        state.clips_state.write[p_track] = Vector3(clip_data.x, clip_data.y, 0.0);
+        active_clips_count++;
     }
+    state.active_clips.write[p_track] = p_clip;
+    tracks_dirty = true;
+    clips_version++;
+    baked_track_dirty = true;
+    queue_process();
+}
 
-    float frame = frame_overrides[p_symbol->get_variation_idx()];
-    return frame < 0 ? p_default : frame;
+int FlashPlayer::get_clip_id(int p_track) const {
+    return state.get_clip_id(p_track);
 }
 
 Dictionary FlashPlayer::get_variants() const {
@@ -212,7 +317,19 @@ bool FlashPlayer::_get(const StringName &p_name, Variant &r_ret) const {
 	} else if (p_name == "performance/triangles_generated") {
 		r_ret = performance_triangles_generated;
         return true;
-	}
+	} else if (p_name == "performance/cache_hits") {
+        r_ret = geometry_cache.get_hits();
+        return true;
+    } else if (p_name == "performance/cache_misses") {
+        r_ret = geometry_cache.get_misses();
+        return true;
+    } else if (p_name == "performance/cache_memory") {
+        r_ret = geometry_cache.get_memory_usage();
+        return true;
+    } else if (p_name == "performance/baked") {
+        r_ret = baked_track.is_valid();
+        return true;
+    }
     return false;
 }
 
@@ -229,81 +346,41 @@ void FlashPlayer::_get_property_list(List<PropertyInfo> *p_list) const {
         }
         p_list->push_back(PropertyInfo(Variant::STRING, "variants/" + key, PROPERTY_HINT_ENUM, options_string));
     }
-    HashMap<String, Vector<String>> clips;
-    Array timelines = resource->get_symbols().values();
-    for (int i=0; i<timelines.size(); i++) {
-        Ref<FlashTimeline> tl = timelines[i];
-        String clips_header = tl->get_clips_header();
-        if (clips_header == String()) continue;
-        Array clip_names = tl->get_clips().keys();
-        for (int i=0; i<clip_names.size(); i++) {
-            String clip_name = clip_names[i];
-            if (clips[clips_header].find(clip_name) < 0) {
-                clips[clips_header].push_back(clip_name);
-            }
-        }
-    }
-    List<String> clip_keys;
-    clips.get_key_list(&clip_keys);
-    for (List<String>::Element *E = clip_keys.front(); E; E = E->next()) {
-        String clips_key = E->get();
-        Vector<String> timeline_clips = clips[clips_key];
-        timeline_clips.insert(0, "[default]");
-        p_list->push_back(PropertyInfo(Variant::STRING, "clips/" + clips_key, PROPERTY_HINT_ENUM, String(",").join(timeline_clips)));
+    for (int i=0; i<resource->get_clip_tracks_count(); i++) {
+        const FlashClipTrack &track = resource->get_clip_track(i);
+        p_list->push_back(PropertyInfo(Variant::STRING, "clips/" + track.name, PROPERTY_HINT_ENUM, "[default]," + String(",").join(track.clips)));
     }
 }
 
 PoolStringArray FlashPlayer::get_clips_tracks() const {
-    PoolStringArray result;
-    Dictionary unique;
-    if (!resource.is_valid()) return result;
-    Array timelines = resource->get_symbols().values();
-    for (int i=0; i<timelines.size(); i++) {
-        Ref<FlashTimeline> tl = timelines[i];
-        String clips_track = tl->get_clips_header();
-        if (clips_track == String()) continue;
-        if (!unique.has(clips_track)) {
-            unique[clips_track] = true;
-            result.push_back(clips_track);
-        }
-    }
-    return result;
+    if (!resource.is_valid()) return PoolStringArray();
+    return resource->get_clip_track_names();
 }
 
 PoolStringArray FlashPlayer::get_clips_for_track(const String &track) const {
-    PoolStringArray result;
-    Dictionary cache;
-    if (!resource.is_valid()) return result;
-    Array timelines = resource->get_symbols().values();
-    for (int i=0; i<timelines.size(); i++) {
-        Ref<FlashTimeline> tl = timelines[i];
-        String clips_track = tl->get_clips_header();
-        if (clips_track != track) continue;
-        Array clip_names = tl->get_clips().keys();
-        for (int i=0; i<clip_names.size(); i++) {
-            String clip_name = clip_names[i];
-            if (!cache.has(clip_name)) {
-                cache[clip_name] = true;
-                result.push_back(clip_name);
-            }
-        }
-    }
-    return result;
+    if (!resource.is_valid()) return PoolStringArray();
+    int track_id = resource->find_clip_track(track);
+    if (track_id < 0) return PoolStringArray();
+    return resource->get_clip_track(track_id).clips;
 }
 
 float FlashPlayer::get_clip_duration(const String &header, const String &clip) const {
-    return 0.0;
+    if (!resource.is_valid()) return 0.0;
+    int track_id = resource->find_clip_track(header);
+    if (track_id < 0) return 0.0;
+    int clip_id = resource->find_clip(track_id, clip);
+    if (clip_id < 0) return 0.0;
+    Vector2 range = resource->get_clip_track(track_id).ranges[clip_id];
+    return range.y - range.x;
 }
 
 void FlashPlayer::_validate_property(PropertyInfo &prop) const {
     if (prop.name == "active_symbol"){
         String symbols_hint = "[document]";
         if (resource.is_valid()) {
-            Array symbols = resource->get_symbols().values();
+            PoolStringArray symbols = resource->get_symbol_names(true);
             for (int i=0; i<symbols.size(); i++){
-                Ref<FlashTimeline> symbol = symbols[i];
-                if (symbol->get_local_path().find("/") >= 0) continue;
-                symbols_hint += "," + symbol->get_token();
+                symbols_hint += "," + symbols[i];
             }
         }
         prop.hint_string = symbols_hint;
@@ -331,6 +408,10 @@ void FlashPlayer::_validate_property(PropertyInfo &prop) const {
         }
     }
 
+    if (prop.name == "quantization_fps" && playback_quantization != QUANTIZATION_CUSTOM) {
+        prop.usage = PROPERTY_USAGE_NOEDITOR;
+    }
+
     if (prop.name == "material" || prop.name == "use_parent_material") {
         prop.usage = PROPERTY_USAGE_NOEDITOR|PROPERTY_USAGE_RESOURCE_NOT_PERSISTENT;
     }
@@ -350,20 +431,32 @@ void FlashPlayer::set_resource(const Ref<FlashDocument> &doc) {
     processed_frame = -1;
     playback_start = 0;
     playback_end = 0;
-    frame_overrides.clear();
+    state.frame_overrides.clear();
     active_variants.clear();
+    geometry_cache.clear();
+    variants_version++;
+    clips_version++;
+    frames_overridden = false;
+    baked_track_dirty = true;
+    active_clips_count = 0;
+    _resolve_cache_symbols();
     if (resource.is_valid()) {
-        frame_overrides.resize(resource->get_variated_symbols_count());
-        for (int i=0; i<frame_overrides.size(); i++) { frame_overrides.set(i, -1); }
+        state.clips_state.resize(resource->get_clip_tracks_count());
+        state.active_clips.resize(resource->get_clip_tracks_count());
+        for (int i=0; i<state.active_clips.size(); i++) { state.active_clips.set(i, -1); }
+        state.frame_overrides.resize(resource->get_variated_symbols_count());
+        for (int i=0; i<state.frame_overrides.size(); i++) { state.frame_overrides.set(i, -1); }
         active_symbol = resource->get_main_timeline();
         if (active_symbol.is_valid())
             playback_end = active_symbol->get_duration();
-        VisualServer::get_singleton()->material_set_param(flash_material, "ATLAS_SIZE", resource->get_atlas_size());
-        VisualServer::get_singleton()->material_set_param(flash_material, "ATLAS", resource->get_atlas());
+        _update_atlas_params();
     } else {
-        frame_overrides.resize(0);
+        state.frame_overrides.resize(0);
+        state.clips_state.resize(0);
+        state.active_clips.resize(0);
     }
     queue_process();
+    _update_processing();
     _change_notify();
     emit_signal("resource_changed");
 }
@@ -374,6 +467,11 @@ Ref<FlashDocument> FlashPlayer::get_resource() const {
 
 void FlashPlayer::_bind_methods() {
     ClassDB::bind_method(D_METHOD("override_frame", "symbol", "frame"), &FlashPlayer::override_frame);
+    ClassDB::bind_method(D_METHOD("queue_variant", "variant", "value"), &FlashPlayer::queue_variant);
+    ClassDB::bind_method(D_METHOD("queue_clip", "track", "clip"), &FlashPlayer::queue_clip);
+    ClassDB::bind_method(D_METHOD("queue_frame_override", "symbol", "frame"), &FlashPlayer::queue_frame_override);
+    ClassDB::bind_method(D_METHOD("queue_active_clip", "clip"), &FlashPlayer::queue_active_clip);
+    ClassDB::bind_method(D_METHOD("queue_advance", "delta"), &FlashPlayer::queue_advance);
     ClassDB::bind_method(D_METHOD("set_playing", "playing"), &FlashPlayer::set_playing);
     ClassDB::bind_method(D_METHOD("is_playing"), &FlashPlayer::is_playing);
     ClassDB::bind_method(D_METHOD("set_loop", "loop"), &FlashPlayer::set_loop);
@@ -391,8 +489,36 @@ void FlashPlayer::_bind_methods() {
     ClassDB::bind_method(D_METHOD("set_active_symbol", "active_symbol"), &FlashPlayer::set_active_symbol);
     ClassDB::bind_method(D_METHOD("get_active_symbol"), &FlashPlayer::get_active_symbol);
     ClassDB::bind_method(D_METHOD("set_active_clip", "active_clip"), &FlashPlayer::set_active_clip);
+    ClassDB::bind_method(D_METHOD("get_active_variants"), &FlashPlayer::get_active_variants);
+    ClassDB::bind_method(D_METHOD("set_active_variants", "variants"), &FlashPlayer::set_active_variants);
+    ClassDB::bind_method(D_METHOD("apply_skin_preset", "preset"), &FlashPlayer::apply_skin_preset);
+    ClassDB::bind_method(D_METHOD("set_clip_by_id", "track_id", "clip_id"), &FlashPlayer::set_clip_by_id);
+    ClassDB::bind_method(D_METHOD("get_clip_id", "track_id"), &FlashPlayer::get_clip_id);
     ClassDB::bind_method(D_METHOD("get_active_clip"), &FlashPlayer::get_active_clip);
 
+    ClassDB::bind_method(D_METHOD("set_cache_enabled", "enabled"), &FlashPlayer::set_cache_enabled);
+    ClassDB::bind_method(D_METHOD("is_cache_enabled"), &FlashPlayer::is_cache_enabled);
+    ClassDB::bind_method(D_METHOD("set_cache_symbols", "symbols"), &FlashPlayer::set_cache_symbols);
+    ClassDB::bind_method(D_METHOD("get_cache_symbols"), &FlashPlayer::get_cache_symbols);
+    ClassDB::bind_method(D_METHOD("set_cache_memory_limit", "bytes"), &FlashPlayer::set_cache_memory_limit);
+    ClassDB::bind_method(D_METHOD("get_cache_memory_limit"), &FlashPlayer::get_cache_memory_limit);
+    ClassDB::bind_method(D_METHOD("clear_cache"), &FlashPlayer::clear_cache);
+    ClassDB::bind_method(D_METHOD("reset_cache_stats"), &FlashPlayer::reset_cache_stats);
+    ClassDB::bind_method(D_METHOD("set_processing_mode", "mode"), &FlashPlayer::set_processing_mode);
+    ClassDB::bind_method(D_METHOD("get_processing_mode"), &FlashPlayer::get_processing_mode);
+    ClassDB::bind_method(D_METHOD("set_playback_quantization", "quantization"), &FlashPlayer::set_playback_quantization);
+    ClassDB::bind_method(D_METHOD("get_playback_quantization"), &FlashPlayer::get_playback_quantization);
+    ClassDB::bind_method(D_METHOD("set_quantization_fps", "fps"), &FlashPlayer::set_quantization_fps);
+    ClassDB::bind_method(D_METHOD("get_quantization_fps"), &FlashPlayer::get_quantization_fps);
+    ClassDB::bind_method(D_METHOD("set_use_baked_tracks", "use"), &FlashPlayer::set_use_baked_tracks);
+    ClassDB::bind_method(D_METHOD("is_using_baked_tracks"), &FlashPlayer::is_using_baked_tracks);
+    ClassDB::bind_method(D_METHOD("set_baked_interpolation", "interpolation"), &FlashPlayer::set_baked_interpolation);
+    ClassDB::bind_method(D_METHOD("is_baked_interpolation"), &FlashPlayer::is_baked_interpolation);
+    ClassDB::bind_method(D_METHOD("set_parallel_evaluation", "parallel"), &FlashPlayer::set_parallel_evaluation);
+    ClassDB::bind_method(D_METHOD("is_parallel_evaluation"), &FlashPlayer::is_parallel_evaluation);
+    ClassDB::bind_method(D_METHOD("set_stream_lookahead", "frames"), &FlashPlayer::set_stream_lookahead);
+    ClassDB::bind_method(D_METHOD("get_stream_lookahead"), &FlashPlayer::get_stream_lookahead);
+
     ClassDB::bind_method(D_METHOD("_animation_process"), &FlashPlayer::_animation_process);
 
     ClassDB::bind_method(D_METHOD("_sort_clips"), &FlashPlayer::_sort_clips);
@@ -400,9 +526,30 @@ void FlashPlayer::_bind_methods() {
     ADD_PROPERTY(PropertyInfo(Variant::BOOL, "playing", PROPERTY_HINT_NONE, ""), "set_playing", "is_playing");
     ADD_PROPERTY(PropertyInfo(Variant::BOOL, "loop", PROPERTY_HINT_NONE, ""), "set_loop", "is_loop");
     ADD_PROPERTY(PropertyInfo(Variant::REAL, "frame_rate", PROPERTY_HINT_NONE, ""), "set_frame_rate", "get_frame_rate");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "processing_mode", PROPERTY_HINT_ENUM, "Always,When Visible,When On Screen"), "set_processing_mode", "get_processing_mode");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "playback_quantization", PROPERTY_HINT_ENUM, "None,Authored FPS,Custom FPS,Integer Frames Unless Tweening"), "set_playback_quantization", "get_playback_quantization");
+    ADD_PROPERTY(PropertyInfo(Variant::REAL, "quantization_fps", PROPERTY_HINT_RANGE, "1,120,1"), "set_quantization_fps", "get_quantization_fps");
     ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "resource", PROPERTY_HINT_RESOURCE_TYPE, "FlashDocument"), "set_resource", "get_resource");
     ADD_PROPERTY(PropertyInfo(Variant::STRING, "active_symbol", PROPERTY_HINT_ENUM, ""), "set_active_symbol", "get_active_symbol");
     ADD_PROPERTY(PropertyInfo(Variant::STRING, "active_clip", PROPERTY_HINT_ENUM, ""), "set_active_clip", "get_active_clip");
+    ADD_GROUP("Cache", "cache_");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "cache_enabled", PROPERTY_HINT_NONE, ""), "set_cache_enabled", "is_cache_enabled");
+    ADD_PROPERTY(PropertyInfo(Variant::POOL_STRING_ARRAY, "cache_symbols", PROPERTY_HINT_NONE, ""), "set_cache_symbols", "get_cache_symbols");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "cache_memory_limit", PROPERTY_HINT_RANGE, "0,67108864,1024"), "set_cache_memory_limit", "get_cache_memory_limit");
+    ADD_GROUP("Baked Tracks", "baked_");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "baked_tracks_enabled", PROPERTY_HINT_NONE, ""), "set_use_baked_tracks", "is_using_baked_tracks");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "baked_interpolation", PROPERTY_HINT_NONE, ""), "set_baked_interpolation", "is_baked_interpolation");
+    ADD_GROUP("", "");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "parallel_evaluation", PROPERTY_HINT_NONE, ""), "set_parallel_evaluation", "is_parallel_evaluation");
+    ADD_PROPERTY(PropertyInfo(Variant::REAL, "stream_lookahead", PROPERTY_HINT_RANGE, "0,1200,1"), "set_stream_lookahead", "get_stream_lookahead");
+
+    BIND_ENUM_CONSTANT(PROCESSING_ALWAYS);
+    BIND_ENUM_CONSTANT(PROCESSING_WHEN_VISIBLE);
+    BIND_ENUM_CONSTANT(PROCESSING_WHEN_ON_SCREEN);
+    BIND_ENUM_CONSTANT(QUANTIZATION_NONE);
+    BIND_ENUM_CONSTANT(QUANTIZATION_AUTHORED);
+    BIND_ENUM_CONSTANT(QUANTIZATION_CUSTOM);
+    BIND_ENUM_CONSTANT(QUANTIZATION_INTEGER_UNLESS_TWEENING);
 
     ADD_SIGNAL(MethodInfo("resource_changed"));
     ADD_SIGNAL(MethodInfo("animation_completed"));
@@ -431,8 +578,8 @@ void FlashPlayer::set_active_symbol(String p_value) {
     frame = 0;
     processed_frame = -1;
     playback_start = 0;
-    if (resource.is_valid() && resource->get_symbols().has(active_symbol_name)) {
-        active_symbol = resource->get_symbols()[active_symbol_name];
+    if (resource.is_valid() && resource->has_symbol(active_symbol_name)) {
+        active_symbol = resource->get_symbol(active_symbol_name);
     } else if (resource.is_valid()){
         active_symbol = resource->get_main_timeline();
     } else {
@@ -444,7 +591,9 @@ void FlashPlayer::set_active_symbol(String p_value) {
     } else {
         playback_end = 0;
     }
+    baked_track_dirty = true;
     queue_process();
+    _update_processing();
     _change_notify();
 }
 String FlashPlayer::get_active_symbol() const {
@@ -483,13 +632,39 @@ PoolStringArray FlashPlayer::get_symbols() const {
     if (!resource.is_valid()) {
         return result;
     }
-    Array symbols = resource->get_symbols().values();
-    for (int i=0; i<symbols.size(); i++){
-        Ref<FlashTimeline> symbol = symbols[i];
-        if (symbol->get_local_path().find("/") >= 0) continue;
-        result.push_back(symbol->get_token());
+    return resource->get_symbol_names(true);
+}
+
+void FlashPlayer::set_cache_enabled(bool p_enabled) {
+    if (cache_enabled == p_enabled) return;
+    cache_enabled = p_enabled;
+    if (!cache_enabled) geometry_cache.clear();
+    tracks_dirty = true;
+    queue_process();
+}
+
+void FlashPlayer::set_cache_symbols(const PoolStringArray &p_symbols) {
+    cache_symbols = p_symbols;
+    _resolve_cache_symbols();
+    tracks_dirty = true;
+    queue_process();
+}
+
+void FlashPlayer::_resolve_cache_symbols() {
+    cache_symbols_resolved.clear();
+    if (!resource.is_valid()) return;
+    for (int i=0; i<cache_symbols.size(); i++) {
+        // not loaded symbols aren't drawn, resolved again once loaded
+        Ref<FlashTimeline> symbol = resource->get_symbols().get(cache_symbols[i], Variant());
+        if (symbol.is_valid()) cache_symbols_resolved.insert(symbol.ptr());
     }
-    return result;
+}
+
+void FlashPlayer::clear_cache() {
+    geometry_cache.clear();
+    geometry_cache.reset_stats();
+    tracks_dirty = true;
+    queue_process();
 }
 
 PoolStringArray FlashPlayer::get_clips(String p_symbol) const {
@@ -499,15 +674,8 @@ PoolStringArray FlashPlayer::get_clips(String p_symbol) const {
     if (p_symbol == String()) {
         symbol = active_symbol;
     } else {
-        Array symbols = resource->get_symbols().values();
-        for (int i=0; i<symbols.size(); i++){
-            Ref<FlashTimeline> s = symbols[i];
-            if (s->get_local_path().find("/") >= 0) continue;
-            if (s->get_token() == p_symbol) {
-                symbol = s;
-                break;
-            }
-        }
+        symbol = resource->get_symbol(p_symbol);
+        if (symbol.is_valid() && symbol->get_local_path().find("/") >= 0) symbol.unref();
     }
     if (!symbol.is_valid()) return result;
     Array clips = symbol->get_clips().keys();
@@ -519,28 +687,132 @@ PoolStringArray FlashPlayer::get_clips(String p_symbol) const {
 }
 
 void FlashPlayer::queue_process(float p_delta) {
-    queued_delta = MAX(p_delta, queued_delta);
+    // time is summed, player may wait in scheduler for a few frames;
+    // no more than one loop, events of longer span fire once anyway
+    queued_delta += p_delta;
+    if (active_symbol.is_valid()) {
+        queued_delta = MIN(queued_delta, float(active_symbol->get_duration()));
+    }
     if (!animation_process_queued) {
         animation_process_queued = true;
-        call_deferred("_animation_process");
+        if (FlashServer::get_singleton() != NULL) {
+            FlashServer::get_singleton()->queue_player(this);
+        } else {
+            call_deferred("_animation_process");
+        }
+    }
+}
+
+float FlashPlayer::get_screen_coverage() const {
+    if (!is_inside_tree() || draw_rect.has_no_area()) return 0;
+    Rect2 viewport_rect = get_viewport_rect();
+    if (viewport_rect.has_no_area()) return 0;
+    Rect2 rect = (get_viewport_transform() * get_global_transform_with_canvas()).xform(draw_rect);
+    return rect.clip(viewport_rect).get_area() / viewport_rect.get_area();
+}
+
+float FlashPlayer::_get_quantization_step() const {
+    switch (playback_quantization) {
+        case QUANTIZATION_AUTHORED: return 1.0;
+        case QUANTIZATION_CUSTOM: return quantization_fps > 0 ? frame_rate / quantization_fps : 0.0;
+        case QUANTIZATION_INTEGER_UNLESS_TWEENING: return quantization_tweening ? 0.0 : 1.0;
+        default: return 0.0;
     }
 }
 
+float FlashPlayer::_quantize_frame(float p_frame) const {
+    float step = _get_quantization_step();
+    if (step <= 0) return p_frame;
+    return Math::floor(p_frame / step + CMP_EPSILON) * step;
+}
+
+// Dedicated server runs on dummy rasterizer. Minimized window is not
+// headless, its geometry is kept fresh for the moment it is restored.
+static bool _is_headless() {
+    static bool headless = OS::get_singleton()->get_name() == "Server";
+    return headless;
+}
+
+bool FlashPlayer::_is_geometry_needed() const {
+    if (!is_inside_tree()) return true;
+    // nothing to draw on headless servers
+    if (_is_headless()) return false;
+    if (processing_mode == PROCESSING_ALWAYS) return true;
+    if (!is_visible_in_tree()) return false;
+    if (processing_mode == PROCESSING_WHEN_VISIBLE) return true;
+    // bounds of last evaluated frame are used, unknown bounds count as visible
+    if (draw_rect.has_no_area()) return true;
+    Rect2 rect = (get_viewport_transform() * get_global_transform_with_canvas()).xform(draw_rect);
+    return rect.intersects(get_viewport_rect());
+}
+
+void FlashPlayer::_check_geometry_needed() {
+    if (!_is_geometry_needed()) return;
+    geometry_stale = false;
+    tracks_dirty = true;
+    // events of hidden period were fired by events pass already
+    processed_frame = -1;
+    queue_process();
+    _update_processing();
+}
+
+// Process notification is only needed for playback and for polling
+// on-screen state of stale players, idle players cost nothing per frame.
+void FlashPlayer::_update_processing() {
+    if (!is_inside_tree()) return;
+    bool active = (playing && active_symbol.is_valid()) || (geometry_stale && processing_mode == PROCESSING_WHEN_ON_SCREEN);
+    if (active == is_processing()) return;
+    set_process(active);
+    if (FlashServer::get_singleton() != NULL) {
+        FlashServer::get_singleton()->set_player_active(this, active);
+    }
+}
+
+void FlashPlayer::set_playing(bool p_playing) {
+    playing = p_playing;
+    _update_processing();
+}
+
+void FlashPlayer::set_processing_mode(ProcessingMode p_mode) {
+    processing_mode = p_mode;
+    if (geometry_stale) _check_geometry_needed();
+    _update_processing();
+}
+
 void FlashPlayer::_animation_process() {
-    if (processed_frame == frame && !tracks_dirty) {
+    _stream_frames();
+    if (resource.is_valid() && resource->get_symbols_version() != symbols_version) {
+        // symbols were loaded or unloaded, caches are keyed by pointers
+        symbols_version = resource->get_symbols_version();
+        geometry_cache.clear();
+        _resolve_cache_symbols();
+    }
+    if (!_is_geometry_needed()) {
+        // time keeps going in `advance`, geometry is rebuilt on reappearance
+        if (!geometry_stale) {
+            geometry_stale = true;
+            _update_processing();
+        }
+        _events_process(frame, queued_delta);
         animation_process_queued = false;
         queued_delta = 0.0;
         return;
     }
-    events.clear();
-    masks.clear();
-    clipping_cache.clear();
-    clipping_items.clear();
-    processed_frame = frame;
-    indices.resize(0);
-    points.resize(0);
-    colors.resize(0);
-    uvs.resize(0);
+    float eval_frame = _quantize_frame(frame);
+    if (processed_frame == eval_frame && !tracks_dirty) {
+        animation_process_queued = false;
+        queued_delta = 0.0;
+        return;
+    }
+    output.clear();
+    geometry_cache.next_tick();
+    // snapped evaluation gets time between snapped frames, so events
+    // of the frames passed are fired exactly once
+    float eval_delta = queued_delta;
+    if (eval_frame != frame && processed_frame >= 0 && eval_frame >= processed_frame) {
+        eval_delta = eval_frame - processed_frame;
+    }
+    processed_frame = eval_frame;
 
     if (!active_symbol.is_valid()) {
         update();
@@ -550,11 +822,46 @@ void FlashPlayer::_animation_process() {
         return;
     }
 
-    active_symbol->animation_process(this, frame, queued_delta);
+    if (baked_track_dirty) {
+        _resolve_baked_track();
+    }
+    if (baked_track.is_valid()) {
+        _baked_process(eval_frame, eval_delta);
+    } else if (_is_parallel()) {
+        _parallel_process(eval_frame, eval_delta);
+    } else {
+        FlashEvaluator evaluator(&state, &output, this);
+        active_symbol->animation_process(&evaluator, eval_frame, eval_delta);
+    }
+    _update_next_change(eval_frame);
+    draw_rect = Rect2();
+    for (int i=0; i<output.points.size(); i++) {
+        if (i == 0) {
+            draw_rect.position = output.points[i];
+        } else {
+            draw_rect.expand_to(output.points[i]);
+        }
+    }
     update();
-    performance_triangles_generated = indices.size() / 3;
+    performance_triangles_generated = output.indices.size() / 3;
 
-    for (List<String>::Element *E = events.front(); E; E = E->next()) {
+    _emit_events();
+    animation_process_queued = false;
+    queued_delta = 0.0;
+    tracks_dirty = false;
+}
+
+// Chunked layers of active symbol get frames around playhead before any
+// evaluation, so seeks load playhead chunk right here, synchronously.
+// Quantized frame never runs ahead of `frame`, so window starts there.
+void FlashPlayer::_stream_frames() {
+    if (!active_symbol.is_valid() || (baked_track.is_valid() && !baked_track_dirty)) return;
+    float from = MIN(frame, _quantize_frame(frame));
+    active_symbol->stream(from, frame + stream_lookahead);
+}
+
+void FlashPlayer::_emit_events() {
+    for (List<String>::Element *E = output.events.front(); E; E = E->next()) {
         // always emit user events in deferred mode
         // to prevent recursive `animation_process` invocation
 #ifndef TOOLS_ENABLED
@@ -564,9 +871,21 @@ void FlashPlayer::_animation_process() {
             call_deferred("emit_signal", "animation_event", E->get());
 #endif
     }
-    animation_process_queued = false;
-    queued_delta = 0.0;
-    tracks_dirty = false;
+}
+
+void FlashPlayer::_events_process(float p_frame, float p_delta) {
+    output.events.clear();
+    if (!active_symbol.is_valid() || p_delta <= 0) return;
+    if (baked_track_dirty) {
+        _resolve_baked_track();
+    }
+    if (baked_track.is_valid()) {
+        _baked_events(p_frame, p_delta);
+    } else {
+        FlashEvaluator evaluator(&state, &output, this);
+        active_symbol->events_process(&evaluator, p_frame, p_delta);
+    }
+    _emit_events();
 }
 
 void FlashPlayer::advance(float p_time, bool p_seek, bool advance_all_frames) {
@@ -581,14 +900,12 @@ void FlashPlayer::advance(float p_time, bool p_seek, bool advance_all_frames) {
 
     
     if (advance_all_frames) {
-        List<String> clip_keys;
-        clips_state.get_key_list(&clip_keys);
-        for (List<String>::Element *E = clip_keys.front(); E; E = E->next()) {
-            String clips_key = E->get();
-            Vector3 *clip = clips_state.getptr(clips_key);
-            if (clip == NULL) {
+        Vector3 *clips = state.clips_state.ptrw();
+        for (int i=0; i<state.active_clips.size(); i++) {
+            if (state.active_clips[i] < 0) {
                 continue;
             }
+            Vector3 *clip = &clips[i];
             if (p_seek) {
                 clip->z = delta;
             } else {
@@ -600,6 +917,7 @@ void FlashPlayer::advance(float p_time, bool p_seek, bool advance_all_frames) {
             } else if (loop) while (clip->z > duration) {
                 clip->z -= duration;
             }
+            clips_version++;
         }
     }
 
@@ -615,7 +933,18 @@ void FlashPlayer::advance(float p_time, bool p_seek, bool advance_all_frames) {
         animation_completed = true;
         frame -= playback_end - playback_start;
     }
-    queue_process(delta);
+    // nothing visible changes until `next_change_frame`, so keep sleeping,
+    // skipped time is passed on wake up to fire events of skipped frames
+    if (geometry_stale) {
+        sleeping_delta = 0.0;
+        _stream_frames();
+        _events_process(frame, delta);
+    } else if (!p_seek && !animation_completed && !tracks_dirty && processed_frame >= 0 && frame >= processed_frame && frame < next_change_frame) {
+        sleeping_delta += delta;
+    } else {
+        queue_process(delta + sleeping_delta);
+        sleeping_delta = 0.0;
+    }
     if (animation_completed) {
 #ifndef TOOLS_ENABLED
         call_deferred("emit_signal", "animation_completed");
@@ -629,39 +958,33 @@ void FlashPlayer::advance(float p_time, bool p_seek, bool advance_all_frames) {
 
 void FlashPlayer::advance_clip_for_track(const String &p_track, const String &p_clip, float p_time, bool p_seek, float *r_elapsed, float *r_remaining) {
     if (!resource.is_valid()) return;
+    int track_id = resource->find_clip_track(p_track);
+    int clip_id = -1;
+    if (track_id >= 0 && p_clip != "[default]") {
+        clip_id = resource->find_clip(track_id, p_clip);
+    }
+    advance_clip(track_id, clip_id, p_time, p_seek, r_elapsed, r_remaining);
+}
 
-    if (p_clip == Variant() || p_clip == "[default]") {
-        if(clips_state.has(p_track)) clips_state.erase(p_track);
-        if(active_clips.has(p_track)) active_clips.erase(p_track);
+void FlashPlayer::advance_clip(int p_track, int p_clip, float p_time, bool p_seek, float *r_elapsed, float *r_remaining) {
+    if (p_track < 0 || p_track >= state.active_clips.size() || p_clip < 0) {
+        if (p_track >= 0 && p_track < state.active_clips.size()) set_clip_by_id(p_track, -1);
         if (r_elapsed != NULL) *r_elapsed = 0.0;
         if (r_remaining != NULL) *r_remaining = 0.0;
         return;
     }
 
     float delta = p_time*frame_rate;
-    String *current_clip = active_clips.getptr(p_track);
-    if (current_clip == NULL || *current_clip != p_clip) {
-        active_clips[p_track] = p_clip;
-        Array timelines = resource->get_symbols().values();
-        for (int i=0; i<timelines.size(); i++) {
-            Ref<FlashTimeline> tl = timelines[i];
-            if (p_track != tl->get_clips_header()) continue;
-            Vector2 clip_data = tl->get_clips()[p_clip];
-            clips_state[p_track] = Vector3(clip_data.x, clip_data.y, 0.0);
-            break;
-        }
+    if (state.active_clips[p_track] != p_clip) {
+        set_clip_by_id(p_track, p_clip);
     }
 
-    Vector3 *current_state = clips_state.getptr(p_track);
-    if (current_state == NULL) {
-        if (r_elapsed != NULL) *r_elapsed = 0.0;
-        if (r_remaining != NULL) *r_remaining = 0.0;
-        return;
-    }
+    Vector3 *current_state = &state.clips_state.write[p_track];
     float duration = current_state->y - current_state->x;
     if (p_seek) {
         if (current_state->z != delta) {
             tracks_dirty = true;
+            clips_version++;
             current_state->z = delta;
         }
     } else {
@@ -673,6 +996,7 @@ void FlashPlayer::advance_clip_for_track(const String &p_track, const String &p_
         }
         if (next_state != current_state->z) {
             tracks_dirty = true;
+            clips_version++;
             current_state->z = next_state;
         }
     }
@@ -681,30 +1005,6 @@ void FlashPlayer::advance_clip_for_track(const String &p_track, const String &p_
     if (r_remaining != NULL) *r_remaining = (duration - current_state->z) / frame_rate;
 }
 
-void FlashPlayer::add_polygon(Vector<Vector2> p_points, Vector<Color> p_colors, Vector<Vector2> p_uvs, int p_texture_idx) {
-    Vector<int> local_indices = Geometry::triangulate_polygon(p_points);
-    for (int i=0; i<local_indices.size(); i++){
-        indices.push_back(local_indices[i] + points.size());
-    }
-    int clipping_id = clipping_cache.size();
-    int clipping_size_with_tex_idx = (clipping_items.size() << 8) | (p_texture_idx & 0xff);
-    for (int i=0; i<p_points.size(); i++) {
-        points.push_back(p_points[i]);
-        colors.push_back(p_colors[i]);
-        uvs.push_back(p_uvs[i] * 0.5 + Vector2(clipping_id, clipping_size_with_tex_idx));
-    }
-}
-
-void FlashPlayer::queue_animation_event(const String &p_event, bool p_reversed) {
-    if (events.find(p_event) == NULL) {
-        if (p_reversed) {
-            events.push_front(p_event);
-        } else {
-            events.push_back(p_event);
-        }
-    }
-}
-
 void FlashPlayer::update_clipping_data() {
     clipping_data->lock();
     Vector2i pos = Vector2i(0, 0);
@@ -712,7 +1012,7 @@ void FlashPlayer::update_clipping_data() {
     //scale.scale(Vector2(2.0, 2.0));
 
     Transform2D glob = get_viewport_transform() * get_global_transform_with_canvas();
-    for (List<FlashMaskItem>::Element *E = clipping_cache.front(); E; E = E->next()) {
+    for (List<FlashMaskItem>::Element *E = output.clipping_cache.front(); E; E = E->next()) {
         FlashMaskItem item = E->get();
         Transform2D tr = (glob * item.transform * scale).affine_inverse();
         Color xy = Color(tr[0].x, tr[0].y, tr[1].x, tr[1].y);
@@ -737,54 +1037,326 @@ void FlashPlayer::update_clipping_data() {
     clipping_texture->set_data(clipping_data);
 }
 
-void FlashPlayer::mask_begin(int mask_id) {
-    if (!current_mask) current_mask = mask_id;
-    masks.set(current_mask, List<FlashMaskItem>());
-    mask_stack.push_back(mask_id);
+bool FlashPlayer::is_cached_as_bitmap(bool p_cache_as_bitmap, FlashTimeline *p_symbol) {
+    if (!cache_enabled || cache_capture_depth > 0) return false;
+    if (!p_cache_as_bitmap && !cache_symbols_resolved.has(p_symbol)) return false;
+    return p_symbol->is_cacheable();
 }
-void FlashPlayer::mask_end(int mask_id) {
-    if (current_mask == mask_id) {
-        mask_stack.pop_front();
-        if (mask_stack.size() > 0) {
-            current_mask = mask_stack.back()->get();
-        } else {
-            current_mask = 0;
-        }
+
+FlashCacheKey FlashPlayer::_cache_key(FlashTimeline *p_symbol, float p_frame) const {
+    int flags = p_symbol->get_subtree_flags();
+    uint64_t key_state = 0;
+    if (flags & FlashTimeline::SUBTREE_HAS_VARIANTS) key_state |= uint64_t(variants_version) << 32;
+    if (flags & FlashTimeline::SUBTREE_HAS_CLIPS) key_state |= clips_version;
+    return FlashGeometryCache::make_key(p_symbol, p_frame, key_state);
+}
+
+bool FlashPlayer::cache_replay(FlashTimeline *p_symbol, float p_frame, const Transform2D &p_transform, const FlashColorEffect &p_effect, FlashOutputBuffers &r_output) {
+    const FlashCachedGeometry *geometry = geometry_cache.lookup(_cache_key(p_symbol, p_frame));
+    if (geometry == NULL) return false;
+    _add_cached_geometry(*geometry, p_transform, p_effect, r_output);
+    return true;
+}
+
+void FlashPlayer::cache_begin() {
+    if (cache_capture_depth == 0) {
+        cache_capture = FlashCachedGeometry();
+    }
+    cache_capture_depth++;
+}
+
+void FlashPlayer::cache_end(FlashTimeline *p_symbol, float p_frame, const Transform2D &p_transform, const FlashColorEffect &p_effect, FlashOutputBuffers &r_output) {
+    ERR_FAIL_COND(cache_capture_depth <= 0);
+    cache_capture_depth--;
+    if (cache_capture_depth > 0) return;
+    // geometry bigger then whole cache still has to be drawn
+    geometry_cache.store(_cache_key(p_symbol, p_frame), cache_capture);
+    _add_cached_geometry(cache_capture, p_transform, p_effect, r_output);
+    cache_capture = FlashCachedGeometry();
+}
+
+void FlashPlayer::cache_add_polygon(const Vector<Vector2> &p_points, const Vector<int> &p_indices, const FlashColorEffect &p_effect, const Vector<Vector2> &p_uvs, int p_texture_idx) {
+    int offset = cache_capture.points.size();
+    for (int i=0; i<p_indices.size(); i++){
+        cache_capture.indices.push_back(p_indices[i] + offset);
     }
+    for (int i=0; i<p_points.size(); i++) {
+        cache_capture.points.push_back(p_points[i]);
+        cache_capture.uvs.push_back(p_uvs[i]);
+        cache_capture.mults.push_back(p_effect.mult);
+        cache_capture.adds.push_back(p_effect.add);
+        cache_capture.texture_indices.push_back(p_texture_idx);
+    }
+}
+
+void FlashPlayer::_add_cached_geometry(const FlashCachedGeometry &p_geometry, const Transform2D &p_transform, const FlashColorEffect &p_effect, FlashOutputBuffers &r_output) {
+    int offset = r_output.points.size();
+    for (int i=0; i<p_geometry.indices.size(); i++) {
+        r_output.indices.push_back(p_geometry.indices[i] + offset);
+    }
+    int clipping_id = r_output.clipping_cache.size();
+    int clipping_size = r_output.clipping_items.size() << 8;
+    for (int i=0; i<p_geometry.points.size(); i++) {
+        Color mult = p_geometry.mults[i] * p_effect.mult;
+        Color add = p_geometry.adds[i] * p_effect.mult + p_effect.add;
+        r_output.add_vertex(p_transform.xform(p_geometry.points[i]), flash_encode_color_effect(mult, add), p_geometry.uvs[i] * 0.5, clipping_id, clipping_size | (p_geometry.texture_indices[i] & 0xff));
+    }
+}
+
+void FlashPlayer::set_use_baked_tracks(bool p_use) {
+    if (use_baked_tracks == p_use) return;
+    use_baked_tracks = p_use;
+    baked_track_dirty = true;
+    tracks_dirty = true;
+    queue_process();
 }
-bool FlashPlayer::is_masking() {
-    return current_mask > 0;
+
+void FlashPlayer::set_baked_interpolation(bool p_interpolation) {
+    baked_interpolation = p_interpolation;
+    tracks_dirty = true;
+    queue_process();
 }
-void FlashPlayer::mask_add(Transform2D p_transform, Rect2i p_texture_region, int p_texture_idx) {
-    FlashMaskItem item;
-    item.texture_idx = p_texture_idx;
-    item.texture_region = p_texture_region;
-    item.transform = p_transform;
-    if (!masks.has(current_mask)) {
-        masks.set(current_mask, List<FlashMaskItem>());
+
+void FlashPlayer::_resolve_baked_track() {
+    baked_track_dirty = false;
+    baked_track.unref();
+    if (!use_baked_tracks || !resource.is_valid() || resource->get_baked_tracks().size() == 0) return;
+    // only states that was precomputed on import: default one,
+    // or single variant switched
+    if (frames_overridden || active_clips_count > 0 || active_variants.size() > 1) return;
+    String variant, value;
+    if (active_variants.size() == 1) {
+        const String *key = active_variants.next(NULL);
+        variant = *key;
+        value = active_variants[variant];
     }
-    masks[current_mask].push_back(item);
+    baked_track = resource->get_baked_track(get_active_symbol(), variant, value);
+}
+
+void FlashPlayer::_update_next_change(float p_frame) {
+    float change;
+    if (baked_track.is_valid()) {
+        change = baked_interpolation ? 0.0 : floor(p_frame) + 1.0 - p_frame;
+    } else {
+        FlashEvaluator evaluator(&state, &output, this);
+        change = active_symbol->get_next_change(&evaluator, p_frame);
+    }
+    if (playback_quantization == QUANTIZATION_INTEGER_UNLESS_TWEENING) {
+        quantization_tweening = change <= 0;
+    }
+    float step = _get_quantization_step();
+    if (step > 0) {
+        // change becomes visible on the first snapped frame after it
+        next_change_frame = MAX(Math::ceil((p_frame + change) / step - CMP_EPSILON) * step, p_frame + step);
+    } else {
+        next_change_frame = p_frame + change;
+    }
+}
+
+void FlashPlayer::set_playback_quantization(PlaybackQuantization p_quantization) {
+    playback_quantization = p_quantization;
+    quantization_tweening = false;
+    tracks_dirty = true;
+    queue_process();
+    _change_notify();
+}
+
+void FlashPlayer::set_quantization_fps(float p_fps) {
+    quantization_fps = p_fps;
+    tracks_dirty = true;
+    queue_process();
+}
+
+// Geometry cache is bound to the player and not thread safe, so players
+// caching their symbols are always evaluated serially.
+bool FlashPlayer::_is_parallel() const {
+    if (!parallel_evaluation || output.draw_recorder != NULL) return false;
+    // cached subtrees are captured through player, layer tasks run without it
+    if (cache_enabled && (cache_symbols_resolved.size() > 0 || (active_symbol->get_subtree_flags() & FlashTimeline::SUBTREE_HAS_CACHED))) return false;
+    return FlashServer::get_singleton() != NULL && active_symbol->get_layers_count() > 1;
+}
+
+struct FlashParallelEvaluation {
+    const FlashPlayerState *state;
+    const FlashLayer *const *layers;
+    FlashOutputBuffers *outputs;
+    float frame;
+    float delta;
+};
+
+void FlashPlayer::_parallel_layer_task(void *p_userdata, int p_index) {
+    FlashParallelEvaluation *evaluation = (FlashParallelEvaluation *)p_userdata;
+    FlashEvaluator evaluator(evaluation->state, &evaluation->outputs[p_index]);
+    evaluation->layers[p_index]->animation_process(&evaluator, evaluation->frame, evaluation->delta);
 }
-void FlashPlayer::clip_begin(int mask_id) {
-    if (!masks.has(mask_id)) {
-        print_line("No flash mask found, id=" + itos(mask_id));
+
+// Top-level layers are evaluated as separate tasks into own buffers,
+// which are merged afterwards in paint order. Result is the same as
+// of serial evaluation: masks of the symbol are evaluated first and
+// only read by layers, clipping ids and events are fixed up on merge.
+void FlashPlayer::_parallel_process(float p_frame, float p_delta) {
+    FlashEvaluator evaluator(&state, &output, this);
+    active_symbol->fire_events(&evaluator, p_frame, p_delta);
+    active_symbol->masks_process(&evaluator, p_frame, p_delta);
+    active_symbol->get_paint_order(parallel_layers);
+    if (output.current_mask != 0) {
+        // unbalanced mask layer captures all the layers below
+        for (int i=0; i<parallel_layers.size(); i++) {
+            parallel_layers[i]->animation_process(&evaluator, p_frame, p_delta);
+        }
         return;
     }
-    for (List<FlashMaskItem>::Element *E = clipping_items.front(); E; E = E->next()) {
-        clipping_cache.push_back(E->get());
+
+    parallel_outputs.resize(parallel_layers.size());
+    FlashOutputBuffers *outputs = parallel_outputs.ptrw();
+    for (int i=0; i<parallel_outputs.size(); i++) {
+        outputs[i].clear();
+        outputs[i].deferred = true;
+        outputs[i].masks = output.masks;
+        outputs[i].mask_stack = output.mask_stack;
     }
-    for (List<FlashMaskItem>::Element *E = masks[mask_id].front(); E; E = E->next()) {
-        clipping_items.push_back(E->get());
+
+    FlashParallelEvaluation evaluation;
+    evaluation.state = &state;
+    evaluation.layers = parallel_layers.ptr();
+    evaluation.outputs = outputs;
+    evaluation.frame = p_frame;
+    evaluation.delta = p_delta;
+    FlashServer::get_singleton()->run_parallel(_parallel_layer_task, &evaluation, parallel_layers.size());
+
+    for (int i=0; i<parallel_outputs.size(); i++) {
+        output.append(outputs[i]);
     }
 }
-void FlashPlayer::clip_end(int mask_id) {
-    if (!masks.has(mask_id)) return;
-    for (List<FlashMaskItem>::Element *E = clipping_items.front(); E; E = E->next()) {
-        clipping_cache.push_back(E->get());
+
+void FlashPlayer::_baked_process(float p_frame, float p_delta) {
+    int count = baked_track->get_frames_count();
+    if (count == 0) return;
+    int current = CLAMP((int)Math::floor(p_frame), 0, count - 1);
+
+    PoolIntArray vertex_offsets = baked_track->get_vertex_offsets();
+    PoolIntArray index_offsets = baked_track->get_index_offsets();
+    PoolIntArray clipping_offsets = baked_track->get_clipping_offsets();
+    PoolVector2Array track_points = baked_track->get_points();
+    PoolVector2Array track_uvs = baked_track->get_uvs();
+    PoolColorArray track_colors = baked_track->get_colors();
+    PoolIntArray track_indices = baked_track->get_indices();
+    PoolRealArray track_clipping = baked_track->get_clipping();
+    PoolIntArray::Read vo = vertex_offsets.read();
+    PoolIntArray::Read io = index_offsets.read();
+    PoolIntArray::Read co = clipping_offsets.read();
+
+    int vertex_from = vo[current];
+    int vertex_count = vo[current + 1] - vertex_from;
+    int index_from = io[current];
+    int index_count = io[current + 1] - index_from;
+    output.points.resize(vertex_count);
+    output.uvs.resize(vertex_count);
+    output.colors.resize(vertex_count);
+    output.indices.resize(index_count);
+    if (vertex_count > 0) {
+        memcpy(output.points.ptrw(), track_points.read().ptr() + vertex_from, vertex_count * sizeof(Vector2));
+        memcpy(output.uvs.ptrw(), track_uvs.read().ptr() + vertex_from, vertex_count * sizeof(Vector2));
+        memcpy(output.colors.ptrw(), track_colors.read().ptr() + vertex_from, vertex_count * sizeof(Color));
     }
-    for (List<FlashMaskItem>::Element *E = masks[mask_id].front(); E; E = E->next()) {
-        clipping_items.pop_back();
+    if (index_count > 0) {
+        memcpy(output.indices.ptrw(), track_indices.read().ptr() + index_from, index_count * sizeof(int));
     }
+
+    // lerp positions only, when both frames share topology
+    float amount = p_frame - Math::floor(p_frame);
+    if (baked_interpolation && amount > 0 && vertex_count > 0) {
+        int next = current + 1 < count ? current + 1 : (loop ? 0 : current);
+        if (next != current && vo[next + 1] - vo[next] == vertex_count && io[next + 1] - io[next] == index_count) {
+            PoolVector2Array::Read pr = track_points.read();
+            const Vector2 *next_points = pr.ptr() + vo[next];
+            Vector2 *dst = output.points.ptrw();
+            for (int i=0; i<vertex_count; i++) {
+                dst[i] = dst[i].linear_interpolate(next_points[i], amount);
+            }
+        }
+    }
+
+    PoolRealArray::Read cr = track_clipping.read();
+    for (int i=co[current]; i + FlashBakedTrack::CLIPPING_ITEM_SIZE <= co[current + 1]; i += FlashBakedTrack::CLIPPING_ITEM_SIZE) {
+        FlashMaskItem item;
+        item.transform = Transform2D(cr[i], cr[i+1], cr[i+2], cr[i+3], cr[i+4], cr[i+5]);
+        item.texture_region = Rect2(cr[i+6], cr[i+7], cr[i+8], cr[i+9]);
+        item.texture_idx = cr[i+10];
+        output.clipping_cache.push_back(item);
+    }
+
+    _baked_events(p_frame, p_delta);
+}
+
+void FlashPlayer::_baked_events(float p_frame, float p_delta) {
+    int count = baked_track->get_frames_count();
+    // every baked frame keeps events fired when entering it
+    if (count > 0 && p_delta > 0) {
+        int to = (int)Math::floor(p_frame);
+        int prev = (int)Math::floor(p_frame - p_delta);
+        // events of window wrapping over track end are queued reversed,
+        // merging baked frames can't reproduce that order
+        if (to - prev > 1 && Math::floor(prev / float(count)) != Math::floor(to / float(count))) {
+            active_symbol->stream(p_frame - p_delta, p_frame);
+            FlashEvaluator evaluator(&state, &output, this);
+            active_symbol->events_process(&evaluator, p_frame, p_delta);
+            return;
+        }
+        Array track_events = baked_track->get_events();
+        int from = MAX(prev + 1, to - count + 1);
+        for (int i=from; i<=to; i++) {
+            PoolStringArray frame_events = track_events[((i % count) + count) % count];
+            for (int j=0; j<frame_events.size(); j++) {
+                output.add_event(frame_events[j]);
+            }
+        }
+    }
+}
+
+Ref<FlashBakedTrack> FlashPlayer::bake_track(const String &p_symbol, const String &p_variant, const String &p_value) {
+    ERR_FAIL_COND_V_MSG(resource.is_null(), Ref<FlashBakedTrack>(), "Can't bake track without resource");
+    bool was_using_baked_tracks = use_baked_tracks;
+    use_baked_tracks = false;
+    set_active_symbol(p_symbol);
+    if (p_variant != String()) {
+        set_variant(p_variant, p_value);
+    }
+
+    Ref<FlashBakedTrack> track;
+    track.instance();
+    int duration = active_symbol.is_valid() ? active_symbol->get_duration() : 0;
+    for (int i=0; i<duration; i++) {
+        frame = i;
+        processed_frame = -1;
+        tracks_dirty = true;
+        queued_delta = 1.0;
+        _animation_process();
+
+        Vector<real_t> clipping;
+        for (List<FlashMaskItem>::Element *E = output.clipping_cache.front(); E; E = E->next()) {
+            const FlashMaskItem &item = E->get();
+            clipping.push_back(item.transform[0].x);
+            clipping.push_back(item.transform[0].y);
+            clipping.push_back(item.transform[1].x);
+            clipping.push_back(item.transform[1].y);
+            clipping.push_back(item.transform[2].x);
+            clipping.push_back(item.transform[2].y);
+            clipping.push_back(item.texture_region.position.x);
+            clipping.push_back(item.texture_region.position.y);
+            clipping.push_back(item.texture_region.size.x);
+            clipping.push_back(item.texture_region.size.y);
+            clipping.push_back(item.texture_idx);
+        }
+        PoolStringArray frame_events;
+        for (List<String>::Element *E = output.events.front(); E; E = E->next()) {
+            frame_events.push_back(E->get());
+        }
+        track->add_frame(output.points, output.uvs, output.colors, output.indices, clipping, frame_events);
+    }
+    use_baked_tracks = was_using_baked_tracks;
+    baked_track_dirty = true;
+    return track;
 }
 
 FlashPlayer::~FlashPlayer() {
@@ -803,12 +1375,30 @@ FlashPlayer::FlashPlayer() {
     active_symbol_name = "[document]";
     active_clip = "";
     loop = false;
+    active_clips_count = 0;
     tracks_dirty = true;
     animation_process_queued = false;
 
     processed_frame = -1;
-    current_mask = 0;
-    cliping_depth = 0;
+
+    cache_enabled = true;
+    cache_capture_depth = 0;
+    next_change_frame = -1;
+    sleeping_delta = 0.0;
+    processing_mode = PROCESSING_ALWAYS;
+    geometry_stale = false;
+    playback_quantization = QUANTIZATION_NONE;
+    quantization_fps = 30;
+    quantization_tweening = false;
+    use_baked_tracks = true;
+    baked_interpolation = false;
+    baked_track_dirty = true;
+    frames_overridden = false;
+    parallel_evaluation = false;
+    stream_lookahead = 24;
+    variants_version = 0;
+    clips_version = 0;
+    symbols_version = 0;
 
     performance_triangles_generated = 0;
     performance_triangles_drawn = 0;
@@ -825,17 +1415,24 @@ FlashPlayer::FlashPlayer() {
             "uniform sampler2DArray ATLAS;\n"
             "uniform sampler2D CLIPPING_TEXTURE;\n"
             "uniform vec2 ATLAS_SIZE;\n"
+            "uniform sampler2D ATLAS_SLOTS;\n"
+            "uniform bool ATLAS_RESIDENCY = false;\n"
             "varying float CLIPPING_SIZE;\n"
             "varying float CLIPPING_IDX[4];"
             "varying vec4 CLIPPING_UV[4];\n"
             "varying float TEX_IDX;\n"
 
+            "float atlas_slot(float idx) {\n"
+            "   if (!ATLAS_RESIDENCY) return idx;\n"
+            "   return floor(texelFetch(ATLAS_SLOTS, ivec2(int(idx), 0), 0).r * 255.0 + 0.5);\n"
+            "}\n"
+
             "void vertex() {\n"
             "   float clipping_size_with_tex_idx = 0.0;\n"
             "   float clipping_id = 0.0;\n"
             "   UV.x = 2.0 * modf(UV.x, clipping_id);\n"
             "   UV.y = 2.0 * modf(UV.y, clipping_size_with_tex_idx);\n"
-            "   TEX_IDX = float(int(clipping_size_with_tex_idx) & 255);\n"
+            "   TEX_IDX = atlas_slot(float(int(clipping_size_with_tex_idx) & 255));\n"
             "   float clipping_size = float(int(clipping_size_with_tex_idx) >> 8);\n"
             "   CLIPPING_SIZE = min(clipping_size, 4.0);\n"
             "   for (int i=0; i<int(CLIPPING_SIZE); i++) {"
@@ -857,7 +1454,7 @@ FlashPlayer::FlashPlayer() {
             "       vec2 clipping_pos = (local * vec4(VERTEX, 0.0 ,1.0)).xy;\n"
             "       CLIPPING_UV[i].xy = clipping_pos / tex_size;\n"
             "       CLIPPING_UV[i].zw = (clipping_pos + tex_pos)/ATLAS_SIZE;\n"
-            "       CLIPPING_IDX[i] = tr_origin.b;\n"
+            "       CLIPPING_IDX[i] = atlas_slot(tr_origin.b);\n"
             "   }\n"
             "}\n"
 
@@ -874,7 +1471,7 @@ FlashPlayer::FlashPlayer() {
             "           masked = max(masked, mask.a);\n"
             "       }\n"
             "   }\n"
-            "   if (masked > 0.0) {\n"
+            "   if (masked > 0.0 && (!ATLAS_RESIDENCY || TEX_IDX < 255.0)) {\n"
             "       vec4 add;\n"
             "       vec4 c = texture(ATLAS, vec3(UV, TEX_IDX));\n"
             "       vec4 mult = 2.0*modf(COLOR, add);\n"
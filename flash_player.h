@@ -26,15 +26,15 @@
 #include <scene/2d/node_2d.h>
 
 #include "flash_resources.h"
+#include "flash_cache.h"
+#include "flash_evaluator.h"
 
 class FlashDocument;
 class FlashTimeline;
-
-struct FlashMaskItem {
-    Transform2D transform;
-    Rect2 texture_region;
-    int texture_idx;
-};
+class FlashLayer;
+class FlashBakedTrack;
+class FlashSkinPreset;
+struct FlashColorEffect;
 
 class FlashPlayer: public Node2D {
     GDCLASS(FlashPlayer, Node2D);
@@ -59,25 +59,59 @@ class FlashPlayer: public Node2D {
 
     // batcher part
     float processed_frame;
-    int cliping_depth;
-    Vector<Vector2> points;
-    Vector<Vector2> uvs;
-    Vector<Color> colors;
-    Vector<int> indices;
-    List<String> events;
-
-    HashMap<String, Vector3> clips_state;
-    HashMap<String, String> active_clips;
+    FlashPlayerState state;
+    FlashOutputBuffers output;
+
+    int active_clips_count;
     Ref<Image> clipping_data;
     Ref<ImageTexture> clipping_texture;
-    HashMap<int, List<FlashMaskItem>> masks;
-    List<int> mask_stack;
-    Vector<int> frame_overrides;
     HashMap<String, String> active_variants;
-    List<FlashMaskItem> clipping_cache;
-    List<FlashMaskItem> clipping_items;
-    int current_mask;
 
+    // cache as bitmap
+    bool cache_enabled;
+    PoolStringArray cache_symbols;
+    Set<const FlashTimeline*> cache_symbols_resolved;
+    FlashGeometryCache geometry_cache;
+    FlashCachedGeometry cache_capture;
+    int cache_capture_depth;
+    uint32_t variants_version;
+    uint32_t clips_version;
+    uint32_t symbols_version;
+
+    // baked tracks
+    bool use_baked_tracks;
+    bool baked_interpolation;
+    bool baked_track_dirty;
+    bool frames_overridden;
+    Ref<FlashBakedTrack> baked_track;
+
+    // parallel evaluation of top-level layers
+    bool parallel_evaluation;
+    Vector<const FlashLayer*> parallel_layers;
+    Vector<FlashOutputBuffers> parallel_outputs;
+
+    // frame (in active symbol time) of the next visual change
+    float next_change_frame;
+    float sleeping_delta;
+
+    // visibility driven processing
+    int processing_mode;
+    bool geometry_stale;
+
+    // playback quantization
+    int playback_quantization;
+    float quantization_fps;
+    bool quantization_tweening;
+
+    // frames of chunked layers loaded ahead of playhead,
+    // on top of the chunk following playhead one
+    float stream_lookahead;
+
+    // atlas layers pinned for drawing
+    Ref<FlashDocument> resident_document;
+    Ref<FlashTimeline> resident_symbol;
+
+    Rect2 draw_rect;
 
     int performance_triangles_drawn;
 	int performance_triangles_generated;
@@ -90,8 +124,43 @@ protected:
     virtual void _validate_property(PropertyInfo &prop) const;
 	static void _bind_methods();
     bool _sort_clips(Variant a, Variant b) const;
+    void _resolve_cache_symbols();
+    FlashCacheKey _cache_key(FlashTimeline *p_symbol, float p_frame) const;
+    void _add_cached_geometry(const FlashCachedGeometry &p_geometry, const Transform2D &p_transform, const FlashColorEffect &p_effect, FlashOutputBuffers &r_output);
+    void _resolve_baked_track();
+    void _baked_process(float p_frame, float p_delta);
+    void _update_next_change(float p_frame);
+    float _get_quantization_step() const;
+    float _quantize_frame(float p_frame) const;
+    bool _is_geometry_needed() const;
+    void _events_process(float p_frame, float p_delta);
+    void _baked_events(float p_frame, float p_delta);
+    bool _is_parallel() const;
+    void _parallel_process(float p_frame, float p_delta);
+    static void _parallel_layer_task(void *p_userdata, int p_index);
+    void _emit_events();
+    void _check_geometry_needed();
+    void _apply_frame_overrides(const Dictionary &p_variants, const Vector<int> &p_overrides);
+    void _update_processing();
+    void _update_atlas_params();
+    void _update_residency();
+    void _release_residency();
+    void _stream_frames();
 
 public:
+    enum ProcessingMode {
+        PROCESSING_ALWAYS,
+        PROCESSING_WHEN_VISIBLE,
+        PROCESSING_WHEN_ON_SCREEN
+    };
+
+    enum PlaybackQuantization {
+        QUANTIZATION_NONE,
+        QUANTIZATION_AUTHORED,
+        QUANTIZATION_CUSTOM,
+        QUANTIZATION_INTEGER_UNLESS_TWEENING
+    };
+
     FlashPlayer();
     ~FlashPlayer();
 
@@ -102,15 +171,25 @@ public:
     String get_variant(String key) const;
     void set_clip(String header, Variant value);
     String get_clip(String header) const;
+    void set_clip_by_id(int p_track, int p_clip);
+    int get_clip_id(int p_track) const;
     PoolStringArray get_clips_tracks() const;
     PoolStringArray get_clips_for_track(const String &track) const;
     float get_clip_duration(const String &track, const String &clip) const;
     Dictionary get_variants() const;
-    float get_symbol_frame(FlashTimeline* symbol, float p_default);
+    Dictionary get_active_variants() const;
+    void set_active_variants(const Dictionary &p_variants);
+    void apply_skin_preset(const Ref<FlashSkinPreset> &p_preset);
     float get_frame_rate() const { return frame_rate; }
     void set_frame_rate(float p_frame_rate) { frame_rate = p_frame_rate; }
+    ProcessingMode get_processing_mode() const { return (ProcessingMode)processing_mode; }
+    void set_processing_mode(ProcessingMode p_mode);
+    PlaybackQuantization get_playback_quantization() const { return (PlaybackQuantization)playback_quantization; }
+    void set_playback_quantization(PlaybackQuantization p_quantization);
+    float get_quantization_fps() const { return quantization_fps; }
+    void set_quantization_fps(float p_fps);
     bool is_playing() const { return playing; }
-    void set_playing(bool p_playing) { playing = p_playing; }
+    void set_playing(bool p_playing);
     bool is_loop() const { return loop; }
     void set_loop(bool p_loop) { loop = p_loop; }
     Ref<FlashDocument> get_resource() const;
@@ -122,25 +201,54 @@ public:
     void set_active_clip(String p_clip);
     PoolStringArray get_symbols() const;
     PoolStringArray get_clips(String p_symbol=String()) const;
+    bool is_cache_enabled() const { return cache_enabled; }
+    void set_cache_enabled(bool p_enabled);
+    PoolStringArray get_cache_symbols() const { return cache_symbols; }
+    void set_cache_symbols(const PoolStringArray &p_symbols);
+    int get_cache_memory_limit() const { return geometry_cache.get_memory_limit(); }
+    void set_cache_memory_limit(int p_limit) { geometry_cache.set_memory_limit(p_limit); }
+    void clear_cache();
+    void reset_cache_stats() { geometry_cache.reset_stats(); }
+    bool is_using_baked_tracks() const { return use_baked_tracks; }
+    void set_use_baked_tracks(bool p_use);
+    bool is_baked_interpolation() const { return baked_interpolation; }
+    void set_baked_interpolation(bool p_interpolation);
+    bool is_parallel_evaluation() const { return parallel_evaluation; }
+    void set_parallel_evaluation(bool p_parallel) { parallel_evaluation = p_parallel; }
+    float get_stream_lookahead() const { return stream_lookahead; }
+    void set_stream_lookahead(float p_frames) { stream_lookahead = MAX(p_frames, 0.0f); }
+    Ref<FlashBakedTrack> bake_track(const String &p_symbol, const String &p_variant=String(), const String &p_value=String());
 
     // batcher part
     void queue_animation_process();
     void queue_process(float delta=0.0);
+    Rect2 get_draw_rect() const { return draw_rect; }
+    float get_screen_coverage() const;
     void _animation_process();
     void advance(float p_delta, bool p_skip=false, bool advance_all_tracks=false);
     void advance_clip_for_track(const String &p_track, const String &p_clip, float delta=0.0, bool p_skip=false, float *r_elapsed=NULL, float *r_ramaining=NULL);
+    void advance_clip(int p_track, int p_clip, float delta=0.0, bool p_skip=false, float *r_elapsed=NULL, float *r_ramaining=NULL);
     void update_clipping_data();
-    void add_polygon(Vector<Vector2> p_points, Vector<Color> p_colors, Vector<Vector2> p_uvs, int p_texture_idx);
-    void queue_animation_event(const String &p_name, bool p_reversed=false);
-
-    bool is_masking();
-    void mask_begin(int layer);
-    void mask_add(Transform2D p_transform, Rect2i p_texture_region, int p_texture_idx);
-    void mask_end(int layer);
 
-    void clip_begin(int layer);
-    void clip_end(int layer);
+    // thread safe counterparts of setters above, applied by
+    // FlashServer on main thread once per frame
+    void queue_variant(const String &p_variant, const Variant &p_value);
+    void queue_clip(const String &p_track, const Variant &p_clip);
+    void queue_frame_override(const String &p_symbol, const Variant &p_frame);
+    void queue_active_clip(const String &p_clip);
+    void queue_advance(float p_delta);
+
+    bool is_cached_as_bitmap(bool p_cache_as_bitmap, FlashTimeline *p_symbol);
+    bool cache_replay(FlashTimeline *p_symbol, float p_frame, const Transform2D &p_transform, const FlashColorEffect &p_effect, FlashOutputBuffers &r_output);
+    void cache_begin();
+    void cache_end(FlashTimeline *p_symbol, float p_frame, const Transform2D &p_transform, const FlashColorEffect &p_effect, FlashOutputBuffers &r_output);
+    bool is_cache_capturing() const { return cache_capture_depth > 0; }
+    void cache_add_polygon(const Vector<Vector2> &p_points, const Vector<int> &p_indices, const FlashColorEffect &p_effect, const Vector<Vector2> &p_uvs, int p_texture_idx);
+
+    void set_draw_recorder(Vector<FlashDrawItem> *p_recorder) { output.draw_recorder = p_recorder; }
 };
 
+VARIANT_ENUM_CAST(FlashPlayer::ProcessingMode);
+VARIANT_ENUM_CAST(FlashPlayer::PlaybackQuantization);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,188 @@
+// MIT License
+
+// Copyright (c) 2021 Yakov Borevich, Funexpected LLC
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <core/os/file_access.h>
+#include <core/project_settings.h>
+#include "flash_residency.h"
+#include "flash_resources.h"
+
+uint64_t FlashAtlasResidency::get_budget() {
+    int budget_mb = GLOBAL_GET("flash/atlas/residency_budget_mb");
+    return budget_mb > 0 ? uint64_t(budget_mb) << 20 : 0;
+}
+
+bool FlashAtlasResidency::is_needed(const FlashTextureHeader &p_header, uint64_t p_budget) {
+    int layers = p_header.get_layers();
+    uint64_t layer_size = p_header.get_layer_size();
+    return p_budget > 0 && layers > 0 && layer_size > 0 && uint64_t(layers) * layer_size > p_budget;
+}
+
+Ref<FlashAtlasResidency> FlashAtlasResidency::open(const String &p_path, uint64_t p_budget) {
+    FileAccess *f = FileAccess::open(p_path, FileAccess::READ);
+    ERR_FAIL_COND_V_MSG(f == NULL, Ref<FlashAtlasResidency>(), "Can't open " + p_path);
+    FlashTextureHeader header;
+    Error err = ResourceFormatLoaderFlashTexture::read_header(f, header);
+    memdelete(f);
+    if (err != OK) return Ref<FlashAtlasResidency>();
+
+    if (!is_needed(header, p_budget)) return Ref<FlashAtlasResidency>();
+    int layers = header.get_layers();
+    uint64_t layer_size = header.get_layer_size();
+    ERR_FAIL_COND_V_MSG(layers > MAX_LAYERS, Ref<FlashAtlasResidency>(), "Too many atlas layers for residency in " + p_path);
+    // at least one slot, otherwise nothing could be drawn at all
+    int slots = MAX(int(p_budget / layer_size), 1);
+
+    Ref<FlashAtlasResidency> residency;
+    residency.instance();
+    residency->path = p_path;
+    residency->header = header;
+    residency->texture.instance();
+    residency->texture->create(header.width, header.height, slots, header.format, header.flags);
+    residency->layer_slots.resize(layers);
+    residency->layer_pins.resize(layers);
+    for (int i=0; i<layers; i++) {
+        residency->layer_slots.write[i] = NO_SLOT;
+        residency->layer_pins.write[i] = 0;
+    }
+    residency->slot_layers.resize(slots);
+    residency->slot_stamps.resize(slots);
+    for (int i=0; i<slots; i++) {
+        residency->slot_layers.write[i] = -1;
+        residency->slot_stamps.write[i] = 0;
+    }
+    residency->slots_image.instance();
+    residency->slots_texture.instance();
+    residency->slots_dirty = true;
+    residency->_update_slots();
+    return residency;
+}
+
+int FlashAtlasResidency::_find_slot() {
+    int lru = -1;
+    for (int i=0; i<slot_layers.size(); i++) {
+        int layer = slot_layers[i];
+        if (layer < 0) return i;
+        if (layer_pins[layer] > 0) continue;
+        if (lru < 0 || slot_stamps[i] < slot_stamps[lru]) lru = i;
+    }
+    if (lru >= 0) {
+        layer_slots.write[slot_layers[lru]] = NO_SLOT;
+        slot_layers.write[lru] = -1;
+        evictions++;
+    }
+    return lru;
+}
+
+int FlashAtlasResidency::_load(FileAccess *&r_file, int p_layer) {
+    int slot = _find_slot();
+    if (slot < 0) {
+        failures++;
+        return NO_SLOT;
+    }
+    if (r_file == NULL) {
+        r_file = FileAccess::open(path, FileAccess::READ);
+        ERR_FAIL_COND_V_MSG(r_file == NULL, NO_SLOT, "Can't open " + path);
+    }
+    Ref<Image> image = ResourceFormatLoaderFlashTexture::read_layer(r_file, header, p_layer);
+    if (image.is_null()) {
+        failures++;
+        return NO_SLOT;
+    }
+    texture->set_layer_data(image, slot);
+    layer_slots.write[p_layer] = slot;
+    slot_layers.write[slot] = p_layer;
+    slots_dirty = true;
+    loads++;
+    return slot;
+}
+
+void FlashAtlasResidency::_require(const Vector<int> &p_layers, bool p_pin) {
+    FileAccess *f = NULL;
+    // pin everything first, so layers of the same request don't evict each other
+    if (p_pin) {
+        for (int i=0; i<p_layers.size(); i++) {
+            ERR_CONTINUE(p_layers[i] < 0 || p_layers[i] >= layer_pins.size());
+            layer_pins.write[p_layers[i]]++;
+        }
+    }
+    for (int i=0; i<p_layers.size(); i++) {
+        int layer = p_layers[i];
+        if (layer < 0 || layer >= layer_slots.size()) continue;
+        int slot = layer_slots[layer];
+        if (slot == NO_SLOT) {
+            if (p_pin) misses++;
+            slot = _load(f, layer);
+        }
+        if (slot != NO_SLOT) slot_stamps.write[slot] = ++tick;
+    }
+    if (f != NULL) memdelete(f);
+    _update_slots();
+}
+
+void FlashAtlasResidency::release(const Vector<int> &p_layers) {
+    for (int i=0; i<p_layers.size(); i++) {
+        int layer = p_layers[i];
+        if (layer < 0 || layer >= layer_pins.size()) continue;
+        ERR_CONTINUE(layer_pins[layer] <= 0);
+        layer_pins.write[layer]--;
+        // released layers age from now on
+        int slot = layer_slots[layer];
+        if (slot != NO_SLOT) slot_stamps.write[slot] = ++tick;
+    }
+}
+
+void FlashAtlasResidency::_update_slots() {
+    if (!slots_dirty) return;
+    slots_dirty = false;
+    PoolVector<uint8_t> data;
+    data.resize(MAX_LAYERS + 1);
+    {
+        PoolVector<uint8_t>::Write w = data.write();
+        for (int i=0; i<=MAX_LAYERS; i++) {
+            w[i] = i < layer_slots.size() ? layer_slots[i] : NO_SLOT;
+        }
+    }
+    slots_image->create(MAX_LAYERS + 1, 1, false, Image::FORMAT_R8, data);
+    if (slots_texture->get_width() == 0) {
+        slots_texture->create_from_image(slots_image, 0);
+    } else {
+        slots_texture->set_data(slots_image);
+    }
+}
+
+Dictionary FlashAtlasResidency::get_stats() const {
+    int resident = 0;
+    for (int i=0; i<slot_layers.size(); i++) {
+        if (slot_layers[i] >= 0) resident++;
+    }
+    Dictionary stats;
+    stats["layers"] = layer_slots.size();
+    stats["slots"] = slot_layers.size();
+    stats["resident_layers"] = resident;
+    stats["resident_bytes"] = uint64_t(resident) * header.get_layer_size();
+    stats["budget_bytes"] = uint64_t(slot_layers.size()) * header.get_layer_size();
+    stats["loads"] = loads;
+    stats["misses"] = misses;
+    stats["evictions"] = evictions;
+    stats["failures"] = failures;
+    return stats;
+}
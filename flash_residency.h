@@ -0,0 +1,124 @@
+// MIT License
+
+// Copyright (c) 2021 Yakov Borevich, Funexpected LLC
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef FLASH_RESIDENCY_H
+#define FLASH_RESIDENCY_H
+
+#include <core/reference.h>
+#include <core/dictionary.h>
+#include <scene/resources/texture.h>
+
+class FileAccess;
+
+// Parsed header of chunked `.ftex` atlas, see `ResourceFormatLoaderFlashTexture`.
+struct FlashTextureHeader {
+    struct Chunk {
+        uint32_t offset;
+        uint32_t stored_size;
+        uint32_t size;
+        uint32_t compression;
+    };
+
+    int width;
+    int height;
+    Image::Format format;
+    uint32_t flags;
+    bool mipmaps;
+    Vector<Chunk> chunks;
+
+    FlashTextureHeader():
+        width(0),
+        height(0),
+        format(Image::FORMAT_RGBA8),
+        flags(0),
+        mipmaps(false) {}
+
+    int get_layers() const { return chunks.size(); }
+    uint32_t get_layer_size() const { return Image::get_image_data_size(width, height, format, mipmaps); }
+};
+
+// Keeps only part of atlas layers in memory. Texture array gets a fixed
+// number of slots fitting `flash/atlas/residency_budget_mb`, layers are
+// read from `.ftex` into slots on demand. Layers used by players are
+// pinned, the rest are replaced least recently used first. Shader maps
+// layer index to slot with `slots_texture` (one R8 texel per layer,
+// `NO_SLOT` for non-resident), so geometry keeps plain layer indices.
+class FlashAtlasResidency: public Reference {
+    GDCLASS(FlashAtlasResidency, Reference);
+
+    String path;
+    FlashTextureHeader header;
+    Ref<TextureArray> texture;
+    Ref<Image> slots_image;
+    Ref<ImageTexture> slots_texture;
+    Vector<int> layer_slots;
+    Vector<int> layer_pins;
+    Vector<int> slot_layers;
+    Vector<uint64_t> slot_stamps;
+    uint64_t tick;
+    bool slots_dirty;
+
+    int loads;
+    int misses;
+    int evictions;
+    int failures;
+
+    int _find_slot();
+    int _load(FileAccess *&r_file, int p_layer);
+    void _require(const Vector<int> &p_layers, bool p_pin);
+    void _update_slots();
+
+public:
+    enum {
+        MAX_LAYERS = 255,
+        NO_SLOT = 255
+    };
+
+    FlashAtlasResidency():
+        tick(0),
+        slots_dirty(false),
+        loads(0),
+        misses(0),
+        evictions(0),
+        failures(0) {}
+
+    // `flash/atlas/residency_budget_mb` in bytes, 0 when disabled
+    static uint64_t get_budget();
+    static bool is_needed(const FlashTextureHeader &p_header, uint64_t p_budget);
+    // Returns null when whole atlas fits budget or file isn't chunked.
+    static Ref<FlashAtlasResidency> open(const String &p_path, uint64_t p_budget);
+
+    String get_path() const { return path; }
+    Ref<TextureArray> get_texture() const { return texture; }
+    Ref<ImageTexture> get_slots_texture() const { return slots_texture; }
+    int get_layers_count() const { return layer_slots.size(); }
+    int get_slots_count() const { return slot_layers.size(); }
+    bool is_resident(int p_layer) const { return p_layer >= 0 && p_layer < layer_slots.size() && layer_slots[p_layer] != NO_SLOT; }
+
+    void acquire(const Vector<int> &p_layers) { _require(p_layers, true); }
+    void release(const Vector<int> &p_layers);
+    void preload(const Vector<int> &p_layers) { _require(p_layers, false); }
+    Dictionary get_stats() const;
+    void reset_stats() { loads = 0; misses = 0; evictions = 0; failures = 0; }
+};
+
+#endif
@@ -21,8 +21,10 @@
 // SOFTWARE.
 
 #include "flash_resources.h"
+#include "flash_format.h"
 #include "core/io/compression.h"
 #include "core/io/marshalls.h"
+#include "core/engine.h"
 
 FlashDocument *FlashElement::get_document() const {
     return document;
@@ -159,11 +161,29 @@ void FlashDocument::_bind_methods() {
     ClassDB::bind_method(D_METHOD("set_timelines", "timelines"), &FlashDocument::set_timelines);
     ClassDB::bind_method(D_METHOD("get_duration"), &FlashDocument::get_duration, DEFVAL(String()), DEFVAL(String()));
     ClassDB::bind_method(D_METHOD("get_variants"), &FlashDocument::get_variants);
+    ClassDB::bind_method(D_METHOD("get_clip_track_names"), &FlashDocument::get_clip_track_names);
+    ClassDB::bind_method(D_METHOD("find_clip_track", "track"), &FlashDocument::find_clip_track);
+    ClassDB::bind_method(D_METHOD("find_clip", "track_id", "clip"), &FlashDocument::find_clip);
+    ClassDB::bind_method(D_METHOD("find_symbol", "token"), &FlashDocument::find_symbol);
+    ClassDB::bind_method(D_METHOD("get_import_report"), &FlashDocument::get_import_report);
+    ClassDB::bind_method(D_METHOD("set_import_report", "import_report"), &FlashDocument::set_import_report);
+    ClassDB::bind_method(D_METHOD("get_baked_tracks"), &FlashDocument::get_baked_tracks);
+    ClassDB::bind_method(D_METHOD("set_baked_tracks", "baked_tracks"), &FlashDocument::set_baked_tracks);
+    ClassDB::bind_method(D_METHOD("preload_symbols", "symbols"), &FlashDocument::preload_symbols);
+    ClassDB::bind_method(D_METHOD("get_residency_stats"), &FlashDocument::get_residency_stats);
+    ClassDB::bind_method(D_METHOD("get_symbol_names", "top_level"), &FlashDocument::get_symbol_names, DEFVAL(false));
+    ClassDB::bind_method(D_METHOD("is_symbol_loaded", "token"), &FlashDocument::is_symbol_loaded);
+    ClassDB::bind_method(D_METHOD("load_symbols", "symbols"), &FlashDocument::load_symbols);
+    ClassDB::bind_method(D_METHOD("unload_symbols", "symbols"), &FlashDocument::unload_symbols);
+    ClassDB::bind_method(D_METHOD("get_symbols_report"), &FlashDocument::get_symbols_report);
+    ClassDB::bind_method(D_METHOD("get_streaming_stats"), &FlashDocument::get_streaming_stats);
 
     ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "atlas", PROPERTY_HINT_RESOURCE_TYPE, "TextureArray", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_atlas", "get_atlas");
     ADD_PROPERTY(PropertyInfo(Variant::DICTIONARY, "symbols", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_symbols", "get_symbols");
     ADD_PROPERTY(PropertyInfo(Variant::DICTIONARY, "bitmaps", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_bitmaps", "get_bitmaps");
     ADD_PROPERTY(PropertyInfo(Variant::DICTIONARY, "timelines", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_timelines", "get_timelines");
+    ADD_PROPERTY(PropertyInfo(Variant::DICTIONARY, "import_report", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_import_report", "get_import_report");
+    ADD_PROPERTY(PropertyInfo(Variant::DICTIONARY, "baked_tracks", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_baked_tracks", "get_baked_tracks");
 }
 template <class T> Ref<T> FlashDocument::element(FlashElement *parent) {
     Ref<T> elem; elem.instance();
@@ -199,15 +219,29 @@ void FlashDocument::set_timelines(Array p_timelines) {
 }
 float FlashDocument::get_duration(String timeline, String label) {
     Ref<FlashTimeline> tl = get_main_timeline();
-    if (timeline != String() && symbols.has(timeline)) tl = symbols[timeline];
+    if (timeline != String() && has_symbol(timeline)) tl = get_symbol(timeline);
     if (label == String() || !tl->get_clips().has(label)) return tl->get_duration();
     Vector2 lb = tl->get_clips()[label];
     return lb.y - lb.x;
 }
+Ref<FlashBakedTrack> FlashDocument::get_baked_track(const String &p_symbol, const String &p_variant, const String &p_value) const {
+    String key = p_variant == String() ? p_symbol : p_symbol + "|" + p_variant + "=" + p_value;
+    return baked_tracks.get(key, Ref<FlashBakedTrack>());
+}
+void FlashDocument::set_baked_track(const String &p_symbol, const String &p_variant, const String &p_value, const Ref<FlashBakedTrack> &p_track) {
+    String key = p_variant == String() ? p_symbol : p_symbol + "|" + p_variant + "=" + p_value;
+    baked_tracks[key] = p_track;
+}
 Dictionary FlashDocument::get_variants() const {
     return variants;
 }
 void FlashDocument::cache_variants() {
+    // symbols may be gone since previous run, see `prune_unreachable`
+    variants.clear();
+    for (int i=0; i<symbols.size(); i++) {
+        Ref<FlashTimeline> timeline = symbols.get_value_at_index(i);
+        timeline->set_variation_idx(-1);
+    }
     Set<String> variated_symbols;
     for (int i=0; i<symbols.size(); i++) {
         Ref<FlashTimeline> timeline = symbols.get_value_at_index(i);
@@ -216,7 +250,7 @@ void FlashDocument::cache_variants() {
             Ref<FlashLayer> layer = L->get();
             for (List<Ref<FlashFrame>>::Element *F = layer->frames.front(); F; F = F->next()) {
                 Ref<FlashFrame> frame = F->get();
-                if (frame->label_type == "anchor") {
+                if (frame->label_type == FlashFrame::LABEL_ANCHOR) {
                     Dictionary variants_by_layer;
                     if (variants.has(layer->get_layer_name())) {
                         variants_by_layer = variants[layer->get_layer_name()];
@@ -242,6 +276,95 @@ void FlashDocument::cache_variants() {
         symbol->set_variation_idx(variant_idx);
         variant_idx++; 
     }
+    // compiled skin presets depend on variation indices
+    emit_changed();
+}
+// Index clips headers, clips and symbols by dense ids, so players could
+// keep clip state in flat arrays and resolve names once.
+void FlashDocument::cache_clips() {
+    clip_tracks.clear();
+    clip_track_ids.clear();
+    clip_track_names = PoolStringArray();
+    symbols_by_id.clear();
+
+    Vector<FlashTimeline*> all_timelines;
+    for (int i=0; i<symbols.size(); i++) {
+        Ref<FlashTimeline> timeline = symbols.get_value_at_index(i);
+        if (timeline.is_null()) continue;
+        timeline->symbol_id = symbols_by_id.size();
+        symbols_by_id.push_back(timeline.ptr());
+        all_timelines.push_back(timeline.ptr());
+    }
+    for (List<Ref<FlashTimeline>>::Element *E = timelines.front(); E; E = E->next()) {
+        all_timelines.push_back(E->get().ptr());
+    }
+
+    for (int i=0; i<all_timelines.size(); i++) {
+        FlashTimeline *timeline = all_timelines[i];
+        timeline->clips_track_id = -1;
+        if (timeline->clips_header == String()) continue;
+        int *track_id = clip_track_ids.getptr(timeline->clips_header);
+        if (track_id == NULL) {
+            FlashClipTrack track;
+            track.name = timeline->clips_header;
+            clip_track_ids[track.name] = clip_tracks.size();
+            clip_track_names.push_back(track.name);
+            clip_tracks.push_back(track);
+            track_id = clip_track_ids.getptr(timeline->clips_header);
+        }
+        timeline->clips_track_id = *track_id;
+        FlashClipTrack &track = clip_tracks.write[*track_id];
+        for (int j=0; j<timeline->clips.size(); j++) {
+            String clip = timeline->clips.get_key_at_index(j);
+            if (find_clip(*track_id, clip) >= 0) continue;
+            track.clips.push_back(clip);
+            track.ranges.push_back(timeline->clips.get_value_at_index(j));
+        }
+    }
+}
+int FlashDocument::find_clip_track(const String &p_track) const {
+    const int *track_id = clip_track_ids.getptr(p_track);
+    return track_id == NULL ? -1 : *track_id;
+}
+int FlashDocument::find_clip(int p_track, const String &p_clip) const {
+    ERR_FAIL_INDEX_V(p_track, clip_tracks.size(), -1);
+    PoolStringArray::Read clips = clip_tracks[p_track].clips.read();
+    for (int i=0; i<clip_tracks[p_track].clips.size(); i++) {
+        if (clips[i] == p_clip) return i;
+    }
+    return -1;
+}
+int FlashDocument::find_symbol(const String &p_token) const {
+    Ref<FlashTimeline> timeline = symbols.get(p_token, Variant());
+    if (timeline.is_valid()) return timeline->get_symbol_id();
+    const FlashSymbolBlob *blob = symbol_blobs.getptr(p_token);
+    return blob != NULL ? blob->symbol_id : -1;
+}
+int FlashDocument::get_variation_idx(const String &p_token) const {
+    Ref<FlashTimeline> timeline = symbols.get(p_token, Variant());
+    if (timeline.is_valid()) return timeline->get_variation_idx();
+    const FlashSymbolBlob *blob = symbol_blobs.getptr(p_token);
+    return blob != NULL ? blob->variation_idx : -1;
+}
+// Frame overrides for a full set of variants, variants not listed
+// (or set to "[default]") keep default frames.
+void FlashDocument::compile_variants(const Dictionary &p_variants, Vector<int> &r_overrides) const {
+    r_overrides.resize(variated_symbols_count);
+    int *overrides = r_overrides.ptrw();
+    for (int i=0; i<r_overrides.size(); i++) { overrides[i] = -1; }
+    for (int i=0; i<p_variants.size(); i++) {
+        String variant = p_variants.get_key_at_index(i);
+        String value = p_variants.get_value_at_index(i);
+        if (value == "[default]" || !variants.has(variant)) continue;
+        Dictionary symbols_by_variant = variants[variant];
+        if (!symbols_by_variant.has(value)) continue;
+        Dictionary frames_by_symbol = symbols_by_variant[value];
+        for (int j=0; j<frames_by_symbol.size(); j++) {
+            int variation_idx = get_variation_idx(frames_by_symbol.get_key_at_index(j));
+            if (variation_idx < 0) continue;
+            overrides[variation_idx] = frames_by_symbol.get_value_at_index(j);
+        }
+    }
 }
 Ref<FlashDocument> FlashDocument::from_file(const String &p_path) {
     Ref<FlashDocument> doc; doc.instance();
@@ -267,7 +390,257 @@ Error FlashDocument::load_file(const String &p_path) {
 
 FlashTimeline* FlashDocument::get_timeline(String token) {
     Ref<FlashTimeline> tl = symbols.get(token, Variant());
-    return tl.is_valid() ? tl.ptr() : nullptr;
+    return tl.is_valid() ? tl.ptr() : _load_symbol(token);
+}
+Ref<FlashTimeline> FlashDocument::get_symbol(const String &p_token) {
+    return Ref<FlashTimeline>(get_timeline(p_token));
+}
+// Reads symbol on first use. Instances resolve their symbols on the
+// way, so whole subtree gets loaded; subtree flags need all of it
+// resolved and are computed once outermost load is done.
+FlashTimeline *FlashDocument::_load_symbol(const String &p_token) {
+    const FlashSymbolBlob *blob = symbol_blobs.getptr(p_token);
+    if (blob == NULL) return NULL;
+    Ref<FlashTimeline> timeline = FlashDocumentFormat::read_symbol(this, *blob);
+    ERR_FAIL_COND_V_MSG(timeline.is_null(), NULL, "Can't load symbol " + p_token);
+    ERR_FAIL_INDEX_V(timeline->symbol_id, symbols_by_id.size(), NULL);
+    symbols[p_token] = timeline;
+    symbols_by_id.write[timeline->symbol_id] = timeline.ptr();
+    symbols_loads++;
+    symbols_version++;
+
+    loading_depth++;
+    loading_symbols.push_back(timeline.ptr());
+    timeline->resolve();
+    loading_depth--;
+    if (loading_depth == 0) {
+        for (int i=0; i<loading_symbols.size(); i++) {
+            loading_symbols[i]->compute_subtree_flags();
+        }
+        loading_symbols.clear();
+    }
+    return timeline.ptr();
+}
+PoolStringArray FlashDocument::get_symbol_names(bool p_top_level) const {
+    PoolStringArray result;
+    Set<String> names;
+    for (int i=0; i<symbols.size(); i++) {
+        Ref<FlashTimeline> timeline = symbols.get_value_at_index(i);
+        if (timeline.is_null() || (p_top_level && timeline->get_local_path().find("/") >= 0)) continue;
+        names.insert(symbols.get_key_at_index(i));
+    }
+    const String *key = NULL;
+    while ((key = symbol_blobs.next(key))) {
+        if (p_top_level && symbol_blobs[*key].local_path.find("/") >= 0) continue;
+        names.insert(*key);
+    }
+    for (Set<String>::Element *E = names.front(); E; E = E->next()) {
+        result.push_back(E->get());
+    }
+    return result;
+}
+int FlashDocument::load_symbols(const PoolStringArray &p_symbols) {
+    int loaded = 0;
+    for (int i=0; i<p_symbols.size(); i++) {
+        if (symbols.has(p_symbols[i])) continue;
+        ERR_CONTINUE_MSG(!symbol_blobs.has(p_symbols[i]), "No symbol found for " + p_symbols[i]);
+        if (_load_symbol(p_symbols[i]) != NULL) loaded++;
+    }
+    return loaded;
+}
+void FlashDocument::load_all_symbols() {
+    const String *key = NULL;
+    while ((key = symbol_blobs.next(key))) {
+        if (!symbols.has(*key)) _load_symbol(*key);
+    }
+}
+// Symbol is unloaded only if nothing holds it: no other loaded symbol
+// instances it and no player has it active (document is the only owner).
+int FlashDocument::unload_symbols(const PoolStringArray &p_symbols) {
+    Set<String> pending;
+    for (int i=0; i<p_symbols.size(); i++) {
+        if (symbols.has(p_symbols[i]) && symbol_blobs.has(p_symbols[i])) pending.insert(p_symbols[i]);
+    }
+    int unloaded = 0;
+    bool changed = true;
+    // unloading a symbol may release the ones it instances
+    while (changed && pending.size() > 0) {
+        changed = false;
+        Set<const FlashTimeline*> referenced;
+        Array loaded = symbols.values();
+        for (List<Ref<FlashTimeline>>::Element *E = timelines.front(); E; E = E->next()) {
+            loaded.push_back(E->get());
+        }
+        for (int i=0; i<loaded.size(); i++) {
+            Ref<FlashTimeline> timeline = loaded[i];
+            for (int l=0; l<2; l++) {
+                const List<Ref<FlashLayer>> &list = l == 0 ? timeline->layers : timeline->masks;
+                for (const List<Ref<FlashLayer>>::Element *L = list.front(); L; L = L->next()) {
+                    for (List<Ref<FlashFrame>>::Element *F = L->get()->frames.front(); F; F = F->next()) {
+                        const Vector<FlashDrawingData> &drawings = F->get()->drawings;
+                        for (int j=0; j<drawings.size(); j++) {
+                            if (drawings[j].timeline != NULL && drawings[j].timeline != timeline.ptr()) referenced.insert(drawings[j].timeline);
+                        }
+                    }
+                }
+            }
+        }
+        loaded.clear();
+        for (Set<String>::Element *E = pending.front(); E;) {
+            Set<String>::Element *N = E->next();
+            Ref<FlashTimeline> timeline = symbols[E->get()];
+            // held by `symbols` and this reference only
+            if (!referenced.has(timeline.ptr()) && timeline->reference_get_count() <= 2) {
+                symbols_by_id.write[timeline->symbol_id] = NULL;
+                symbols.erase(E->get());
+                pending.erase(E);
+                unloaded++;
+                changed = true;
+            }
+            E = N;
+        }
+    }
+    if (unloaded > 0) {
+        symbols_unloads += unloaded;
+        symbols_version++;
+    }
+    return unloaded;
+}
+void FlashDocument::load_all_frames() {
+    for (int i=0; i<symbols.size(); i++) {
+        Ref<FlashTimeline> timeline = symbols.get_value_at_index(i);
+        if (timeline.is_valid()) timeline->load_all_chunks();
+    }
+    for (List<Ref<FlashTimeline>>::Element *E = timelines.front(); E; E = E->next()) {
+        E->get()->load_all_chunks();
+    }
+}
+Dictionary FlashDocument::get_streaming_stats() const {
+    int chunks = 0;
+    int loaded_chunks = 0;
+    int loaded_frames = 0;
+    Array loaded = symbols.values();
+    for (const List<Ref<FlashTimeline>>::Element *E = timelines.front(); E; E = E->next()) {
+        loaded.push_back(E->get());
+    }
+    for (int i=0; i<loaded.size(); i++) {
+        Ref<FlashTimeline> timeline = loaded[i];
+        for (int l=0; l<2; l++) {
+            const List<Ref<FlashLayer>> &list = l == 0 ? timeline->layers : timeline->masks;
+            for (const List<Ref<FlashLayer>>::Element *L = list.front(); L; L = L->next()) {
+                const Vector<FlashFrameChunk> &layer_chunks = L->get()->chunks;
+                for (int c=0; c<layer_chunks.size(); c++) {
+                    chunks++;
+                    if (!layer_chunks[c].loaded) continue;
+                    loaded_chunks++;
+                    loaded_frames += layer_chunks[c].frames.size();
+                }
+            }
+        }
+    }
+    Dictionary stats;
+    stats["chunks"] = chunks;
+    stats["loaded_chunks"] = loaded_chunks;
+    stats["loaded_frames"] = loaded_frames;
+    stats["loads"] = frame_chunk_loads;
+    stats["seeks"] = frame_chunk_seeks;
+    stats["evictions"] = frame_chunk_evictions;
+    stats["failures"] = frame_chunk_failures;
+    return stats;
+}
+// Drops library symbols and bitmaps not reachable from main timelines
+// and `p_roots` through instances and bitmap instances, tables built
+// by `setup` are rebuilt. Returns what was removed.
+Dictionary FlashDocument::prune_unreachable(const PoolStringArray &p_roots) {
+    load_all_symbols();
+    load_all_frames();
+    Set<String> reached_symbols;
+    Set<String> reached_bitmaps;
+    PoolStringArray missing_roots;
+    Vector<FlashTimeline*> pending;
+    for (List<Ref<FlashTimeline>>::Element *E = timelines.front(); E; E = E->next()) {
+        pending.push_back(E->get().ptr());
+    }
+    for (int i=0; i<p_roots.size(); i++) {
+        if (!symbols.has(p_roots[i])) {
+            missing_roots.push_back(p_roots[i]);
+        } else if (!reached_symbols.has(p_roots[i])) {
+            reached_symbols.insert(p_roots[i]);
+            pending.push_back(get_timeline(p_roots[i]));
+        }
+    }
+    while (pending.size() > 0) {
+        const FlashTimeline *timeline = pending[pending.size() - 1];
+        pending.resize(pending.size() - 1);
+        for (int l=0; l<2; l++) {
+            const List<Ref<FlashLayer>> &list = l == 0 ? timeline->layers : timeline->masks;
+            for (const List<Ref<FlashLayer>>::Element *L = list.front(); L; L = L->next()) {
+                for (const List<Ref<FlashFrame>>::Element *F = L->get()->frames.front(); F; F = F->next()) {
+                    // group members are flattened, so every entry is visited
+                    const Vector<FlashDrawingData> &drawings = F->get()->drawings;
+                    for (int i=0; i<drawings.size(); i++) {
+                        const FlashDrawingData &drawing = drawings[i];
+                        if (drawing.kind == FlashDrawingData::KIND_BITMAP) {
+                            reached_bitmaps.insert(drawing.token);
+                        } else if (drawing.kind == FlashDrawingData::KIND_INSTANCE && !reached_symbols.has(drawing.token) && symbols.has(drawing.token)) {
+                            reached_symbols.insert(drawing.token);
+                            pending.push_back(get_timeline(drawing.token));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    PoolStringArray removed_symbols;
+    Array symbol_keys = symbols.keys();
+    for (int i=0; i<symbol_keys.size(); i++) {
+        String token = symbol_keys[i];
+        if (reached_symbols.has(token)) continue;
+        symbols.erase(token);
+        symbol_blobs.erase(token);
+        removed_symbols.push_back(token);
+    }
+    PoolStringArray removed_bitmaps;
+    Array bitmap_keys = bitmaps.keys();
+    for (int i=0; i<bitmap_keys.size(); i++) {
+        String name = bitmap_keys[i];
+        if (reached_bitmaps.has(name)) continue;
+        bitmaps.erase(name);
+        removed_bitmaps.push_back(name);
+    }
+    if (removed_symbols.size() > 0 || removed_bitmaps.size() > 0) {
+        setup(this, NULL);
+    }
+
+    Dictionary report;
+    report["symbols"] = removed_symbols;
+    report["bitmaps"] = removed_bitmaps;
+    if (missing_roots.size() > 0) report["missing_roots"] = missing_roots;
+    return report;
+}
+Dictionary FlashDocument::get_symbols_report() const {
+    int total_bytes = 0;
+    int loaded_bytes = 0;
+    PoolStringArray loaded;
+    const String *key = NULL;
+    while ((key = symbol_blobs.next(key))) {
+        total_bytes += symbol_blobs[*key].size;
+        if (!symbols.has(*key)) continue;
+        loaded_bytes += symbol_blobs[*key].size;
+        loaded.push_back(*key);
+    }
+    // documents parsed from xml have every symbol loaded
+    bool serialized = symbol_blobs.size() > 0;
+    Dictionary report;
+    report["symbols"] = serialized ? symbol_blobs.size() : symbols.size();
+    report["loaded_symbols"] = serialized ? loaded.size() : symbols.size();
+    report["loaded"] = loaded;
+    report["total_bytes"] = total_bytes;
+    report["loaded_bytes"] = loaded_bytes;
+    report["loads"] = symbols_loads;
+    report["unloads"] = symbols_unloads;
+    return report;
 }
 
 void FlashDocument::parse_timeline(const String &path) {
@@ -308,6 +681,96 @@ void FlashDocument::setup(FlashDocument *p_document, FlashElement *p_parent) {
     }
 
     cache_variants();
+    cache_clips();
+    resolve();
+}
+
+// Resolves links between elements (instance symbols, bitmap textures
+// and uvs) up front, so evaluation never writes into the document
+// and one document can be evaluated from several threads at once.
+void FlashDocument::resolve() {
+    resolve(get_atlas_size());
+}
+void FlashDocument::resolve(const Vector2 &p_atlas_size) {
+    // symbols loaded by instances below get their flags computed at the end
+    loading_depth++;
+    Array bitmaps_array = bitmaps.values();
+    for (int i=0; i<bitmaps_array.size(); i++) {
+        Ref<FlashBitmapItem> bi = bitmaps_array[i];
+        if (bi.is_valid() && bi->get_texture().is_valid())
+            bi->get_texture()->update_uvs(p_atlas_size);
+    }
+    Array symbols_array = symbols.values();
+    for (int i=0; i<symbols_array.size(); i++) {
+        Ref<FlashTimeline> timeline = symbols_array[i];
+        if (timeline.is_valid())
+            timeline->resolve();
+    }
+    for (List<Ref<FlashTimeline>>::Element *E = timelines.front(); E; E = E->next()) {
+        E->get()->resolve();
+    }
+    loading_depth--;
+    // flags depend on resolved instances of the whole tree
+    for (int i=0; i<symbols_array.size(); i++) {
+        Ref<FlashTimeline> timeline = symbols_array[i];
+        if (timeline.is_valid())
+            timeline->compute_subtree_flags();
+    }
+    for (int i=0; i<loading_symbols.size(); i++) {
+        loading_symbols[i]->compute_subtree_flags();
+    }
+    loading_symbols.clear();
+    for (List<Ref<FlashTimeline>>::Element *E = timelines.front(); E; E = E->next()) {
+        E->get()->compute_subtree_flags();
+    }
+}
+void FlashDocument::acquire_symbol(FlashTimeline *p_symbol) {
+    if (residency.is_null() || p_symbol == NULL) return;
+    residency->acquire(p_symbol->get_atlas_layers());
+}
+void FlashDocument::release_symbol(FlashTimeline *p_symbol) {
+    if (residency.is_null() || p_symbol == NULL) return;
+    residency->release(p_symbol->get_atlas_layers());
+}
+void FlashDocument::preload_symbols(const PoolStringArray &p_symbols) {
+    if (residency.is_null()) return;
+    Set<int> layers;
+    for (int i=0; i<p_symbols.size(); i++) {
+        Ref<FlashTimeline> timeline = p_symbols[i] == String() ? get_main_timeline() : get_symbol(p_symbols[i]);
+        ERR_CONTINUE_MSG(timeline.is_null(), "No symbol found for " + p_symbols[i]);
+        const Vector<int> &timeline_layers = timeline->get_atlas_layers();
+        for (int j=0; j<timeline_layers.size(); j++) {
+            layers.insert(timeline_layers[j]);
+        }
+    }
+    Vector<int> preloaded;
+    for (Set<int>::Element *E = layers.front(); E; E = E->next()) {
+        preloaded.push_back(E->get());
+    }
+    residency->preload(preloaded);
+}
+Dictionary FlashDocument::get_residency_stats() const {
+    if (residency.is_valid()) return residency->get_stats();
+    // whole atlas is resident
+    Dictionary stats;
+    int layers = atlas.is_valid() ? atlas->get_depth() : 0;
+    uint64_t layer_size = atlas.is_valid() ? Image::get_image_data_size(atlas->get_width(), atlas->get_height(), atlas->get_format(), atlas->get_flags() & TextureLayered::FLAG_MIPMAPS) : 0;
+    stats["layers"] = layers;
+    stats["slots"] = layers;
+    stats["resident_layers"] = layers;
+    stats["resident_bytes"] = uint64_t(layers) * layer_size;
+    stats["budget_bytes"] = uint64_t(layers) * layer_size;
+    stats["loads"] = 0;
+    stats["misses"] = 0;
+    stats["evictions"] = 0;
+    stats["failures"] = 0;
+    return stats;
+}
+void FlashDocument::set_atlas(Ref<TextureArray> p_atlas) {
+    atlas = p_atlas;
+    // bitmap uvs are baked against atlas size, document
+    // may still be loading here and get resolved in `setup`
+    if (document == this) resolve();
 }
 Ref<FlashTextureRect> FlashDocument::get_bitmap_rect(const String &p_name) {
     ERR_FAIL_COND_V_MSG(!bitmaps.has(p_name), Ref<FlashTextureRect>(), "No bitmap found for " + p_name);
@@ -335,8 +798,8 @@ Error FlashDocument::parse(Ref<XMLParser> xml) {
     }
     return Error::OK;
 }
-void FlashDocument::animation_process(FlashPlayer* node, float time, float delta, Transform2D tr, FlashColorEffect effect) {
-    for (List<Ref<FlashTimeline>>::Element *E = timelines.front(); E; E = E->next()) {
+void FlashDocument::animation_process(FlashEvaluator* node, float time, float delta, Transform2D tr, FlashColorEffect effect) const {
+    for (const List<Ref<FlashTimeline>>::Element *E = timelines.front(); E; E = E->next()) {
         E->get()->animation_process(node, time, delta, tr, effect);
     }
 }
@@ -396,10 +859,11 @@ Array FlashTimeline::get_layers() {
 }
 void FlashTimeline::set_layers(Array p_layers) {
     layers.clear();
+    masks.clear();
     for (int i=0; i<p_layers.size(); i++) {
         Ref<FlashLayer> layer = p_layers[i];
         if (layer.is_valid()) {
-            if (layer->get_type() == "mask")
+            if (layer->get_layer_type() == FlashLayer::TYPE_MASK)
                 masks.push_back(layer);
             else
                 layers.push_back(layer);
@@ -415,10 +879,10 @@ Ref<FlashLayer> FlashTimeline::get_layer(int index) {
     }
     return Ref<FlashLayer>();
 }
-void FlashTimeline::add_label(const String &name, const String &label_type, float start, float duration) {
-    if (label_type == "anchor") {
+void FlashTimeline::add_label(const String &name, int label_type, float start, float duration) {
+    if (label_type == FlashFrame::LABEL_ANCHOR) {
         variants[name] = start;
-    } else if (label_type == "comment") {
+    } else if (label_type == FlashFrame::LABEL_COMMENT) {
         PoolRealArray timings;
         if (events.has(name)) {
             timings = events[name];
@@ -433,8 +897,127 @@ void FlashTimeline::add_label(const String &name, const String &label_type, floa
     }
     //labels[name] = Vector2(start, start+duration);
 }
+// Evaluation only reads flags computed on resolve or symbol load,
+// walking the tree here could load symbols into shared document.
+int FlashTimeline::get_subtree_flags() const {
+    ERR_FAIL_COND_V_MSG(subtree_flags < 0, 0, "Subtree flags of " + get_token() + " aren't computed yet");
+    return subtree_flags;
+}
+void FlashTimeline::compute_subtree_flags() {
+    if (subtree_flags >= 0) return;
+    Set<const FlashTimeline*> visited;
+    subtree_flags = _collect_subtree_flags(visited);
+}
+int FlashTimeline::_collect_subtree_flags(Set<const FlashTimeline*> &r_visited) {
+    if (subtree_flags >= 0) return subtree_flags;
+    // recursive symbols can't loop forever
+    if (r_visited.has(this)) return 0;
+    r_visited.insert(this);
+    int flags = 0;
+    if (events.size() > 0) flags |= SUBTREE_HAS_EVENTS;
+    if (variation_idx >= 0) flags |= SUBTREE_HAS_VARIANTS;
+    if (clips_header != String() && clips.size() > 0) flags |= SUBTREE_HAS_CLIPS;
+    if (masks.size() > 0) flags |= SUBTREE_HAS_MASKS;
+    for (const List<Ref<FlashLayer>>::Element *L = layers.front(); L; L = L->next()) {
+        Ref<FlashLayer> layer = L->get();
+        if (layer->get_mask_id()) flags |= SUBTREE_HAS_MASKS;
+        for (int c=0; c<layer->chunks.size(); c++) {
+            const FlashFrameChunk &chunk = layer->chunks[c];
+            if (chunk.has_tweens) flags |= SUBTREE_HAS_TWEENS;
+            if (chunk.has_cached) flags |= SUBTREE_HAS_CACHED;
+            for (int i=0; i<chunk.symbols.size(); i++) {
+                FlashTimeline *timeline = document->get_timeline(chunk.symbols[i]);
+                if (timeline != NULL) flags |= timeline->_collect_subtree_flags(r_visited);
+            }
+        }
+        for (List<Ref<FlashFrame>>::Element *F = layer->frames.front(); F; F = F->next()) {
+            Ref<FlashFrame> frame = F->get();
+            if (frame->flags & FLAG_HAS_TWEEN) flags |= SUBTREE_HAS_TWEENS;
+            for (int i=0; i<frame->drawings.size(); i++) {
+                const FlashDrawingData &drawing = frame->drawings[i];
+                if (drawing.kind != FlashDrawingData::KIND_INSTANCE) continue;
+                if (drawing.cache_as_bitmap) flags |= SUBTREE_HAS_CACHED;
+                if (drawing.timeline == NULL) continue;
+                flags |= drawing.timeline->_collect_subtree_flags(r_visited);
+            }
+        }
+    }
+    return flags;
+}
+const Vector<int> &FlashTimeline::get_atlas_layers() {
+    if (atlas_layers_ready) return atlas_layers;
+    Set<const FlashTimeline*> visited;
+    Set<int> layers;
+    _collect_atlas_layers(visited, layers);
+    atlas_layers.clear();
+    for (Set<int>::Element *E = layers.front(); E; E = E->next()) {
+        atlas_layers.push_back(E->get());
+    }
+    atlas_layers_ready = true;
+    return atlas_layers;
+}
+void FlashTimeline::_collect_atlas_layers(Set<const FlashTimeline*> &r_visited, Set<int> &r_layers) const {
+    if (r_visited.has(this)) return;
+    r_visited.insert(this);
+    for (int l=0; l<2; l++) {
+        const List<Ref<FlashLayer>> &list = l == 0 ? layers : masks;
+        for (const List<Ref<FlashLayer>>::Element *L = list.front(); L; L = L->next()) {
+            // chunks not loaded yet are known by what they refer to
+            const Vector<FlashFrameChunk> &chunks = L->get()->chunks;
+            for (int c=0; c<chunks.size(); c++) {
+                for (int i=0; i<chunks[c].bitmaps.size(); i++) {
+                    Ref<FlashTextureRect> texture = document->get_bitmap_rect(chunks[c].bitmaps[i]);
+                    if (texture.is_valid()) r_layers.insert(texture->get_index());
+                }
+                for (int i=0; i<chunks[c].symbols.size(); i++) {
+                    FlashTimeline *timeline = document->get_timeline(chunks[c].symbols[i]);
+                    if (timeline != NULL) timeline->_collect_atlas_layers(r_visited, r_layers);
+                }
+            }
+            for (List<Ref<FlashFrame>>::Element *F = L->get()->frames.front(); F; F = F->next()) {
+                const Vector<FlashDrawingData> &drawings = F->get()->drawings;
+                for (int i=0; i<drawings.size(); i++) {
+                    const FlashDrawingData &drawing = drawings[i];
+                    if (drawing.kind == FlashDrawingData::KIND_BITMAP && drawing.texture.is_valid()) {
+                        r_layers.insert(drawing.texture->get_index());
+                    } else if (drawing.kind == FlashDrawingData::KIND_INSTANCE && drawing.timeline != NULL) {
+                        drawing.timeline->_collect_atlas_layers(r_visited, r_layers);
+                    }
+                }
+            }
+        }
+    }
+}
+void FlashTimeline::resolve() {
+    subtree_flags = -1;
+    atlas_layers_ready = false;
+    for (List<Ref<FlashLayer>>::Element *L = layers.front(); L; L = L->next()) {
+        L->get()->resolve();
+    }
+    for (List<Ref<FlashLayer>>::Element *L = masks.front(); L; L = L->next()) {
+        L->get()->resolve();
+    }
+}
+void FlashTimeline::stream(float p_from, float p_to) {
+    uint64_t tick = Engine::get_singleton()->get_idle_frames();
+    for (List<Ref<FlashLayer>>::Element *L = layers.front(); L; L = L->next()) {
+        L->get()->stream(p_from, p_to, tick);
+    }
+    for (List<Ref<FlashLayer>>::Element *L = masks.front(); L; L = L->next()) {
+        L->get()->stream(p_from, p_to, tick);
+    }
+}
+void FlashTimeline::load_all_chunks() {
+    for (List<Ref<FlashLayer>>::Element *L = layers.front(); L; L = L->next()) {
+        L->get()->load_all_chunks();
+    }
+    for (List<Ref<FlashLayer>>::Element *L = masks.front(); L; L = L->next()) {
+        L->get()->load_all_chunks();
+    }
+}
 void FlashTimeline::setup(FlashDocument *p_document, FlashElement *p_parent) {
     FlashElement::setup(p_document, p_parent);
+    subtree_flags = -1;
     for (List<Ref<FlashLayer>>::Element *E = layers.front(); E; E = E->next()) {
         E->get()->setup(document, this);
     }
@@ -462,7 +1045,7 @@ Error FlashTimeline::parse(Ref<XMLParser> xml) {
                 layer_index++;
                 continue;
             }
-            if (layer->get_type() == "mask") {
+            if (layer->get_layer_type() == FlashLayer::TYPE_MASK) {
                 masks.push_back(layer);
             } else {
                 layers.push_back(layer);
@@ -474,7 +1057,47 @@ Error FlashTimeline::parse(Ref<XMLParser> xml) {
     }
     return Error::OK;
 }
-void FlashTimeline::animation_process(FlashPlayer* node, float time, float delta, Transform2D tr, FlashColorEffect effect) {
+// Evaluates timeline without a player: all mutable state lives in
+// `p_state` and `r_output`, so any number of threads may evaluate
+// the same document, each with its own buffers.
+void FlashTimeline::evaluate(float p_time, const FlashPlayerState &p_state, FlashOutputBuffers &r_output, float p_delta) const {
+    FlashEvaluator evaluator(&p_state, &r_output);
+    animation_process(&evaluator, p_time, p_delta);
+}
+void FlashTimeline::animation_process(FlashEvaluator* node, float time, float delta, Transform2D tr, FlashColorEffect effect) const {
+    fire_events(node, time, delta);
+    masks_process(node, time, delta, tr, effect);
+    for (const List<Ref<FlashLayer>>::Element *E = layers.back(); E; E = E->prev()) {
+        E->get()->animation_process(node, time, delta, tr, effect);
+    }
+}
+void FlashTimeline::masks_process(FlashEvaluator* node, float time, float delta, Transform2D tr, FlashColorEffect effect) const {
+    for (const List<Ref<FlashLayer>>::Element *E = masks.front(); E; E = E->next()) {
+        E->get()->animation_process(node, time, delta, tr, effect);
+    }
+}
+// Regular layers in order they are drawn by `animation_process`.
+void FlashTimeline::get_paint_order(Vector<const FlashLayer*> &r_layers) const {
+    r_layers.resize(0);
+    for (const List<Ref<FlashLayer>>::Element *E = layers.back(); E; E = E->prev()) {
+        r_layers.push_back(E->get().ptr());
+    }
+}
+
+// Cheap variant of `animation_process`: only walks subtrees
+// that have events and fires them, no geometry produced.
+void FlashTimeline::events_process(FlashEvaluator* node, float time, float delta) const {
+    if (!(get_subtree_flags() & SUBTREE_HAS_EVENTS)) return;
+    fire_events(node, time, delta);
+    for (const List<Ref<FlashLayer>>::Element *E = masks.front(); E; E = E->next()) {
+        E->get()->events_process(node, time, delta);
+    }
+    for (const List<Ref<FlashLayer>>::Element *E = layers.back(); E; E = E->prev()) {
+        E->get()->events_process(node, time, delta);
+    }
+}
+
+void FlashTimeline::fire_events(FlashEvaluator* node, float time, float delta) const {
     if (events.size() && delta > 0.0) {
         float event_frame_start = -2.0;
         float event_frame_end = -2.0;
@@ -499,13 +1122,23 @@ void FlashTimeline::animation_process(FlashPlayer* node, float time, float delta
             }
         }
     }
+}
 
-    for (List<Ref<FlashLayer>>::Element *E = masks.front(); E; E = E->next()) {
-        E->get()->animation_process(node, time, delta, tr, effect);
+// Returns how many frames (in timeline time) may pass before output
+// of timeline changes, 0 if it changes continuously.
+float FlashTimeline::get_next_change(FlashEvaluator* node, float time) const {
+    float next_change = Math_INF;
+    // events are fired on entering next integer frame
+    if (events.size()) next_change = floor(time) + 1.0 - time;
+    for (const List<Ref<FlashLayer>>::Element *E = masks.front(); E; E = E->next()) {
+        next_change = MIN(next_change, E->get()->get_next_change(node, time));
+        if (next_change <= 0) return 0;
     }
-    for (List<Ref<FlashLayer>>::Element *E = layers.back(); E; E = E->prev()) {
-        E->get()->animation_process(node, time, delta, tr, effect);
+    for (const List<Ref<FlashLayer>>::Element *E = layers.front(); E; E = E->next()) {
+        next_change = MIN(next_change, E->get()->get_next_change(node, time));
+        if (next_change <= 0) return 0;
     }
+    return next_change;
 }
 
 void FlashLayer::_bind_methods() {
@@ -529,6 +1162,22 @@ void FlashLayer::_bind_methods() {
     ADD_PROPERTY(PropertyInfo(Variant::INT, "mask_id", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_mask_id", "get_mask_id");
     ADD_PROPERTY(PropertyInfo(Variant::ARRAY, "frames", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_frames", "get_frames");
 }
+FlashLayer::Type FlashLayer::parse_type(const String &p_type) {
+    if (p_type == "guide") return TYPE_GUIDE;
+    if (p_type == "guided") return TYPE_GUIDED;
+    if (p_type == "mask") return TYPE_MASK;
+    if (p_type == "folder") return TYPE_FOLDER;
+    return TYPE_NORMAL;
+}
+String FlashLayer::get_type_name(Type p_type) {
+    switch (p_type) {
+        case TYPE_GUIDE: return "guide";
+        case TYPE_GUIDED: return "guided";
+        case TYPE_MASK: return "mask";
+        case TYPE_FOLDER: return "folder";
+        default: return "normal";
+    }
+}
 Array FlashLayer::get_frames() {
     Array l;
     for (List<Ref<FlashFrame>>::Element *E = frames.front(); E; E = E->next()) {
@@ -555,8 +1204,8 @@ Error FlashLayer::parse(Ref<XMLParser> xml) {
     if (xml->has_attribute("name"))
         layer_name = xml->get_attribute_value_safe("name");
     if (xml->has_attribute("layerType"))
-        type = xml->get_attribute_value_safe("layerType");
-    if (type == "guide") {
+        type = parse_type(xml->get_attribute_value_safe("layerType"));
+    if (type == TYPE_GUIDE) {
         if (xml->is_empty()) return ERR_SKIP;
         while (xml->read() == OK) {
             if (xml->get_node_type() == XMLParser::NODE_TEXT) continue;
@@ -570,7 +1219,7 @@ Error FlashLayer::parse(Ref<XMLParser> xml) {
         int layer_index = xml->get_attribute_value_safe("parentLayerIndex").to_int();
         FlashTimeline *tl = find_parent<FlashTimeline>();
         Ref<FlashLayer> parent_layer = tl->get_layer(layer_index);
-        if (parent_layer.is_valid() && parent_layer->type == "mask") {
+        if (parent_layer.is_valid() && parent_layer->type == TYPE_MASK) {
             mask_id = parent_layer->get_eid();
         }
     }
@@ -587,11 +1236,110 @@ Error FlashLayer::parse(Ref<XMLParser> xml) {
     }
     return Error::OK;
 };
-void FlashLayer::animation_process(FlashPlayer* node, float time, float delta, Transform2D parent_transform, FlashColorEffect parent_effect) {
-    if (type == "guide") return;
-    if (type == "folder") return;
-    if (type == "mask") node->mask_begin(get_eid());
-    if (mask_id) node->clip_begin(mask_id);
+// Static layer (single keyframe of bitmaps) never changes,
+// masked layer has `mask_id` of its mask layer.
+void FlashLayer::resolve() {
+    flags = 0;
+    if (mask_id) flags |= FLAG_MASKED;
+    for (List<Ref<FlashFrame>>::Element *F = frames.front(); F; F = F->next()) {
+        F->get()->resolve();
+    }
+    if (frames.size() != 1 || chunks.size() > 0) return;
+    Ref<FlashFrame> frame = frames.front()->get();
+    if (frame->index != 0 || (frame->flags & FLAG_HAS_TWEEN)) return;
+    for (int i=0; i<frame->drawings.size(); i++) {
+        if (frame->drawings[i].kind == FlashDrawingData::KIND_INSTANCE) return;
+    }
+    flags |= FLAG_STATIC;
+}
+bool FlashLayer::_load_chunk(FlashFrameChunk &r_chunk) {
+    if (FlashDocumentFormat::read_chunk(document, this, r_chunk, r_chunk.frames) != OK) {
+        r_chunk.frames.clear();
+        document->frame_chunk_failures++;
+        return false;
+    }
+    for (List<Ref<FlashFrame>>::Element *F = r_chunk.frames.front(); F; F = F->next()) {
+        F->get()->resolve();
+    }
+    r_chunk.loaded = true;
+    document->frame_chunk_loads++;
+    return true;
+}
+void FlashLayer::_collect_chunk_frames() {
+    List<Ref<FlashFrame>> collected;
+    for (int i=0; i<chunks.size(); i++) {
+        const List<Ref<FlashFrame>> &chunk_frames = chunks[i].frames;
+        for (const List<Ref<FlashFrame>>::Element *F = chunk_frames.front(); F; F = F->next()) {
+            collected.push_back(F->get());
+        }
+    }
+    if (frames_lock != NULL) frames_lock->write_lock();
+    frames = collected;
+    if (frames_lock != NULL) frames_lock->write_unlock();
+}
+// Keyframe at `p_frame_idx` and the one after it, or the first keyframe
+// if there is none yet. Found frames are held by reference, so chunked
+// layers only need the list locked while it is walked.
+void FlashLayer::_find_frames(int p_frame_idx, Ref<FlashFrame> &r_current, Ref<FlashFrame> &r_next) const {
+    if (frames_lock != NULL) frames_lock->read_lock();
+    for (const List<Ref<FlashFrame>>::Element *E = frames.front(); E; E = E->next()) {
+        if (E->get()->get_index() > p_frame_idx) {
+            if (r_current.is_null()) r_next = E->get();
+            break;
+        }
+        r_current = E->get();
+        r_next = E->next() ? E->next()->get() : Ref<FlashFrame>();
+    }
+    if (frames_lock != NULL) frames_lock->read_unlock();
+}
+// Loads chunks overlapping frames window (wrapped by layer duration as in
+// `animation_process`) and the one after playhead chunk, where tween of its
+// last keyframe ends. Chunks nobody asked for since previous tick are
+// dropped, so players of the same document share loaded chunks. Must
+// not run while document is evaluated, player calls it beforehand.
+bool FlashLayer::stream(float p_from, float p_to, uint64_t p_tick) {
+    if (chunks.size() == 0) return false;
+    float from = p_from;
+    while (duration > 0 && from > duration) from -= duration;
+    float to = from + MAX(p_to - p_from, 0.0f);
+    // window running past layer end continues from its start
+    float wrapped = duration > 0 && to > duration ? to - duration : -1;
+    int frame_idx = static_cast<int>(floor(from));
+    int current = 0;
+    while (current + 1 < chunks.size() && chunks[current + 1].start <= frame_idx) current++;
+
+    bool changed = false;
+    for (int i=0; i<chunks.size(); i++) {
+        FlashFrameChunk &chunk = chunks.write[i];
+        bool needed = i == current || i == current + 1 || (chunk.start <= to && chunk.end > from) || chunk.start <= wrapped;
+        if (needed) {
+            chunk.used_tick = p_tick;
+            if (chunk.loaded) continue;
+            // playhead chunk wasn't loaded ahead: seek, or first frame played
+            if (i == current) document->frame_chunk_seeks++;
+            if (_load_chunk(chunk)) changed = true;
+        } else if (chunk.loaded && chunk.used_tick + 1 < p_tick) {
+            chunk.frames.clear();
+            chunk.loaded = false;
+            document->frame_chunk_evictions++;
+            changed = true;
+        }
+    }
+    if (changed) _collect_chunk_frames();
+    return changed;
+}
+void FlashLayer::load_all_chunks() {
+    bool changed = false;
+    for (int i=0; i<chunks.size(); i++) {
+        FlashFrameChunk &chunk = chunks.write[i];
+        if (!chunk.loaded && _load_chunk(chunk)) changed = true;
+    }
+    if (changed) _collect_chunk_frames();
+}
+void FlashLayer::animation_process(FlashEvaluator* node, float time, float delta, Transform2D parent_transform, FlashColorEffect parent_effect) const {
+    if (type == TYPE_GUIDE || type == TYPE_FOLDER) return;
+    if (type == TYPE_MASK) node->mask_begin(get_eid());
+    if (flags & FLAG_MASKED) node->clip_begin(mask_id);
 
     float frame_time = time;
     while (duration > 0 && frame_time > duration) frame_time -= duration;
@@ -599,55 +1347,50 @@ void FlashLayer::animation_process(FlashPlayer* node, float time, float delta, T
 
     Ref<FlashFrame> current;
     Ref<FlashFrame> next;
-    for (List<Ref<FlashFrame>>::Element *E = frames.front(); E; E = E->next()) {
-        if (E->get()->get_index() > frame_idx) {
-            break;
-        }
-        current = E->get();
-        if (E->next()) next = E->next()->get();
-    }
+    _find_frames(frame_idx, current, next);
 
     if (!current.is_valid()) return;
 
     float interpolation = 0;
     float current_time = frame_time - current->get_index();
-    if (current->tweens.size() > 0){
+    if (current->flags & FLAG_HAS_TWEEN){
         Ref<FlashTween>tween = current->tweens.front()->get();
         interpolation = tween->interpolate(current_time/current->get_duration());
     }
 
-    int idx = 0;
-    for (List<Ref<FlashDrawing>>::Element *E = current->elements.front(); E; E = E->next()) {
-        Ref<FlashDrawing> elem = E->get();
-        Transform2D tr = elem->get_transform();
+    // drawings are paired with next keyframe by top level index,
+    // group members are skipped by stride
+    const Vector<FlashDrawingData> &drawings = current->drawings;
+    int next_idx = 0;
+    for (int i=0; i<drawings.size(); i+=drawings[i].get_stride()) {
+        const FlashDrawingData &elem = drawings[i];
+        Transform2D tr = elem.transform;
         FlashColorEffect effect = current->color_effect;
-        FlashInstance *inst = Object::cast_to<FlashInstance>(elem.ptr());
-        if (inst != NULL) {
-            effect = inst->color_effect * effect;
+        if (elem.flags & FLAG_HAS_COLOR_EFFECT) {
+            effect = elem.color_effect * effect;
         }
         FlashColorEffect next_effect = effect;
 
-        if (next.is_valid() && next->elements.size() >= idx+1) {
-            Ref<FlashDrawing> next_elem = next->elements[idx];
-            Transform2D to = next_elem->get_transform();
+        if (next.is_valid() && next_idx < next->drawings.size()) {
+            const FlashDrawingData &next_elem = next->drawings[next_idx];
+            Transform2D to = next_elem.transform;
             Vector2 x = tr[0].linear_interpolate(to[0], interpolation);
             Vector2 y = tr[1].linear_interpolate(to[1], interpolation);
             Vector2 o = tr[2].linear_interpolate(to[2], interpolation);
             tr = Transform2D(x.x, x.y, y.x, y.y, o.x, o.y);
-            FlashInstance *next_inst = Object::cast_to<FlashInstance>(next_elem.ptr());
             next_effect = next->color_effect;
-            if (next_inst != NULL) {
-                next_effect = next_inst->color_effect*next_effect;
+            if (next_elem.flags & FLAG_HAS_COLOR_EFFECT) {
+                next_effect = next_elem.color_effect*next_effect;
             }
+            next_idx += next_elem.get_stride();
         }
         effect = effect.interpolate(next_effect, interpolation);
 
 
-        elem->animation_process(node, frame_time - current->get_index(), delta, parent_transform * tr, effect*parent_effect);
-        idx++;
+        elem.animation_process(node, frame_time - current->get_index(), delta, parent_transform * tr, effect*parent_effect);
     }
-    if (type == "mask") node->mask_end(get_eid());
-    if (mask_id) node->clip_end(mask_id);
+    if (type == TYPE_MASK) node->mask_end(get_eid());
+    if (flags & FLAG_MASKED) node->clip_end(mask_id);
 }
 
 void FlashDrawing::_bind_methods() {
@@ -656,7 +1399,175 @@ void FlashDrawing::_bind_methods() {
 
     ADD_PROPERTY(PropertyInfo(Variant::TRANSFORM2D, "transform", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_transform", "get_transform");
 }
-void FlashDrawing::animation_process(FlashPlayer* node, float time, float delta, Transform2D tr, FlashColorEffect effect) {
+void FlashDrawing::store(Vector<FlashDrawingData> &r_drawings) const {
+    FlashDrawingData drawing;
+    drawing.eid = eid;
+    drawing.transform = transform;
+    r_drawings.push_back(drawing);
+}
+Ref<FlashDrawing> FlashDrawing::make_view(const FlashDrawingData *p_data, FlashDocument *p_document, FlashElement *p_parent) {
+    Ref<FlashDrawing> view;
+    switch (p_data->kind) {
+        case FlashDrawingData::KIND_INSTANCE: {
+            Ref<FlashInstance> instance;
+            instance.instance();
+            instance->set_first_frame(p_data->first_frame);
+            instance->set_loop(FlashDrawingData::get_loop_name(p_data->loop));
+            instance->set_timeline_token(p_data->token);
+            instance->set_cache_as_bitmap(p_data->cache_as_bitmap);
+            instance->color_effect = p_data->color_effect;
+            view = instance;
+        } break;
+        case FlashDrawingData::KIND_BITMAP: {
+            Ref<FlashBitmapInstance> bitmap;
+            bitmap.instance();
+            bitmap->set_library_item_name(p_data->token);
+            view = bitmap;
+        } break;
+        case FlashDrawingData::KIND_GROUP: {
+            Ref<FlashGroup> group;
+            group.instance();
+            Array members;
+            // members are stored right after group entry
+            for (int i=1; i<=p_data->members_count; i++) {
+                members.push_back(make_view(p_data + i, p_document, group.ptr()));
+            }
+            group->set_members(members);
+            view = group;
+        } break;
+        default: {
+            view = Ref<FlashDrawing>(memnew(FlashShape));
+        }
+    }
+    view->set_eid(p_data->eid);
+    view->set_transform(p_data->transform);
+    view->setup(p_document, p_parent);
+    return view;
+}
+
+FlashDrawingData::Loop FlashDrawingData::parse_loop(const String &p_loop) {
+    if (p_loop == "single frame") return LOOP_SINGLE_FRAME;
+    if (p_loop == "play once") return LOOP_PLAY_ONCE;
+    return LOOP_LOOP;
+}
+String FlashDrawingData::get_loop_name(int p_loop) {
+    switch (p_loop) {
+        case LOOP_SINGLE_FRAME: return "single frame";
+        case LOOP_PLAY_ONCE: return "play once";
+        default: return "loop";
+    }
+}
+float FlashDrawingData::get_instance_time(FlashEvaluator* node, float time) const {
+    float instance_time =
+        loop == LOOP_SINGLE_FRAME ? first_frame :
+        loop == LOOP_PLAY_ONCE    ? MIN(first_frame + time, timeline->get_duration()-0.001) :
+                                    first_frame + time;
+    return node->get_symbol_frame(timeline, instance_time);
+}
+void FlashDrawingData::events_process(FlashEvaluator* node, float time, float delta) const {
+    if (kind != KIND_INSTANCE || timeline == NULL) return;
+    timeline->events_process(node, get_instance_time(node, time), delta);
+}
+void FlashDrawingData::animation_process(FlashEvaluator* node, float time, float delta, const Transform2D &tr, const FlashColorEffect &effect) const {
+    switch (kind) {
+        case KIND_INSTANCE: {
+            if (timeline == NULL) return;
+            float instance_time = get_instance_time(node, time);
+            if (node->is_cached_as_bitmap(cache_as_bitmap, timeline)) {
+                if (node->cache_replay(timeline, instance_time, tr, effect)) return;
+                node->cache_begin();
+                timeline->animation_process(node, instance_time, delta);
+                node->cache_end(timeline, instance_time, tr, effect);
+                return;
+            }
+            timeline->animation_process(node, instance_time, delta, tr, effect);
+        } break;
+        case KIND_BITMAP: {
+            if (texture.is_null()) return;
+            const FlashTextureRect *tex = texture.ptr();
+            if (node->is_masking()) {
+                Transform2D scale;
+                scale.scale(tex->get_original_size()/tex->get_region().size);
+                node->mask_add(tr * scale, tex->get_region(), tex->get_index());
+                return;
+            }
+            if (node->is_recording()) {
+                node->record_bitmap(tr, effect, tex->get_original_size(), tex->get_region(), tex->get_index());
+                return;
+            }
+            // uvs are known once atlas is loaded
+            if (tex->get_uvs().size() == 0) return;
+            Vector<Vector2> points;
+            Vector2 size = tex->get_original_size();
+            points.push_back(tr.xform(Vector2()));
+            points.push_back(tr.xform(Vector2(size.x, 0)));
+            points.push_back(tr.xform(size));
+            points.push_back(tr.xform(Vector2(0, size.y)));
+            node->add_polygon(points, effect, tex->get_uvs(), tex->get_index());
+        } break;
+        case KIND_GROUP: {
+            // members are stored right after group entry
+            for (int i=1; i<=members_count; i++) {
+                this[i].animation_process(node, time, delta, tr, effect);
+            }
+        } break;
+        default: break;
+    }
+}
+float FlashDrawingData::get_next_change(FlashEvaluator* node, float time) const {
+    if (kind != KIND_INSTANCE || timeline == NULL) return Math_INF;
+    // clip tracks are advanced by player independently
+    if (node->is_symbol_driven_by_clip(timeline)) return 0;
+    if (loop == LOOP_SINGLE_FRAME || node->has_symbol_frame_override(timeline)) return Math_INF;
+    if (loop == LOOP_PLAY_ONCE) {
+        float end = timeline->get_duration() - 0.001;
+        float instance_time = first_frame + time;
+        if (instance_time >= end) return Math_INF;
+        return MIN(timeline->get_next_change(node, instance_time), end - instance_time);
+    }
+    return timeline->get_next_change(node, first_frame + time);
+}
+
+void FlashLayer::events_process(FlashEvaluator* node, float time, float delta) const {
+    if (type == TYPE_GUIDE || type == TYPE_FOLDER || (flags & FLAG_STATIC)) return;
+    float frame_time = time;
+    while (duration > 0 && frame_time > duration) frame_time -= duration;
+    int frame_idx = static_cast<int>(floor(frame_time));
+    Ref<FlashFrame> current;
+    Ref<FlashFrame> next;
+    _find_frames(frame_idx, current, next);
+    if (!current.is_valid()) return;
+    const Vector<FlashDrawingData> &drawings = current->drawings;
+    for (int i=0; i<drawings.size(); i+=drawings[i].get_stride()) {
+        drawings[i].events_process(node, frame_time - current->get_index(), delta);
+    }
+}
+
+float FlashLayer::get_next_change(FlashEvaluator* node, float time) const {
+    if (type == TYPE_GUIDE || type == TYPE_FOLDER || (flags & FLAG_STATIC)) return Math_INF;
+
+    // same frame lookup as in `animation_process`
+    float frame_time = time;
+    while (duration > 0 && frame_time > duration) frame_time -= duration;
+    int frame_idx = static_cast<int>(floor(frame_time));
+    Ref<FlashFrame> current;
+    Ref<FlashFrame> next;
+    _find_frames(frame_idx, current, next);
+    if (!current.is_valid()) return next.is_valid() ? next->get_index() - frame_time : Math_INF;
+    if ((current->flags & FLAG_HAS_TWEEN) && next.is_valid()) return 0;
+
+    float next_change = current->get_index() + current->get_duration() - frame_time;
+    if (next_change <= 0) {
+        // layer is shorter than timeline, holds last frame until wrap
+        next_change = duration > frame_time ? duration - frame_time : Math_INF;
+    }
+    float element_time = frame_time - current->get_index();
+    const Vector<FlashDrawingData> &drawings = current->drawings;
+    for (int i=0; i<drawings.size(); i+=drawings[i].get_stride()) {
+        next_change = MIN(next_change, drawings[i].get_next_change(node, element_time));
+        if (next_change <= 0) return 0;
+    }
+    return next_change;
 }
 
 void FlashFrame::_bind_methods() {
@@ -689,6 +1600,32 @@ void FlashFrame::_bind_methods() {
     ADD_PROPERTY(PropertyInfo(Variant::ARRAY, "elements", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_elements", "get_elements");
     ADD_PROPERTY(PropertyInfo(Variant::ARRAY, "tweens", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_tweens", "get_tweens");
 }
+FlashFrame::LabelType FlashFrame::parse_label_type(const String &p_label_type) {
+    if (p_label_type == "comment") return LABEL_COMMENT;
+    if (p_label_type == "anchor") return LABEL_ANCHOR;
+    return LABEL_NAME;
+}
+String FlashFrame::get_label_type_name(LabelType p_label_type) {
+    switch (p_label_type) {
+        case LABEL_COMMENT: return "comment";
+        case LABEL_ANCHOR: return "anchor";
+        default: return "name";
+    }
+}
+FlashFrame::TweenType FlashFrame::parse_tween_type(const String &p_tween_type) {
+    if (p_tween_type == "motion") return TWEEN_MOTION;
+    if (p_tween_type == "shape") return TWEEN_SHAPE;
+    if (p_tween_type == "motion object") return TWEEN_MOTION_OBJECT;
+    return TWEEN_NONE;
+}
+String FlashFrame::get_tween_type_name(TweenType p_tween_type) {
+    switch (p_tween_type) {
+        case TWEEN_MOTION: return "motion";
+        case TWEEN_SHAPE: return "shape";
+        case TWEEN_MOTION_OBJECT: return "motion object";
+        default: return "none";
+    }
+}
 PoolColorArray FlashFrame::get_color_effect() const {
     PoolColorArray effect;
     if (color_effect.is_empty()) {
@@ -710,20 +1647,47 @@ void FlashFrame::set_color_effect(PoolColorArray p_color_effect) {
         color_effect.mult = Color(1,1,1,1);
     }
 }
+// Elements are created on every call as views of `drawings`,
+// changing them has no effect until passed to `set_elements`.
 Array FlashFrame::get_elements() {
     Array l;
-    for (List<Ref<FlashDrawing>>::Element *E = elements.front(); E; E = E->next()) {
-        l.push_back(E->get());
+    for (int i=0; i<drawings.size(); i+=drawings[i].get_stride()) {
+        l.push_back(FlashDrawing::make_view(&drawings[i], document, this));
     }
     return l;
 }
 void FlashFrame::set_elements(Array p_elements) {
-    elements.clear();
+    List<Ref<FlashDrawing>> elements;
     for (int i=0; i<p_elements.size(); i++) {
         Ref<FlashDrawing> element = p_elements[i];
         if (element.is_valid())
             elements.push_back(element);
     }
+    _store_elements(elements);
+}
+void FlashFrame::_store_elements(const List<Ref<FlashDrawing>> &p_elements) {
+    drawings.clear();
+    for (const List<Ref<FlashDrawing>>::Element *E = p_elements.front(); E; E = E->next()) {
+        if (E->get().is_valid())
+            E->get()->store(drawings);
+    }
+    if (document != NULL) resolve();
+}
+void FlashFrame::resolve() {
+    flags = 0;
+    if (tweens.size() > 0) flags |= FLAG_HAS_TWEEN;
+    if (!color_effect.is_empty()) flags |= FLAG_HAS_COLOR_EFFECT;
+    Dictionary bitmaps = document->get_bitmaps();
+    for (int i=0; i<drawings.size(); i++) {
+        FlashDrawingData &drawing = drawings.write[i];
+        drawing.flags = 0;
+        if (drawing.kind == FlashDrawingData::KIND_INSTANCE) {
+            drawing.timeline = document->get_timeline(drawing.token);
+            if (!drawing.color_effect.is_empty()) drawing.flags |= FLAG_HAS_COLOR_EFFECT;
+        } else if (drawing.kind == FlashDrawingData::KIND_BITMAP) {
+            drawing.texture = bitmaps.has(drawing.token) ? document->get_bitmap_rect(drawing.token) : Ref<FlashTextureRect>();
+        }
+    }
 }
 Array FlashFrame::get_tweens() {
     Array l;
@@ -743,9 +1707,6 @@ void FlashFrame::set_tweens(Array p_tweens) {
 }
 void FlashFrame::setup(FlashDocument *p_document, FlashElement *p_parent) {
     FlashElement::setup(p_document, p_parent);
-    for (List<Ref<FlashDrawing>>::Element *E = elements.front(); E; E = E->next()) {
-        E->get()->setup(document, this);
-    }
     for (List<Ref<FlashTween>>::Element *E = tweens.front(); E; E = E->next()) {
         E->get()->setup(document, this);
     }
@@ -754,14 +1715,11 @@ Error FlashFrame::parse(Ref<XMLParser> xml) {
     if (xml->has_attribute("index")) index = xml->get_attribute_value_safe("index").to_int();
     if (xml->has_attribute("duration")) duration = xml->get_attribute_value_safe("duration").to_int();
     if (xml->has_attribute("keymode")) keymode = xml->get_attribute_value_safe("keymode");
-    if (xml->has_attribute("tweenType")) tween_type = xml->get_attribute_value_safe("tweenType");
+    if (xml->has_attribute("tweenType")) tween_type = parse_tween_type(xml->get_attribute_value_safe("tweenType"));
     if (xml->has_attribute("name")) frame_name = xml->get_attribute_value_safe("name").strip_edges(true, true);
-    if (xml->has_attribute("labelType")) {
-        label_type = xml->get_attribute_value_safe("labelType");
-    } else {
-        label_type = "name";
-    }
+    if (xml->has_attribute("labelType")) label_type = parse_label_type(xml->get_attribute_value_safe("labelType"));
     if (xml->is_empty()) return Error::OK;
+    List<Ref<FlashDrawing>> elements;
     while (xml->read() == Error::OK) {
         if (xml->get_node_type() == XMLParser::NODE_TEXT) continue;
         if (xml->get_node_name() == "DOMFrame" && (xml->get_node_type() == XMLParser::NODE_ELEMENT_END || xml->is_empty()))
@@ -780,7 +1738,8 @@ Error FlashFrame::parse(Ref<XMLParser> xml) {
             color_effect = parse_color_effect(xml);
 
     }
-    if (tween_type == "motion" && tweens.size() == 0){
+    _store_elements(elements);
+    if (tween_type == TWEEN_MOTION && tweens.size() == 0){
         Ref<FlashTween> linear = document->element<FlashTween>(this);
         tweens.push_back(linear);
     }
@@ -854,6 +1813,18 @@ void FlashGroup::setup(FlashDocument *p_document, FlashElement *p_parent) {
         E->get()->setup(document, this);
     }
 }
+void FlashGroup::store(Vector<FlashDrawingData> &r_drawings) const {
+    List<Ref<FlashDrawing>> flattened = all_members();
+    FlashDrawingData drawing;
+    drawing.kind = FlashDrawingData::KIND_GROUP;
+    drawing.eid = eid;
+    drawing.transform = transform;
+    drawing.members_count = flattened.size();
+    r_drawings.push_back(drawing);
+    for (const List<Ref<FlashDrawing>>::Element *E = flattened.front(); E; E = E->next()) {
+        E->get()->store(r_drawings);
+    }
+}
 Error FlashGroup::parse(Ref<XMLParser> xml) {
     if (xml->is_empty()) return Error::OK;
     while (xml->read() == Error::OK){
@@ -871,12 +1842,6 @@ Error FlashGroup::parse(Ref<XMLParser> xml) {
     }
     return Error::OK;
 }
-void FlashGroup::animation_process(FlashPlayer* node, float time, float delta, Transform2D tr, FlashColorEffect effect) {
-    List<Ref<FlashDrawing>> ms = all_members();
-    for (List<Ref<FlashDrawing>>::Element *E = ms.front(); E; E = E->next()) {
-        E->get()->animation_process(node, time, delta, tr, effect);
-    }
-}
 
 void FlashInstance::_bind_methods() {
     ClassDB::bind_method(D_METHOD("get_first_frame"), &FlashInstance::get_first_frame);
@@ -887,20 +1852,33 @@ void FlashInstance::_bind_methods() {
     ClassDB::bind_method(D_METHOD("set_color_effect", "color_effect"), &FlashInstance::set_color_effect);
     ClassDB::bind_method(D_METHOD("get_timeline_token"), &FlashInstance::get_timeline_token);
     ClassDB::bind_method(D_METHOD("set_timeline_token", "timeline_token"), &FlashInstance::set_timeline_token);
+    ClassDB::bind_method(D_METHOD("is_cache_as_bitmap"), &FlashInstance::is_cache_as_bitmap);
+    ClassDB::bind_method(D_METHOD("set_cache_as_bitmap", "cache_as_bitmap"), &FlashInstance::set_cache_as_bitmap);
 
     ADD_PROPERTY(PropertyInfo(Variant::INT, "first_frame", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_first_frame", "get_first_frame");
     ADD_PROPERTY(PropertyInfo(Variant::STRING, "loop", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_loop", "get_loop");
     ADD_PROPERTY(PropertyInfo(Variant::POOL_COLOR_ARRAY, "color_effect", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_color_effect", "get_color_effect");
     ADD_PROPERTY(PropertyInfo(Variant::STRING, "timeline_token", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_timeline_token", "get_timeline_token");
-}
-void FlashInstance::setup(FlashDocument *p_document, FlashElement *p_parent) {
-    FlashDrawing::setup(p_document, p_parent);
-    layer_name = find_parent<FlashLayer>()->get_layer_name();
-}
-FlashTimeline* FlashInstance::get_timeline() {
-    if (timeline != nullptr) return timeline;
-    timeline = document->get_timeline(timeline_token);
-    return timeline;
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "cache_as_bitmap", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_cache_as_bitmap", "is_cache_as_bitmap");
+}
+String FlashInstance::get_layer_name() const {
+    FlashLayer *layer = find_parent<FlashLayer>();
+    return layer != NULL ? layer->get_layer_name() : String();
+}
+FlashTimeline* FlashInstance::get_timeline() const {
+    return document != NULL ? document->get_timeline(timeline_token) : NULL;
+}
+void FlashInstance::store(Vector<FlashDrawingData> &r_drawings) const {
+    FlashDrawingData drawing;
+    drawing.kind = FlashDrawingData::KIND_INSTANCE;
+    drawing.loop = FlashDrawingData::parse_loop(loop);
+    drawing.cache_as_bitmap = cache_as_bitmap;
+    drawing.eid = eid;
+    drawing.first_frame = first_frame;
+    drawing.transform = transform;
+    drawing.color_effect = color_effect;
+    drawing.token = timeline_token;
+    r_drawings.push_back(drawing);
 }
 PoolColorArray FlashInstance::get_color_effect() const {
     PoolColorArray effect;
@@ -928,10 +1906,8 @@ Error FlashInstance::parse(Ref<XMLParser> xml) {
         first_frame = xml->get_attribute_value_safe("firstFrame").to_int();
     if (xml->has_attribute("loop"))
         loop = xml->get_attribute_value_safe("loop");
-    if (xml->has_attribute("centerPoint3DX"))
-        center_point.x = xml->get_attribute_value_safe("centerPoint3DX").to_float();
-    if (xml->has_attribute("centerPoint3DY"))
-        center_point.y = xml->get_attribute_value_safe("centerPoint3DY").to_float();
+    if (xml->has_attribute("cacheAsBitmap"))
+        cache_as_bitmap = xml->get_attribute_value_safe("cacheAsBitmap") == "true";
     if (xml->is_empty()) return Error::OK;
     while (xml->read() == Error::OK) {
         if (xml->get_node_type() == XMLParser::NODE_TEXT) continue;
@@ -939,32 +1915,12 @@ Error FlashInstance::parse(Ref<XMLParser> xml) {
             return Error::OK;
         if (xml->get_node_name() == "Matrix")
             transform = parse_transform(xml);
-        if (xml->get_node_name() == "Point") {
-            if (xml->has_attribute("x"))
-                transformation_point.x = xml->get_attribute_value_safe("x").to_float();
-            if (xml->has_attribute("y"))
-                transformation_point.y = xml->get_attribute_value_safe("y").to_float();
-        }
         if (xml->get_node_name() == "Color") {
             color_effect = parse_color_effect(xml);
         }
     }
     return Error::OK;
 }
-void FlashInstance::animation_process(FlashPlayer* node, float time, float delta, Transform2D tr, FlashColorEffect effect) {
-    FlashTimeline* tl = get_timeline();
-    if (tl == NULL) return;
-    float instance_time =
-        loop == "single frame"  ? first_frame :
-        loop == "play once"     ? MIN(first_frame + time, tl->get_duration()-0.001) :
-                                  first_frame + time;
-
-    instance_time = node->get_symbol_frame(tl, instance_time);
-
-    tl->animation_process(node, instance_time, delta, tr, effect);
-
-}
-
 void FlashBitmapInstance::_bind_methods(){
     ClassDB::bind_method(D_METHOD("get_library_item_name"), &FlashBitmapInstance::get_library_item_name);
     ClassDB::bind_method(D_METHOD("set_library_item_name", "library_item_name"), &FlashBitmapInstance::set_library_item_name);
@@ -985,62 +1941,16 @@ Error FlashBitmapInstance::parse(Ref<XMLParser> xml) {
     return Error::OK;
 }
 
-Ref<FlashTextureRect> FlashBitmapInstance::get_texture() {
-    if (texture.is_null()) {
-        texture = document->get_bitmap_rect(library_item_name);
-    }
-    return texture;
+Ref<FlashTextureRect> FlashBitmapInstance::get_texture() const {
+    return document != NULL ? document->get_bitmap_rect(library_item_name) : Ref<FlashTextureRect>();
 }
-
-void FlashBitmapInstance::animation_process(FlashPlayer* node, float time, float delta, Transform2D tr, FlashColorEffect effect) {
-    Ref<FlashTextureRect> tex = get_texture();
-    if (!tex.is_valid()) {
-        return;
-    }
-    if (node->is_masking()) {
-        Transform2D scale;
-        scale.scale(tex->get_original_size()/tex->get_region().size);
-        node->mask_add(tr * scale, tex->get_region(), tex->get_index());
-        return;
-    }
-    // if (node->is_masking()) {
-    //     FlashClippingItem item;
-    //     item.transform = tr;
-    //     item.texture = document->load_bitmap(timeline_token);
-    //     node->add_clipping_item(item);
-    //     return;
-    // }
-
-    //node->draw_set_transform_matrix(tr);
-    Vector<Color> colors;
-    Color color = effect.mult * 0.5;
-    color.r += floor(effect.add.r * 255);
-    color.g += floor(effect.add.g * 255);
-    color.b += floor(effect.add.b * 255);
-    color.a += floor(effect.add.a * 255);
-    colors.push_back(color);
-    colors.push_back(color);
-    colors.push_back(color);
-    colors.push_back(color);
-    Vector<Vector2> points;
-    Vector2 size = tex->get_original_size();
-    points.push_back(tr.xform(Vector2()));
-    points.push_back(tr.xform(Vector2(size.x, 0)));
-    points.push_back(tr.xform(size));
-    points.push_back(tr.xform(Vector2(0, size.y)));
-
-    if (uvs.size()  == 0) {
-        Vector2 as = document->get_atlas_size();
-        Rect2 r = tex->get_region();
-        Vector2 start = r.position / as;
-        Vector2 end = (r.position + r.size) / as;
-        uvs.push_back(start);
-        uvs.push_back(Vector2(end.x, start.y));
-        uvs.push_back(end);
-        uvs.push_back(Vector2(start.x, end.y));
-    }
-
-    node->add_polygon(points, colors, uvs, tex->get_index());
+void FlashBitmapInstance::store(Vector<FlashDrawingData> &r_drawings) const {
+    FlashDrawingData drawing;
+    drawing.kind = FlashDrawingData::KIND_BITMAP;
+    drawing.eid = eid;
+    drawing.transform = transform;
+    drawing.token = library_item_name;
+    r_drawings.push_back(drawing);
 }
 
 void FlashTween::_bind_methods() {
@@ -1174,7 +2084,7 @@ inline float __ease_out_bounce(float x) {
 }
 
 // easing calculations taken from https://easings.net/
-float FlashTween::interpolate(float time) {
+float FlashTween::interpolate(float time) const {
     switch (method) {
         case NONE: return time;
         case CLASSIC: return Math::ease(time, intensity);
@@ -1281,6 +2191,56 @@ float FlashTween::interpolate(float time) {
     }
 }
 
+void FlashBakedTrack::add_frame(const Vector<Vector2> &p_points, const Vector<Vector2> &p_uvs, const Vector<Color> &p_colors, const Vector<int> &p_indices, const Vector<real_t> &p_clipping, const PoolStringArray &p_events) {
+    for (int i=0; i<p_points.size(); i++) {
+        points.push_back(p_points[i]);
+        uvs.push_back(p_uvs[i]);
+        colors.push_back(p_colors[i]);
+    }
+    for (int i=0; i<p_indices.size(); i++) {
+        indices.push_back(p_indices[i]);
+    }
+    for (int i=0; i<p_clipping.size(); i++) {
+        clipping.push_back(p_clipping[i]);
+    }
+    vertex_offsets.push_back(points.size());
+    index_offsets.push_back(indices.size());
+    clipping_offsets.push_back(clipping.size());
+    events.push_back(p_events);
+}
+
+void FlashBakedTrack::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("get_frames_count"), &FlashBakedTrack::get_frames_count);
+    ClassDB::bind_method(D_METHOD("get_points"), &FlashBakedTrack::get_points);
+    ClassDB::bind_method(D_METHOD("set_points", "points"), &FlashBakedTrack::set_points);
+    ClassDB::bind_method(D_METHOD("get_uvs"), &FlashBakedTrack::get_uvs);
+    ClassDB::bind_method(D_METHOD("set_uvs", "uvs"), &FlashBakedTrack::set_uvs);
+    ClassDB::bind_method(D_METHOD("get_colors"), &FlashBakedTrack::get_colors);
+    ClassDB::bind_method(D_METHOD("set_colors", "colors"), &FlashBakedTrack::set_colors);
+    ClassDB::bind_method(D_METHOD("get_indices"), &FlashBakedTrack::get_indices);
+    ClassDB::bind_method(D_METHOD("set_indices", "indices"), &FlashBakedTrack::set_indices);
+    ClassDB::bind_method(D_METHOD("get_vertex_offsets"), &FlashBakedTrack::get_vertex_offsets);
+    ClassDB::bind_method(D_METHOD("set_vertex_offsets", "offsets"), &FlashBakedTrack::set_vertex_offsets);
+    ClassDB::bind_method(D_METHOD("get_index_offsets"), &FlashBakedTrack::get_index_offsets);
+    ClassDB::bind_method(D_METHOD("set_index_offsets", "offsets"), &FlashBakedTrack::set_index_offsets);
+    ClassDB::bind_method(D_METHOD("get_clipping"), &FlashBakedTrack::get_clipping);
+    ClassDB::bind_method(D_METHOD("set_clipping", "clipping"), &FlashBakedTrack::set_clipping);
+    ClassDB::bind_method(D_METHOD("get_clipping_offsets"), &FlashBakedTrack::get_clipping_offsets);
+    ClassDB::bind_method(D_METHOD("set_clipping_offsets", "offsets"), &FlashBakedTrack::set_clipping_offsets);
+    ClassDB::bind_method(D_METHOD("get_events"), &FlashBakedTrack::get_events);
+    ClassDB::bind_method(D_METHOD("set_events", "events"), &FlashBakedTrack::set_events);
+
+    ADD_PROPERTY(PropertyInfo(Variant::POOL_VECTOR2_ARRAY, "points", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_points", "get_points");
+    ADD_PROPERTY(PropertyInfo(Variant::POOL_VECTOR2_ARRAY, "uvs", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_uvs", "get_uvs");
+    ADD_PROPERTY(PropertyInfo(Variant::POOL_COLOR_ARRAY, "colors", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_colors", "get_colors");
+    ADD_PROPERTY(PropertyInfo(Variant::POOL_INT_ARRAY, "indices", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_indices", "get_indices");
+    ADD_PROPERTY(PropertyInfo(Variant::POOL_INT_ARRAY, "vertex_offsets", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_vertex_offsets", "get_vertex_offsets");
+    ADD_PROPERTY(PropertyInfo(Variant::POOL_INT_ARRAY, "index_offsets", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_index_offsets", "get_index_offsets");
+    ADD_PROPERTY(PropertyInfo(Variant::POOL_REAL_ARRAY, "clipping", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_clipping", "get_clipping");
+    ADD_PROPERTY(PropertyInfo(Variant::POOL_INT_ARRAY, "clipping_offsets", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_clipping_offsets", "get_clipping_offsets");
+    ADD_PROPERTY(PropertyInfo(Variant::ARRAY, "events", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NOEDITOR | PROPERTY_USAGE_INTERNAL), "set_events", "get_events");
+}
+
 void FlashTextureRect::_bind_methods() {
 
 	ClassDB::bind_method(D_METHOD("set_index", "index"), &FlashTextureRect::set_index);
@@ -1298,8 +2258,125 @@ void FlashTextureRect::_bind_methods() {
     ADD_PROPERTY(PropertyInfo(Variant::VECTOR2, "original_size"), "set_original_size", "get_original_size");
 }
 
+// uvs are shared by every bitmap instance drawing this rect
+void FlashTextureRect::update_uvs(const Vector2 &p_atlas_size) {
+    uvs.clear();
+    if (p_atlas_size.x == 0 || p_atlas_size.y == 0) return;
+    Vector2 start = region.position / p_atlas_size;
+    Vector2 end = (region.position + region.size) / p_atlas_size;
+    uvs.push_back(start);
+    uvs.push_back(Vector2(end.x, start.y));
+    uvs.push_back(end);
+    uvs.push_back(Vector2(start.x, end.y));
+}
+
+const char *ResourceFormatLoaderFlashTexture::MAGIC = "FTEX";
+
 RES ResourceFormatLoaderFlashTexture::load(const String &p_path, const String &p_original_path, Error *r_error) {
-	FileAccess *f = FileAccess::open(p_path, FileAccess::READ);
+    Error err;
+    FileAccess *f = FileAccess::open(p_path, FileAccess::READ, &err);
+    if (f == NULL) {
+        if (r_error) *r_error = ERR_CANT_OPEN;
+        ERR_FAIL_V_MSG(RES(), "Can't open " + p_path);
+    }
+    FlashTextureHeader header;
+    err = read_header(f, header);
+    RES texture;
+    if (err == OK) {
+        texture = _load_chunked(f, header, r_error);
+    } else if (err == ERR_FILE_UNRECOGNIZED) {
+        texture = _load_legacy(f, r_error);
+    } else if (r_error) {
+        *r_error = err;
+    }
+    memdelete(f);
+    ERR_FAIL_COND_V_MSG(texture.is_null(), RES(), "Can't load flash texture " + p_path);
+    return texture;
+}
+
+Error ResourceFormatLoaderFlashTexture::read_header(FileAccess *f, FlashTextureHeader &r_header) {
+    uint8_t magic[4] = {};
+    f->get_buffer(magic, 4);
+    if (memcmp(magic, MAGIC, 4) != 0) {
+        f->seek(0);
+        return ERR_FILE_UNRECOGNIZED;
+    }
+    uint32_t version = f->get_32();
+    ERR_FAIL_COND_V_MSG(version != FTEX_VERSION, ERR_FILE_CORRUPT, "Unsupported flash texture version " + itos(version));
+    int width = f->get_32();
+    int height = f->get_32();
+    int layers = f->get_32();
+    uint32_t format = f->get_32();
+    r_header.flags = f->get_32();
+    r_header.mipmaps = f->get_32();
+    ERR_FAIL_COND_V(width < 0 || height < 0 || layers < 0 || format >= Image::FORMAT_MAX, ERR_FILE_CORRUPT);
+    ERR_FAIL_COND_V(uint64_t(layers) * 16 > f->get_len() - f->get_position(), ERR_FILE_CORRUPT);
+    r_header.width = width;
+    r_header.height = height;
+    r_header.format = (Image::Format)format;
+
+    r_header.chunks.resize(layers);
+    for (int i=0; i<layers; i++) {
+        FlashTextureHeader::Chunk &chunk = r_header.chunks.write[i];
+        chunk.offset = f->get_32();
+        chunk.stored_size = f->get_32();
+        chunk.size = f->get_32();
+        chunk.compression = f->get_32();
+    }
+    return OK;
+}
+
+Ref<Image> ResourceFormatLoaderFlashTexture::read_layer(FileAccess *f, const FlashTextureHeader &p_header, int p_layer) {
+    ERR_FAIL_INDEX_V(p_layer, p_header.chunks.size(), Ref<Image>());
+    const FlashTextureHeader::Chunk &chunk = p_header.chunks[p_layer];
+    ERR_FAIL_COND_V(chunk.size != p_header.get_layer_size(), Ref<Image>());
+    ERR_FAIL_COND_V(uint64_t(chunk.offset) + chunk.stored_size > f->get_len(), Ref<Image>());
+    PoolVector<uint8_t> data;
+    data.resize(chunk.size);
+    f->seek(chunk.offset);
+    if (chunk.compression == CHUNK_RAW) {
+        ERR_FAIL_COND_V(chunk.stored_size != chunk.size, Ref<Image>());
+        PoolVector<uint8_t>::Write w = data.write();
+        ERR_FAIL_COND_V(f->get_buffer(w.ptr(), chunk.size) != int(chunk.size), Ref<Image>());
+    } else {
+        ERR_FAIL_COND_V(chunk.compression != CHUNK_FASTLZ && chunk.compression != CHUNK_ZSTD, Ref<Image>());
+        Compression::Mode mode = chunk.compression == CHUNK_ZSTD ? Compression::MODE_ZSTD : Compression::MODE_FASTLZ;
+        PoolVector<uint8_t> stored;
+        stored.resize(chunk.stored_size);
+        {
+            PoolVector<uint8_t>::Write w = stored.write();
+            ERR_FAIL_COND_V(f->get_buffer(w.ptr(), chunk.stored_size) != int(chunk.stored_size), Ref<Image>());
+        }
+        int decompressed = Compression::decompress(data.write().ptr(), chunk.size, stored.read().ptr(), chunk.stored_size, mode);
+        ERR_FAIL_COND_V(decompressed != int(chunk.size), Ref<Image>());
+    }
+    Ref<Image> image;
+    image.instance();
+    image->create(p_header.width, p_header.height, p_header.mipmaps, p_header.format, data);
+    return image;
+}
+
+RES ResourceFormatLoaderFlashTexture::_load_chunked(FileAccess *f, const FlashTextureHeader &p_header, Error *r_error) {
+    if (r_error) *r_error = ERR_FILE_CORRUPT;
+    int layers = p_header.chunks.size();
+    Ref<TextureArray> texture;
+    texture.instance();
+    // documents without bitmaps get an empty atlas, it can't be created
+    if (layers == 0 || p_header.width == 0 || p_header.height == 0) {
+        if (r_error) *r_error = OK;
+        return texture;
+    }
+    texture->create(p_header.width, p_header.height, layers, p_header.format, p_header.flags);
+    for (int i=0; i<layers; i++) {
+        Ref<Image> image = read_layer(f, p_header, i);
+        ERR_FAIL_COND_V(image.is_null(), RES());
+        texture->set_layer_data(image, i);
+    }
+    if (r_error) *r_error = OK;
+    return texture;
+}
+
+RES ResourceFormatLoaderFlashTexture::_load_legacy(FileAccess *f, Error *r_error) {
     int decompressed_size = f->get_32();
     int bytes;
     PoolVector<uint8_t> buff;
@@ -1320,13 +2397,17 @@ RES ResourceFormatLoaderFlashTexture::load(const String &p_path, const String &p
     Array images = texture_info["images"];
     Ref<TextureArray> texture;
     texture.instance();
+    if (images.size() == 0) {
+        if (r_error) *r_error = OK;
+        return texture;
+    }
     texture->create((int)texture_info["width"], (int)texture_info["height"], images.size(), (Image::Format)(int)texture_info["format"], (int)texture_info["flags"]);
 
     for (int i=0; i<images.size(); i++){
         Ref<Image> img = images[i];
         texture->set_layer_data(img, i);
     }
-    memdelete(f);
+    if (r_error) *r_error = OK;
     return texture;
 }
 
@@ -1340,4 +2421,49 @@ String ResourceFormatLoaderFlashTexture::get_resource_type(const String &p_path)
 	if (p_path.get_extension().to_lower() == "ftex")
 		return "TextureArray";
 	return "";
-}
\ No newline at end of file
+}
+
+void FlashSkinPreset::set_variants(const Dictionary &p_variants) {
+    variants = p_variants;
+    overrides_dirty = true;
+}
+String FlashSkinPreset::get_variant(const String &p_variant) const {
+    return variants.get(p_variant, "[default]");
+}
+void FlashSkinPreset::set_variant(const String &p_variant, const String &p_value) {
+    if (p_value == String() || p_value == "[default]") {
+        variants.erase(p_variant);
+    } else {
+        variants[p_variant] = p_value;
+    }
+    overrides_dirty = true;
+}
+// Overrides are compiled for the last document used, and compiled
+// again once preset or variants of that document change.
+const Vector<int> &FlashSkinPreset::get_frame_overrides(FlashDocument *p_document) {
+    if (compiled_document != p_document->get_instance_id()) {
+        Object *prev = ObjectDB::get_instance(compiled_document);
+        if (prev != NULL && prev->is_connected("changed", this, "_invalidate_overrides")) {
+            prev->disconnect("changed", this, "_invalidate_overrides");
+        }
+        if (!p_document->is_connected("changed", this, "_invalidate_overrides")) {
+            p_document->connect("changed", this, "_invalidate_overrides");
+        }
+        compiled_document = p_document->get_instance_id();
+        overrides_dirty = true;
+    }
+    if (overrides_dirty) {
+        p_document->compile_variants(variants, compiled_overrides);
+        overrides_dirty = false;
+    }
+    return compiled_overrides;
+}
+void FlashSkinPreset::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("get_variants"), &FlashSkinPreset::get_variants);
+    ClassDB::bind_method(D_METHOD("set_variants", "variants"), &FlashSkinPreset::set_variants);
+    ClassDB::bind_method(D_METHOD("get_variant", "variant"), &FlashSkinPreset::get_variant);
+    ClassDB::bind_method(D_METHOD("set_variant", "variant", "value"), &FlashSkinPreset::set_variant);
+    ClassDB::bind_method(D_METHOD("_invalidate_overrides"), &FlashSkinPreset::_invalidate_overrides);
+
+    ADD_PROPERTY(PropertyInfo(Variant::DICTIONARY, "variants"), "set_variants", "get_variants");
+}
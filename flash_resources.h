@@ -25,12 +25,18 @@
 
 #include <core/resource.h>
 #include <core/io/xml_parser.h>
+#include <core/os/rw_lock.h>
 #include <scene/resources/texture.h>
 #include <scene/resources/material.h>
 
 #include "flash_player.h"
+#include "flash_residency.h"
 
 class FlashPlayer;
+class FileAccess;
+class FlashEvaluator;
+struct FlashPlayerState;
+struct FlashOutputBuffers;
 class FlashDocument;
 class FlashTimeline;
 class FlashLayer;
@@ -45,14 +51,14 @@ struct FlashColorEffect {
         add(Color(0,0,0,0)),
         mult(Color(1,1,1,1)) {}
 
-    inline FlashColorEffect interpolate(FlashColorEffect effect, float amount) {
+    inline FlashColorEffect interpolate(FlashColorEffect effect, float amount) const {
         FlashColorEffect new_effect;
         new_effect.mult = mult.linear_interpolate(effect.mult, amount);
         new_effect.add = add.linear_interpolate(effect.add, amount);
         return new_effect;
     }
 
-    inline FlashColorEffect operator *(FlashColorEffect effect) {
+    inline FlashColorEffect operator *(FlashColorEffect effect) const {
         FlashColorEffect new_effect;
         new_effect.mult = mult * effect.mult;
         new_effect.add = add * effect.mult + effect.add;
@@ -64,6 +70,55 @@ struct FlashColorEffect {
     }
 };
 
+// clips sharing the same clips header (layer name), addressed by dense ids
+struct FlashClipTrack {
+    String name;
+    PoolStringArray clips;
+    Vector<Vector2> ranges;
+};
+
+// symbol of `.fdoc` kept serialized until first use, see `FlashDocument::get_symbol`
+struct FlashSymbolBlob {
+    uint32_t offset;
+    uint32_t size;
+    int symbol_id;
+    int variation_idx;
+    String local_path;
+
+    FlashSymbolBlob():
+        offset(0),
+        size(0),
+        symbol_id(-1),
+        variation_idx(-1) {}
+};
+
+// frame range of long layer of `.fdoc` kept serialized until playhead
+// comes close, see `FlashLayer::stream`
+struct FlashFrameChunk {
+    int start;
+    int end;
+    uint32_t offset;
+    uint32_t size;
+    // what chunk frames refer to, so subtree walks don't need them loaded
+    bool has_tweens;
+    bool has_cached;
+    Vector<String> symbols;
+    Vector<String> bitmaps;
+    bool loaded;
+    uint64_t used_tick;
+    List<Ref<FlashFrame>> frames;
+
+    FlashFrameChunk():
+        start(0),
+        end(0),
+        offset(0),
+        size(0),
+        has_tweens(false),
+        has_cached(false),
+        loaded(false),
+        used_tick(0) {}
+};
+
 class FlashElement: public Resource {
     GDCLASS(FlashElement, Resource);
 
@@ -71,14 +126,30 @@ protected:
     FlashDocument *document;
     FlashElement *parent;
     int eid;
+    int flags;
 
 public:
+    // derived from element data on resolve, never serialized
+    enum Flags {
+        FLAG_HAS_TWEEN = 1,
+        FLAG_HAS_COLOR_EFFECT = 2,
+        FLAG_MASKED = 4,
+        FLAG_STATIC = 8
+    };
+
+    FlashElement():
+        document(NULL),
+        parent(NULL),
+        eid(0),
+        flags(0) {}
+
     FlashDocument *get_document() const;
     void set_document(FlashDocument *p_document);
     FlashElement *get_parent() const;
     void set_parent(FlashElement *parent);
     int get_eid() const { return eid; }
     void set_eid(int p_eid) { eid = p_eid; }
+    int get_flags() const { return flags; }
     template <class T> T* find_parent() const;
 
     static void _bind_methods();
@@ -103,6 +174,7 @@ class FlashTextureRect: public Resource {
     Rect2 region;
     Rect2 margin;
     Vector2 original_size;
+    Vector<Vector2> uvs;
 
     static void _bind_methods();
 
@@ -121,10 +193,93 @@ public:
 	Rect2 get_margin() const { return margin; }
     void set_original_size(const Vector2 &p_original_size) { original_size = p_original_size; }
 	Vector2 get_original_size() const { return original_size; }
+    const Vector<Vector2> &get_uvs() const { return uvs; }
+    void update_uvs(const Vector2 &p_atlas_size);
+};
+
+// Pre-evaluated geometry of symbol, one entry per integer frame.
+// Vertex data is stored in final (player-ready) encoding, indices
+// are local to frame, every clipping item takes 11 reals
+// (transform, region, texture index).
+class FlashBakedTrack: public Resource {
+    GDCLASS(FlashBakedTrack, Resource);
+
+    PoolVector2Array points;
+    PoolVector2Array uvs;
+    PoolColorArray colors;
+    PoolIntArray indices;
+    PoolIntArray vertex_offsets;
+    PoolIntArray index_offsets;
+    PoolRealArray clipping;
+    PoolIntArray clipping_offsets;
+    Array events;
+
+    static void _bind_methods();
+
+public:
+    enum {
+        CLIPPING_ITEM_SIZE = 11
+    };
+
+    FlashBakedTrack() {
+        vertex_offsets.push_back(0);
+        index_offsets.push_back(0);
+        clipping_offsets.push_back(0);
+    }
+
+    int get_frames_count() const { return events.size(); }
+    void add_frame(const Vector<Vector2> &p_points, const Vector<Vector2> &p_uvs, const Vector<Color> &p_colors, const Vector<int> &p_indices, const Vector<real_t> &p_clipping, const PoolStringArray &p_events);
+
+    PoolVector2Array get_points() const { return points; }
+    void set_points(const PoolVector2Array &p_points) { points = p_points; }
+    PoolVector2Array get_uvs() const { return uvs; }
+    void set_uvs(const PoolVector2Array &p_uvs) { uvs = p_uvs; }
+    PoolColorArray get_colors() const { return colors; }
+    void set_colors(const PoolColorArray &p_colors) { colors = p_colors; }
+    PoolIntArray get_indices() const { return indices; }
+    void set_indices(const PoolIntArray &p_indices) { indices = p_indices; }
+    PoolIntArray get_vertex_offsets() const { return vertex_offsets; }
+    void set_vertex_offsets(const PoolIntArray &p_offsets) { vertex_offsets = p_offsets; }
+    PoolIntArray get_index_offsets() const { return index_offsets; }
+    void set_index_offsets(const PoolIntArray &p_offsets) { index_offsets = p_offsets; }
+    PoolRealArray get_clipping() const { return clipping; }
+    void set_clipping(const PoolRealArray &p_clipping) { clipping = p_clipping; }
+    PoolIntArray get_clipping_offsets() const { return clipping_offsets; }
+    void set_clipping_offsets(const PoolIntArray &p_offsets) { clipping_offsets = p_offsets; }
+    Array get_events() const { return events; }
+    void set_events(const Array &p_events) { events = p_events; }
+};
+
+// full set of variant choices, compiled once into frame overrides
+// of the document it is applied to
+class FlashSkinPreset: public Resource {
+    GDCLASS(FlashSkinPreset, Resource);
+
+    Dictionary variants;
+    ObjectID compiled_document;
+    Vector<int> compiled_overrides;
+    bool overrides_dirty;
+
+    static void _bind_methods();
+    void _invalidate_overrides() { overrides_dirty = true; }
+
+public:
+    FlashSkinPreset():
+        compiled_document(0),
+        overrides_dirty(true) {}
+
+    Dictionary get_variants() const { return variants; }
+    void set_variants(const Dictionary &p_variants);
+    String get_variant(const String &p_variant) const;
+    void set_variant(const String &p_variant, const String &p_value);
+    const Vector<int> &get_frame_overrides(FlashDocument *p_document);
 };
 
 class FlashDocument: public FlashElement {
     GDCLASS(FlashDocument, FlashElement);
+    friend class FlashDocumentFormat;
+    friend class FlashDocumentInteractiveLoader;
+    friend class FlashLayer;
 
     String document_path;
     Dictionary symbols;
@@ -133,16 +288,58 @@ class FlashDocument: public FlashElement {
     List <Ref<FlashTimeline>> timelines;
     int last_eid;
     Ref<TextureArray> atlas;
+    Ref<FlashAtlasResidency> residency;
     Dictionary variants;
     int variated_symbols_count;
+    Dictionary import_report;
+    Dictionary baked_tracks;
+
+    // dense ids, rebuilt on setup
+    Vector<FlashClipTrack> clip_tracks;
+    HashMap<String, int> clip_track_ids;
+    PoolStringArray clip_track_names;
+    Vector<FlashTimeline*> symbols_by_id;
+
+    // symbols and frame chunks read from `.fdoc` on demand, `symbols`
+    // holds loaded ones only; uncompressed documents keep no payload
+    // and are read straight from file
+    Vector<uint8_t> payload;
+    Vector<String> payload_strings;
+    String payload_path;
+    uint64_t payload_file_offset;
+    HashMap<String, FlashSymbolBlob> symbol_blobs;
+    Vector<FlashTimeline*> loading_symbols;
+    int loading_depth;
+    uint32_t symbols_version;
+    int symbols_loads;
+    int symbols_unloads;
+
+    // layers longer than that are written as frame chunks on save
+    int frame_chunk_size;
+    int frame_chunk_loads;
+    int frame_chunk_seeks;
+    int frame_chunk_evictions;
+    int frame_chunk_failures;
 
     static String invalid_character;
 
+    FlashTimeline *_load_symbol(const String &p_token);
+
 public:
     FlashDocument():
         document_path(""),
         frame_size(1.0/24.0),
-        last_eid(0){}
+        last_eid(0),
+        payload_file_offset(0),
+        loading_depth(0),
+        symbols_version(0),
+        symbols_loads(0),
+        symbols_unloads(0),
+        frame_chunk_size(0),
+        frame_chunk_loads(0),
+        frame_chunk_seeks(0),
+        frame_chunk_evictions(0),
+        frame_chunk_failures(0){}
 
     static void _bind_methods();
 
@@ -154,7 +351,12 @@ public:
 
     Vector2 get_atlas_size() const;
     Ref<TextureArray> get_atlas() const { return atlas; }
-    void set_atlas(Ref<TextureArray> p_atlas) { atlas = p_atlas; }
+    void set_atlas(Ref<TextureArray> p_atlas);
+    Ref<FlashAtlasResidency> get_residency() const { return residency; }
+    void acquire_symbol(FlashTimeline *p_symbol);
+    void release_symbol(FlashTimeline *p_symbol);
+    void preload_symbols(const PoolStringArray &p_symbols);
+    Dictionary get_residency_stats() const;
     String get_document_path() const { return document_path; }
     Dictionary get_symbols() const { return symbols; }
     void set_symbols(Dictionary p_symbols) { symbols = p_symbols; }
@@ -168,8 +370,39 @@ public:
     Dictionary get_variants() const;
     void cache_variants();
     int get_variated_symbols_count() const { return variated_symbols_count; }
+    void compile_variants(const Dictionary &p_variants, Vector<int> &r_overrides) const;
+    void cache_clips();
+    int get_clip_tracks_count() const { return clip_tracks.size(); }
+    PoolStringArray get_clip_track_names() const { return clip_track_names; }
+    const FlashClipTrack &get_clip_track(int p_track) const { return clip_tracks[p_track]; }
+    int find_clip_track(const String &p_track) const;
+    int find_clip(int p_track, const String &p_clip) const;
+    int find_symbol(const String &p_token) const;
+    FlashTimeline *get_symbol_by_id(int p_id) const { return p_id >= 0 && p_id < symbols_by_id.size() ? symbols_by_id[p_id] : NULL; }
+    Dictionary get_import_report() const { return import_report; }
+    void set_import_report(const Dictionary &p_import_report) { import_report = p_import_report; }
+    Dictionary get_baked_tracks() const { return baked_tracks; }
+    void set_baked_tracks(const Dictionary &p_baked_tracks) { baked_tracks = p_baked_tracks; }
+    Ref<FlashBakedTrack> get_baked_track(const String &p_symbol, const String &p_variant=String(), const String &p_value=String()) const;
+    void set_baked_track(const String &p_symbol, const String &p_variant, const String &p_value, const Ref<FlashBakedTrack> &p_track);
 
     FlashTimeline* get_timeline(String token);
+    Ref<FlashTimeline> get_symbol(const String &p_token);
+    bool has_symbol(const String &p_token) const { return symbols.has(p_token) || symbol_blobs.has(p_token); }
+    bool is_symbol_loaded(const String &p_token) const { return symbols.has(p_token); }
+    int get_variation_idx(const String &p_token) const;
+    PoolStringArray get_symbol_names(bool p_top_level=false) const;
+    int load_symbols(const PoolStringArray &p_symbols);
+    void load_all_symbols();
+    int unload_symbols(const PoolStringArray &p_symbols);
+    Dictionary get_symbols_report() const;
+    // changes whenever symbols are loaded or unloaded
+    uint32_t get_symbols_version() const { return symbols_version; }
+    int get_frame_chunk_size() const { return frame_chunk_size; }
+    void set_frame_chunk_size(int p_size) { frame_chunk_size = p_size; }
+    void load_all_frames();
+    Dictionary get_streaming_stats() const;
+    Dictionary prune_unreachable(const PoolStringArray &p_roots);
     void parse_timeline(const String &path);
     Ref<FlashTextureRect> get_bitmap_rect(const String &bitmap_name);
     inline float get_frame_size() const { return frame_size; }
@@ -177,12 +410,16 @@ public:
 
     virtual void setup(FlashDocument *p_document, FlashElement *p_parent);
     virtual Error parse(Ref<XMLParser> parser);
-    void animation_process(FlashPlayer* node, float time, float delta, Transform2D tr=Transform2D(), FlashColorEffect effect=FlashColorEffect());
+    void resolve();
+    // doesn't touch atlas texture, so may run before it is uploaded
+    void resolve(const Vector2 &p_atlas_size);
+    void animation_process(FlashEvaluator* node, float time, float delta, Transform2D tr=Transform2D(), FlashColorEffect effect=FlashColorEffect()) const;
 
 };
 
 class FlashBitmapItem: public FlashElement {
     GDCLASS(FlashBitmapItem, FlashElement);
+    friend class FlashDocumentFormat;
     String name;
     String bitmap_path;
     Ref<FlashTextureRect> texture;
@@ -205,6 +442,7 @@ public:
 
 class FlashTimeline: public FlashElement {
     GDCLASS(FlashTimeline, FlashElement);
+    friend class FlashDocumentFormat;
     friend FlashDocument;
 
     String token;
@@ -217,13 +455,34 @@ class FlashTimeline: public FlashElement {
     List<Ref<FlashLayer>> layers;
     List<Ref<FlashLayer>> masks;
     int variation_idx;
+    int subtree_flags;
+    int symbol_id;
+    int clips_track_id;
+    Vector<int> atlas_layers;
+    bool atlas_layers_ready;
+
+    int _collect_subtree_flags(Set<const FlashTimeline*> &r_visited);
+    void _collect_atlas_layers(Set<const FlashTimeline*> &r_visited, Set<int> &r_layers) const;
 
 public:
+    enum SubtreeFlags {
+        SUBTREE_HAS_MASKS = 1,
+        SUBTREE_HAS_EVENTS = 2,
+        SUBTREE_HAS_TWEENS = 4,
+        SUBTREE_HAS_VARIANTS = 8,
+        SUBTREE_HAS_CLIPS = 16,
+        SUBTREE_HAS_CACHED = 32
+    };
+
     FlashTimeline():
 
         token(""),
         duration(0),
-        variation_idx(-1){}
+        variation_idx(-1),
+        subtree_flags(-1),
+        symbol_id(-1),
+        clips_track_id(-1),
+        atlas_layers_ready(false){}
 
     static void _bind_methods();
 
@@ -245,44 +504,92 @@ public:
     void set_layers(Array p_layers);
     int get_variation_idx() const { return variation_idx; }
     void set_variation_idx(int p_variation_idx) { variation_idx = p_variation_idx; }
+    int get_symbol_id() const { return symbol_id; }
+    int get_clips_track_id() const { return clips_track_id; }
+    int get_layers_count() const { return layers.size(); }
+    int get_subtree_flags() const;
+    void compute_subtree_flags();
+    // tweened subtrees change between whole frames, so never replayed
+    bool is_cacheable() const { return !(get_subtree_flags() & (SUBTREE_HAS_MASKS | SUBTREE_HAS_EVENTS | SUBTREE_HAS_TWEENS)); }
+    // sorted atlas layers used by whole subtree, computed on first use
+    const Vector<int> &get_atlas_layers();
+    // long layers of imported documents are loaded by frame chunks,
+    // `stream` has to be called before evaluating them
+    void stream(float p_from, float p_to);
+    void load_all_chunks();
 
     Ref<FlashLayer> get_layer(int idx);
-    void add_label(const String &name, const String &label_type, float start, float duration);
+    void add_label(const String &name, int label_type, float start, float duration);
     virtual void setup(FlashDocument *p_document, FlashElement *p_parent);
     virtual Error parse(Ref<XMLParser> xml);
-    void animation_process(FlashPlayer* node, float time, float delta, Transform2D tr=Transform2D(), FlashColorEffect effect=FlashColorEffect());
+    void resolve();
+    void evaluate(float p_time, const FlashPlayerState &p_state, FlashOutputBuffers &r_output, float p_delta=0.0) const;
+    void animation_process(FlashEvaluator* node, float time, float delta, Transform2D tr=Transform2D(), FlashColorEffect effect=FlashColorEffect()) const;
+    void masks_process(FlashEvaluator* node, float time, float delta, Transform2D tr=Transform2D(), FlashColorEffect effect=FlashColorEffect()) const;
+    void get_paint_order(Vector<const FlashLayer*> &r_layers) const;
+    float get_next_change(FlashEvaluator* node, float time) const;
+    void events_process(FlashEvaluator* node, float time, float delta) const;
+    void fire_events(FlashEvaluator* node, float time, float delta) const;
 };
 
 class FlashLayer: public FlashElement {
     GDCLASS(FlashLayer, FlashElement);
+    friend class FlashDocumentFormat;
     friend FlashDocument;
+    friend FlashTimeline;
     friend FlashFrame;
 
+public:
+    enum Type {
+        TYPE_NORMAL,
+        TYPE_GUIDE,
+        TYPE_GUIDED,
+        TYPE_MASK,
+        TYPE_FOLDER
+    };
+
+private:
     int index;
     String layer_name;
-    String type;
+    Type type;
     int duration;
     int mask_id;
     Color color;
+    // loaded frames only for layers streamed by chunks, their list
+    // changes under `frames_lock` while others may evaluate it
     List<Ref<FlashFrame>> frames;
+    Vector<FlashFrameChunk> chunks;
+    RWLock *frames_lock;
+
+    bool _load_chunk(FlashFrameChunk &r_chunk);
+    void _collect_chunk_frames();
+    void _find_frames(int p_frame_idx, Ref<FlashFrame> &r_current, Ref<FlashFrame> &r_next) const;
 
 public:
     FlashLayer():
         index(0),
         layer_name(""),
-        type(""),
+        type(TYPE_NORMAL),
         duration(0),
         mask_id(0),
-        color(Color()){}
+        color(Color()),
+        frames_lock(NULL){}
+    ~FlashLayer() {
+        if (frames_lock != NULL) memdelete(frames_lock);
+    }
 
     static void _bind_methods();
+    static Type parse_type(const String &p_type);
+    static String get_type_name(Type p_type);
 
     int get_index() const { return index; }
     void set_index(int p_index) { index = p_index; }
     String get_layer_name() const { return layer_name; };
     void set_layer_name(String p_name) { layer_name = p_name; }
-    String get_type() const { return type; }
-    void set_type(String p_type) { type = p_type; }
+    String get_type() const { return get_type_name(type); }
+    void set_type(String p_type) { type = parse_type(p_type); }
+    Type get_layer_type() const { return type; }
+    void set_layer_type(Type p_type) { type = p_type; }
     int get_duration() const { return duration; }
     void set_duration(int p_duration) { duration = p_duration; }
     int get_mask_id() const { return mask_id; }
@@ -292,10 +599,70 @@ public:
 
     virtual void setup(FlashDocument *p_document, FlashElement *p_parent);
     virtual Error parse(Ref<XMLParser> xml);
-    void animation_process(FlashPlayer* node, float time, float delta, Transform2D tr=Transform2D(), FlashColorEffect effect=FlashColorEffect());
+    void resolve();
+    bool is_streamed() const { return chunks.size() > 0; }
+    bool stream(float p_from, float p_to, uint64_t p_tick);
+    void load_all_chunks();
+    void animation_process(FlashEvaluator* node, float time, float delta, Transform2D tr=Transform2D(), FlashColorEffect effect=FlashColorEffect()) const;
+    float get_next_change(FlashEvaluator* node, float time) const;
+    void events_process(FlashEvaluator* node, float time, float delta) const;
 
 };
 
+// Frame drawings are stored inline as plain structs, not as one Resource
+// per element. Groups are flattened: group entry is followed by
+// `members_count` entries of its members (as `FlashGroup::all_members`).
+// FlashDrawing resources are only views, see `FlashFrame::get_elements`.
+struct FlashDrawingData {
+    enum Kind {
+        KIND_SHAPE,
+        KIND_INSTANCE,
+        KIND_BITMAP,
+        KIND_GROUP
+    };
+
+    enum Loop {
+        LOOP_LOOP,
+        LOOP_PLAY_ONCE,
+        LOOP_SINGLE_FRAME
+    };
+
+    uint8_t kind;
+    uint8_t loop;
+    uint8_t flags;
+    bool cache_as_bitmap;
+    int eid;
+    int first_frame;
+    int members_count;
+    Transform2D transform;
+    FlashColorEffect color_effect;
+    // symbol token for instances, library item name for bitmaps
+    StringName token;
+
+    // resolved by `FlashFrame::resolve`
+    FlashTimeline *timeline;
+    Ref<FlashTextureRect> texture;
+
+    FlashDrawingData():
+        kind(KIND_SHAPE),
+        loop(LOOP_LOOP),
+        flags(0),
+        cache_as_bitmap(false),
+        eid(0),
+        first_frame(0),
+        members_count(0),
+        timeline(NULL) {}
+
+    static Loop parse_loop(const String &p_loop);
+    static String get_loop_name(int p_loop);
+
+    int get_stride() const { return 1 + members_count; }
+    float get_instance_time(FlashEvaluator* node, float time) const;
+    void animation_process(FlashEvaluator* node, float time, float delta, const Transform2D &tr, const FlashColorEffect &effect) const;
+    float get_next_change(FlashEvaluator* node, float time) const;
+    void events_process(FlashEvaluator* node, float time, float delta) const;
+};
+
 class FlashDrawing: public FlashElement {
     GDCLASS(FlashDrawing, FlashElement);
 
@@ -307,35 +674,61 @@ public:
     static void _bind_methods();
     Transform2D get_transform() const { return transform; }
     void set_transform(Transform2D p_transform) { transform = p_transform; }
-    virtual void animation_process(FlashPlayer* node, float time, float delta, Transform2D tr=Transform2D(), FlashColorEffect effect=FlashColorEffect());
+
+    // conversion between resource views and frame storage
+    virtual void store(Vector<FlashDrawingData> &r_drawings) const;
+    static Ref<FlashDrawing> make_view(const FlashDrawingData *p_data, FlashDocument *p_document, FlashElement *p_parent);
 };
 
 class FlashFrame: public FlashElement {
     GDCLASS(FlashFrame, FlashElement);
+    friend class FlashDocumentFormat;
     friend FlashDocument;
+    friend FlashTimeline;
     friend FlashLayer;
 
+public:
+    enum LabelType {
+        LABEL_NAME,
+        LABEL_COMMENT,
+        LABEL_ANCHOR
+    };
+
+    enum TweenType {
+        TWEEN_NONE,
+        TWEEN_MOTION,
+        TWEEN_SHAPE,
+        TWEEN_MOTION_OBJECT
+    };
+
+private:
     int index;
     int duration;
     String frame_name;
-    String label_type;
+    LabelType label_type;
     String keymode;
-    String tween_type;
+    TweenType tween_type;
     FlashColorEffect color_effect;
 
-    List<Ref<FlashDrawing>> elements;
+    Vector<FlashDrawingData> drawings;
     List<Ref<FlashTween>> tweens;
 
+    void _store_elements(const List<Ref<FlashDrawing>> &p_elements);
+
 public:
     FlashFrame():
         index(0),
         duration(1),
         frame_name(""),
-        label_type(""),
+        label_type(LABEL_NAME),
         keymode(""),
-        tween_type("none"){}
+        tween_type(TWEEN_NONE){}
 
     static void _bind_methods();
+    static LabelType parse_label_type(const String &p_label_type);
+    static String get_label_type_name(LabelType p_label_type);
+    static TweenType parse_tween_type(const String &p_tween_type);
+    static String get_tween_type_name(TweenType p_tween_type);
 
     int get_index() const { return index; };
     void set_index(int p_index) { index = p_index; }
@@ -343,49 +736,43 @@ public:
     void set_duration(int p_duration) { duration = p_duration; }
     String get_frame_name() const { return frame_name; }
     void set_frame_name(String p_name) { frame_name = p_name; }
-    String get_label_type() const { return label_type; }
-    void set_label_type(String p_label_type) { label_type = p_label_type; }
+    String get_label_type() const { return get_label_type_name(label_type); }
+    void set_label_type(String p_label_type) { label_type = parse_label_type(p_label_type); }
+    LabelType get_frame_label_type() const { return label_type; }
     String get_keymode() const { return keymode; }
     void set_keymode(String p_keymode) { keymode = p_keymode; }
-    String get_tween_type() const { return tween_type; }
-    void set_tween_type(String p_tween_type) { tween_type = p_tween_type; }
+    String get_tween_type() const { return get_tween_type_name(tween_type); }
+    void set_tween_type(String p_tween_type) { tween_type = parse_tween_type(p_tween_type); }
+    TweenType get_frame_tween_type() const { return tween_type; }
     PoolColorArray get_color_effect() const;
     void set_color_effect(PoolColorArray p_color_effect);
     Array get_elements();
     void set_elements(Array p_elements);
+    const Vector<FlashDrawingData> &get_drawings() const { return drawings; }
     Array get_tweens();
     void set_tweens(Array p_tweens);
 
     virtual void setup(FlashDocument *p_document, FlashElement *p_parent);
     virtual Error parse(Ref<XMLParser> xml);
-    void animation_process(FlashPlayer* node, float time, float delta, Transform2D tr=Transform2D(), FlashColorEffect effect=FlashColorEffect());
-
+    void resolve();
 
 };
 
 class FlashInstance: public FlashDrawing {
     GDCLASS(FlashInstance, FlashDrawing);
 
-    Vector2 center_point;
-    Vector2 transformation_point;
     int first_frame;
     String loop;
     String timeline_token;
-    String layer_name;
-
-    FlashTimeline* timeline;
-
+    bool cache_as_bitmap;
 
 public:
     FlashColorEffect color_effect;
     FlashInstance():
-        center_point(Vector2()),
-        transformation_point(Vector2()),
         first_frame(0),
         loop("loop"),
         timeline_token(""),
-        layer_name(""),
-        timeline(nullptr),
+        cache_as_bitmap(false),
         color_effect(FlashColorEffect()){}
 
     static void _bind_methods();
@@ -398,12 +785,13 @@ public:
     void set_color_effect(PoolColorArray p_color_effect);
     String get_timeline_token() const { return timeline_token; }
     void set_timeline_token(String p_name) { timeline_token = p_name; }
-    String get_layer_name() const { return layer_name; }
+    String get_layer_name() const;
+    bool is_cache_as_bitmap() const { return cache_as_bitmap; }
+    void set_cache_as_bitmap(bool p_cache_as_bitmap) { cache_as_bitmap = p_cache_as_bitmap; }
 
-    virtual void setup(FlashDocument *p_document, FlashElement *p_parent);
-    FlashTimeline* get_timeline();
+    FlashTimeline* get_timeline() const;
     virtual Error parse(Ref<XMLParser> xml);
-    virtual void animation_process(FlashPlayer* node, float time, float delta, Transform2D tr=Transform2D(), FlashColorEffect effect=FlashColorEffect());
+    virtual void store(Vector<FlashDrawingData> &r_drawings) const;
 };
 
 class FlashShape: public FlashDrawing {
@@ -427,7 +815,7 @@ public:
     List<Ref<FlashDrawing>> all_members() const;
     virtual void setup(FlashDocument *p_document, FlashElement *p_parent);
     virtual Error parse(Ref<XMLParser> xml);
-    virtual void animation_process(FlashPlayer* node, float time, float delta, Transform2D tr=Transform2D(), FlashColorEffect effect=FlashColorEffect());
+    virtual void store(Vector<FlashDrawingData> &r_drawings) const;
 };
 
 
@@ -436,21 +824,18 @@ class FlashBitmapInstance: public FlashDrawing {
 
     String library_item_name;
 
-    Vector<Vector2> uvs;
-    Ref<FlashTextureRect> texture;
-
 public:
     FlashBitmapInstance():
         library_item_name(""){}
 
     static void _bind_methods();
 
-    Ref<FlashTextureRect> get_texture();
+    Ref<FlashTextureRect> get_texture() const;
     String get_library_item_name() const { return library_item_name; }
     void set_library_item_name(String p_library_item_name) { library_item_name = p_library_item_name; }
 
     Error parse(Ref<XMLParser> xml);
-    virtual void animation_process(FlashPlayer* node, float time, float delta, Transform2D tr=Transform2D(), FlashColorEffect effect=FlashColorEffect());
+    virtual void store(Vector<FlashDrawingData> &r_drawings) const;
 };
 
 class FlashTween: public FlashElement {
@@ -497,13 +882,40 @@ public:
 
     Error parse(Ref<XMLParser> xml);
 
-    float interpolate(float time);
+    float interpolate(float time) const;
 };
 
 VARIANT_ENUM_CAST(FlashTween::Method);
 
+// Atlas `.ftex` v2 layout: header (magic, version, width, height, layers
+// count, format, flags, mipmaps), then offset table with one entry per
+// layer (offset, stored size, data size, compression) and layer chunks
+// aligned to `FTEX_CHUNK_ALIGN`. Every layer is read (and decompressed)
+// on its own straight into the image passed to the TextureArray, so
+// peak memory is the size of one layer. Files written before v2 are
+// a single FastLZ compressed dictionary and still loadable.
 class ResourceFormatLoaderFlashTexture: public ResourceFormatLoader {
+    RES _load_chunked(FileAccess *f, const FlashTextureHeader &p_header, Error *r_error);
+    RES _load_legacy(FileAccess *f, Error *r_error);
+
 public:
+    enum {
+        FTEX_VERSION = 2,
+        FTEX_CHUNK_ALIGN = 16
+    };
+
+    enum ChunkCompression {
+        CHUNK_RAW,
+        CHUNK_FASTLZ,
+        CHUNK_ZSTD
+    };
+
+    static const char *MAGIC;
+
+    // Returns ERR_FILE_UNRECOGNIZED (with file rewound) for legacy files.
+    static Error read_header(FileAccess *f, FlashTextureHeader &r_header);
+    static Ref<Image> read_layer(FileAccess *f, const FlashTextureHeader &p_header, int p_layer);
+
     virtual RES load(const String &p_path, const String &p_original_path = "", Error *r_error = NULL);
     virtual void get_recognized_extensions(List<String> *p_extensions) const;
 	virtual bool handles_type(const String &p_type) const;
@@ -0,0 +1,338 @@
+// MIT License
+
+// Copyright (c) 2021 Yakov Borevich, Funexpected LLC
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <core/engine.h>
+#include <core/os/os.h>
+#include <core/project_settings.h>
+#include <core/safe_refcount.h>
+#include <scene/main/scene_tree.h>
+
+#include "flash_server.h"
+#include "flash_player.h"
+
+FlashServer *FlashServer::singleton = NULL;
+
+void FlashServer::queue_player(FlashPlayer *p_player) {
+    QueuedPlayer item;
+    item.id = p_player->get_instance_id();
+    item.queued_frame = Engine::get_singleton()->get_idle_frames();
+    item.visible = false;
+    item.priority = 0;
+    queue.push_back(item);
+    if (!process_scheduled) {
+        process_scheduled = true;
+        call_deferred("_process_queue");
+    }
+}
+
+// Players only receive process notification while they need to advance,
+// server keeps track of them for diagnostics.
+void FlashServer::set_player_active(FlashPlayer *p_player, bool p_active) {
+    if (p_active) {
+        active_players.insert(p_player->get_instance_id());
+    } else {
+        active_players.erase(p_player->get_instance_id());
+    }
+}
+
+void FlashServer::_schedule_process() {
+    next_frame_scheduled = false;
+    if (!process_scheduled) {
+        process_scheduled = true;
+        call_deferred("_process_queue");
+    }
+}
+
+void FlashServer::_process_queue() {
+    process_scheduled = false;
+    // players queued while processing may run queue again within same
+    // engine frame, it gets only what is left of frame budget
+    uint64_t idle_frame = Engine::get_singleton()->get_idle_frames();
+    if (idle_frame != frame) {
+        frame = idle_frame;
+        frame_spent_usec = 0;
+        stats_queued = 0;
+        stats_processed = 0;
+    }
+    SceneTree *tree = Object::cast_to<SceneTree>(OS::get_singleton()->get_main_loop());
+    uint64_t start = OS::get_singleton()->get_ticks_usec();
+    uint64_t budget_usec = budget_msec > 0 ? (uint64_t)(budget_msec * 1000.0) : 0;
+
+    // visible players first, then large ones, staleness promotes
+    // skipped ones within their group
+    stats_max_staleness = 0;
+    for (int i=0; i<queue.size(); i++) {
+        QueuedPlayer &item = queue.write[i];
+        FlashPlayer *player = Object::cast_to<FlashPlayer>(ObjectDB::get_instance(item.id));
+        int staleness = item.queued_frame < frame ? frame - item.queued_frame : 0;
+        stats_max_staleness = MAX(stats_max_staleness, staleness);
+        item.visible = player != NULL && player->is_inside_tree() && player->is_visible_in_tree();
+        item.priority = staleness;
+        if (item.visible) {
+            item.priority += player->get_screen_coverage();
+        }
+    }
+    queue.sort();
+
+    Vector<QueuedPlayer> processing = queue;
+    queue.clear();
+    stats_queued += processing.size();
+    int processed = 0;
+    for (int i=0; i<processing.size(); i++) {
+        FlashPlayer *player = Object::cast_to<FlashPlayer>(ObjectDB::get_instance(processing[i].id));
+        if (player == NULL) continue;
+        // at least one player is processed every frame; without scene tree
+        // queue is rerun deferred, so every run has to make progress
+        bool progressed = tree != NULL ? stats_processed > 0 : processed > 0;
+        if (budget_usec > 0 && progressed && frame_spent_usec + OS::get_singleton()->get_ticks_usec() - start >= budget_usec) {
+            queue.push_back(processing[i]);
+            continue;
+        }
+        player->_animation_process();
+        processed++;
+        stats_processed++;
+    }
+    frame_spent_usec += OS::get_singleton()->get_ticks_usec() - start;
+    stats_time_usec = frame_spent_usec;
+    stats_deferred = queue.size();
+
+    if (queue.size() > 0 && !next_frame_scheduled) {
+        if (tree != NULL) {
+            next_frame_scheduled = true;
+            tree->connect("idle_frame", this, "_schedule_process", varray(), CONNECT_ONESHOT);
+        } else {
+            process_scheduled = true;
+            call_deferred("_process_queue");
+        }
+    }
+}
+
+// Safe to call from any thread, never blocks. Commands are coalesced
+// when drained once per frame on main thread: among adjacent commands
+// of same type last write wins for every player property, advance
+// deltas are summed up.
+void FlashServer::post_command(ObjectID p_player, CommandType p_type, const String &p_key, const Variant &p_value) {
+    Command *command = memnew(Command);
+    command->player = p_player;
+    command->type = p_type;
+    command->key = p_key;
+    command->value = p_value;
+    command->next = commands.load(std::memory_order_relaxed);
+    while (!commands.compare_exchange_weak(command->next, command, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    // list was drained, so nobody has scheduled flush yet
+    if (command->next == NULL) {
+        call_deferred("_flush_commands");
+    }
+}
+
+void FlashServer::_flush_commands() {
+    Command *head = commands.exchange(NULL, std::memory_order_acquire);
+    Vector<Command *> posted;
+    for (Command *command = head; command != NULL; command = command->next) {
+        posted.push_back(command);
+    }
+
+    // list is newest first, coalesce in posted order
+    Vector<Command *> flushing;
+    HashMap<CommandKey, int, CommandKeyHasher> slots;
+    HashMap<ObjectID, CommandRun> runs;
+    for (int i=posted.size() - 1; i>=0; i--) {
+        Command *command = posted[i];
+        CommandRun *run = runs.getptr(command->player);
+        if (run == NULL) {
+            CommandRun new_run;
+            new_run.type = command->type;
+            new_run.index = 0;
+            runs.set(command->player, new_run);
+            run = runs.getptr(command->player);
+        } else if (run->type != command->type) {
+            run->type = command->type;
+            run->index++;
+        }
+        CommandKey key;
+        key.player = command->player;
+        key.type = command->type;
+        key.key = command->key;
+        key.run = run->index;
+        const int *slot = slots.getptr(key);
+        if (slot == NULL) {
+            slots.set(key, flushing.size());
+            flushing.push_back(command);
+        } else if (command->type == COMMAND_ADVANCE) {
+            Command *target = flushing[*slot];
+            target->value = float(target->value) + float(command->value);
+        } else {
+            flushing[*slot]->value = command->value;
+        }
+    }
+
+    stats_commands = flushing.size();
+    for (int i=0; i<flushing.size(); i++) {
+        const Command &command = *flushing[i];
+        FlashPlayer *player = Object::cast_to<FlashPlayer>(ObjectDB::get_instance(command.player));
+        if (player == NULL) continue;
+        switch (command.type) {
+            case COMMAND_SET_VARIANT: player->set_variant(command.key, command.value); break;
+            case COMMAND_SET_CLIP: player->set_clip(command.key, command.value); break;
+            case COMMAND_OVERRIDE_FRAME: player->override_frame(command.key, command.value); break;
+            case COMMAND_SET_ACTIVE_CLIP: player->set_active_clip(command.value); break;
+            case COMMAND_ADVANCE: player->advance(command.value); break;
+        }
+    }
+    for (int i=0; i<posted.size(); i++) {
+        memdelete(posted[i]);
+    }
+}
+
+void FlashServer::_run_job(ParallelJob *p_job) {
+    while (true) {
+        uint32_t idx = atomic_increment(&p_job->next) - 1;
+        if (idx >= p_job->count) break;
+        p_job->func(p_job->userdata, idx);
+    }
+}
+
+void FlashServer::_worker_thread(void *p_userdata) {
+    FlashServer *server = (FlashServer *)p_userdata;
+    while (true) {
+        server->work_semaphore->wait();
+        if (server->workers_exit) break;
+        _run_job(server->job);
+        server->done_semaphore->post();
+    }
+}
+
+void FlashServer::_start_workers() {
+    if (work_semaphore != NULL) return;
+    work_semaphore = Semaphore::create();
+    done_semaphore = Semaphore::create();
+    int count = worker_threads > 0 ? worker_threads : OS::get_singleton()->get_processor_count() - 1;
+    for (int i=0; i<count; i++) {
+        workers.push_back(Thread::create(_worker_thread, this));
+    }
+}
+
+// Runs `p_func` for every index in [0, p_count) on worker threads and
+// returns when all of them are done. Calling thread takes tasks too.
+// Not reentrant, tasks must not call it.
+void FlashServer::run_parallel(void (*p_func)(void *, int), void *p_userdata, int p_count) {
+    if (p_count <= 0) return;
+    _start_workers();
+    ParallelJob parallel_job;
+    parallel_job.func = p_func;
+    parallel_job.userdata = p_userdata;
+    parallel_job.count = p_count;
+    parallel_job.next = 0;
+    int helpers = MIN(workers.size(), p_count - 1);
+    job = &parallel_job;
+    for (int i=0; i<helpers; i++) {
+        work_semaphore->post();
+    }
+    _run_job(&parallel_job);
+    for (int i=0; i<helpers; i++) {
+        done_semaphore->wait();
+    }
+    job = NULL;
+}
+
+Dictionary FlashServer::get_stats() const {
+    Dictionary stats;
+    stats["queued"] = stats_queued;
+    stats["processed"] = stats_processed;
+    stats["deferred"] = stats_deferred;
+    stats["max_staleness"] = stats_max_staleness;
+    stats["time_usec"] = stats_time_usec;
+    stats["active_players"] = active_players.size();
+    stats["commands"] = stats_commands;
+    return stats;
+}
+
+void FlashServer::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("_process_queue"), &FlashServer::_process_queue);
+    ClassDB::bind_method(D_METHOD("_schedule_process"), &FlashServer::_schedule_process);
+    ClassDB::bind_method(D_METHOD("_flush_commands"), &FlashServer::_flush_commands);
+    ClassDB::bind_method(D_METHOD("get_budget_msec"), &FlashServer::get_budget_msec);
+    ClassDB::bind_method(D_METHOD("set_budget_msec", "budget_msec"), &FlashServer::set_budget_msec);
+    ClassDB::bind_method(D_METHOD("get_queue_size"), &FlashServer::get_queue_size);
+    ClassDB::bind_method(D_METHOD("get_active_players_count"), &FlashServer::get_active_players_count);
+    ClassDB::bind_method(D_METHOD("get_stats"), &FlashServer::get_stats);
+    ClassDB::bind_method(D_METHOD("get_worker_threads"), &FlashServer::get_worker_threads);
+
+    ADD_PROPERTY(PropertyInfo(Variant::REAL, "budget_msec"), "set_budget_msec", "get_budget_msec");
+
+    BIND_ENUM_CONSTANT(COMMAND_SET_VARIANT);
+    BIND_ENUM_CONSTANT(COMMAND_SET_CLIP);
+    BIND_ENUM_CONSTANT(COMMAND_OVERRIDE_FRAME);
+    BIND_ENUM_CONSTANT(COMMAND_SET_ACTIVE_CLIP);
+    BIND_ENUM_CONSTANT(COMMAND_ADVANCE);
+}
+
+FlashServer::FlashServer() {
+    singleton = this;
+    process_scheduled = false;
+    next_frame_scheduled = false;
+    frame = 0;
+    frame_spent_usec = 0;
+    budget_msec = GLOBAL_DEF("flash/scheduler/budget_msec", 2.0);
+    ProjectSettings::get_singleton()->set_custom_property_info("flash/scheduler/budget_msec", PropertyInfo(Variant::REAL, "flash/scheduler/budget_msec", PROPERTY_HINT_RANGE, "0,33,0.1"));
+    stats_queued = 0;
+    stats_processed = 0;
+    stats_deferred = 0;
+    stats_max_staleness = 0;
+    stats_time_usec = 0;
+    worker_threads = GLOBAL_DEF("flash/threading/worker_threads", 0);
+    ProjectSettings::get_singleton()->set_custom_property_info("flash/threading/worker_threads", PropertyInfo(Variant::INT, "flash/threading/worker_threads", PROPERTY_HINT_RANGE, "0,64,1"));
+    // read by document loader, 0 keeps whole atlas resident
+    GLOBAL_DEF("flash/atlas/residency_budget_mb", 0);
+    // read by document loader, library symbols are read on first use
+    GLOBAL_DEF("flash/loading/lazy_symbols", true);
+    ProjectSettings::get_singleton()->set_custom_property_info("flash/atlas/residency_budget_mb", PropertyInfo(Variant::INT, "flash/atlas/residency_budget_mb", PROPERTY_HINT_RANGE, "0,4096,1"));
+    stats_commands = 0;
+    commands.store(NULL);
+    work_semaphore = NULL;
+    done_semaphore = NULL;
+    job = NULL;
+    workers_exit = false;
+}
+
+FlashServer::~FlashServer() {
+    if (work_semaphore != NULL) {
+        workers_exit = true;
+        for (int i=0; i<workers.size(); i++) {
+            work_semaphore->post();
+        }
+        for (int i=0; i<workers.size(); i++) {
+            Thread::wait_to_finish(workers[i]);
+            memdelete(workers[i]);
+        }
+        memdelete(work_semaphore);
+        memdelete(done_semaphore);
+    }
+    Command *command = commands.exchange(NULL);
+    while (command != NULL) {
+        Command *next = command->next;
+        memdelete(command);
+        command = next;
+    }
+    singleton = NULL;
+}
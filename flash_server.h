@@ -0,0 +1,161 @@
+// MIT License
+
+// Copyright (c) 2021 Yakov Borevich, Funexpected LLC
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef FLASH_SERVER_H
+#define FLASH_SERVER_H
+
+#include <core/object.h>
+#include <core/set.h>
+#include <core/vector.h>
+#include <core/hash_map.h>
+#include <core/os/thread.h>
+#include <core/os/semaphore.h>
+
+#include <atomic>
+
+class FlashPlayer;
+
+// Schedules evaluation of queued players within per-frame time budget.
+// Players over budget are kept in queue and processed next frame first,
+// their time is accumulated meanwhile.
+class FlashServer: public Object {
+    GDCLASS(FlashServer, Object);
+
+public:
+    enum CommandType {
+        COMMAND_SET_VARIANT,
+        COMMAND_SET_CLIP,
+        COMMAND_OVERRIDE_FRAME,
+        COMMAND_SET_ACTIVE_CLIP,
+        COMMAND_ADVANCE
+    };
+
+private:
+    // player commands posted from any thread, applied on main thread;
+    // producers push nodes onto lock-free list, newest first
+    struct Command {
+        ObjectID player;
+        CommandType type;
+        String key;
+        Variant value;
+        Command *next;
+    };
+
+    // commands are coalesced within a run of same type commands
+    // of the player only, so they are applied in posted order
+    struct CommandKey {
+        ObjectID player;
+        CommandType type;
+        String key;
+        int run;
+
+        bool operator==(const CommandKey &p_other) const { return player == p_other.player && type == p_other.type && key == p_other.key && run == p_other.run; }
+    };
+
+    struct CommandKeyHasher {
+        static _FORCE_INLINE_ uint32_t hash(const CommandKey &p_key) { return hash_djb2_one_64(p_key.player, hash_djb2_one_32(p_key.type, hash_djb2_one_32(p_key.run, p_key.key.hash()))); }
+    };
+
+    struct CommandRun {
+        CommandType type;
+        int index;
+    };
+
+    // visible players always go before hidden ones
+    struct QueuedPlayer {
+        ObjectID id;
+        uint64_t queued_frame;
+        bool visible;
+        float priority;
+
+        bool operator<(const QueuedPlayer &p_other) const {
+            if (visible != p_other.visible) return visible;
+            return priority > p_other.priority;
+        }
+    };
+
+    // tasks are picked by shared counter, so idle workers
+    // take over remaining tasks of busy ones
+    struct ParallelJob {
+        void (*func)(void *, int);
+        void *userdata;
+        uint32_t count;
+        volatile uint32_t next;
+    };
+
+    static FlashServer *singleton;
+
+    Vector<QueuedPlayer> queue;
+    Set<ObjectID> active_players;
+    bool process_scheduled;
+    bool next_frame_scheduled;
+    // engine frame budget was last spent in, reruns within it share budget
+    uint64_t frame;
+    uint64_t frame_spent_usec;
+    float budget_msec;
+
+    int stats_queued;
+    int stats_processed;
+    int stats_deferred;
+    int stats_max_staleness;
+    uint64_t stats_time_usec;
+    int stats_commands;
+
+    std::atomic<Command *> commands;
+
+    int worker_threads;
+    Vector<Thread *> workers;
+    Semaphore *work_semaphore;
+    Semaphore *done_semaphore;
+    ParallelJob *job;
+    bool workers_exit;
+
+protected:
+    static void _bind_methods();
+    void _schedule_process();
+    void _process_queue();
+    void _start_workers();
+    void _flush_commands();
+    static void _run_job(ParallelJob *p_job);
+    static void _worker_thread(void *p_userdata);
+
+public:
+    static FlashServer *get_singleton() { return singleton; }
+
+    void queue_player(FlashPlayer *p_player);
+    void set_player_active(FlashPlayer *p_player, bool p_active);
+    int get_active_players_count() const { return active_players.size(); }
+    float get_budget_msec() const { return budget_msec; }
+    void set_budget_msec(float p_budget) { budget_msec = p_budget; }
+    int get_queue_size() const { return queue.size(); }
+    Dictionary get_stats() const;
+    int get_worker_threads() const { return worker_threads; }
+    void run_parallel(void (*p_func)(void *, int), void *p_userdata, int p_count);
+    void post_command(ObjectID p_player, CommandType p_type, const String &p_key, const Variant &p_value);
+
+    FlashServer();
+    ~FlashServer();
+};
+
+VARIANT_ENUM_CAST(FlashServer::CommandType);
+
+#endif
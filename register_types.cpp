@@ -22,10 +22,13 @@
 
 
 #include <core/class_db.h>
+#include <core/engine.h>
 #include <core/project_settings.h>
 #include "register_types.h"
 #include "flash_player.h"
 #include "flash_resources.h"
+#include "flash_format.h"
+#include "flash_server.h"
 #include "animation_node_flash.h"
 
 #ifdef TOOLS_ENABLED
@@ -70,13 +73,13 @@ public:
 			String remap = F->get();
 			if (remap == "path") {
 				String imported_doc_path = config->get_value("remap", remap);
-				String texture_path = imported_doc_path.substr(0, imported_doc_path.length()-3) + "ftex";
+				String texture_path = imported_doc_path.get_basename() + ".ftex";
 				add_file(texture_path, FileAccess::get_file_as_array(texture_path), false);
 			} else if (remap.begins_with("path.")) {
 				String feature = remap.get_slice(".", 1);
 				if (remap_features.has(feature)) {
 					String imported_doc_path = config->get_value("remap", remap);
-					String texture_path = imported_doc_path.substr(0, imported_doc_path.length()-3) + "ftex";
+					String texture_path = imported_doc_path.get_basename() + ".ftex";
 					add_file(texture_path, FileAccess::get_file_as_array(texture_path), false);
 				}
 			}
@@ -97,9 +100,15 @@ static void _editor_init() {
 
 
 Ref<ResourceFormatLoaderFlashTexture> resource_loader_flash_texture;
+Ref<ResourceFormatLoaderFlashDocument> resource_loader_flash_document;
+Ref<ResourceFormatSaverFlashDocument> resource_saver_flash_document;
+static FlashServer *flash_server = NULL;
 
 void register_flash_types() {
 	// core flash classes
+	ClassDB::register_virtual_class<FlashServer>();
+	flash_server = memnew(FlashServer);
+	Engine::get_singleton()->add_singleton(Engine::Singleton("FlashServer", FlashServer::get_singleton()));
 	ClassDB::register_class<FlashPlayer>();
 #ifdef MODULE_FLASH_WITH_ANIMATION_NODES
 	ClassDB::register_class<FlashMachine>();
@@ -109,6 +118,10 @@ void register_flash_types() {
 	// resources
 	ClassDB::register_virtual_class<FlashElement>();
 	ClassDB::register_class<FlashTextureRect>();
+	ClassDB::register_virtual_class<FlashAtlasResidency>();
+	ClassDB::register_virtual_class<FlashDocumentInteractiveLoader>();
+	ClassDB::register_class<FlashBakedTrack>();
+	ClassDB::register_class<FlashSkinPreset>();
 	ClassDB::register_class<FlashDocument>();
 	ClassDB::register_class<FlashBitmapItem>();
 	ClassDB::register_class<FlashTimeline>();
@@ -125,6 +138,10 @@ void register_flash_types() {
 	// loader
 	resource_loader_flash_texture.instance();
 	ResourceLoader::add_resource_format_loader(resource_loader_flash_texture);
+	resource_loader_flash_document.instance();
+	ResourceLoader::add_resource_format_loader(resource_loader_flash_document);
+	resource_saver_flash_document.instance();
+	ResourceSaver::add_resource_format_saver(resource_saver_flash_document);
 
 #ifdef TOOLS_ENABLED
 	EditorNode::add_init_callback(_editor_init);
@@ -132,6 +149,13 @@ void register_flash_types() {
 }
 
 void unregister_flash_types() {
+	if (flash_server) {
+		memdelete(flash_server);
+	}
 	ResourceLoader::remove_resource_format_loader(resource_loader_flash_texture);
 	resource_loader_flash_texture.unref();
+	ResourceLoader::remove_resource_format_loader(resource_loader_flash_document);
+	resource_loader_flash_document.unref();
+	ResourceSaver::remove_resource_format_saver(resource_saver_flash_document);
+	resource_saver_flash_document.unref();
 }
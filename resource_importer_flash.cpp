@@ -30,8 +30,288 @@
 
 #include "resource_importer_flash.h"
 #include "flash_resources.h"
+#include "flash_format.h"
 
-const int ResourceImporterFlash::importer_version = 12;
+const int ResourceImporterFlash::importer_version = 22;
+
+#define ATLAS_PADDING 2
+
+struct FlashFlattenItem {
+    Transform2D transform;
+    Vector2 size;
+    Rect2 region;
+    int texture_idx;
+    FlashColorEffect effect;
+};
+
+struct FlashFlattenJob {
+    Ref<FlashTimeline> timeline;
+    Vector<Ref<FlashLayer>> layers;
+    Vector<FlashFlattenItem> items;
+    int frame;
+    Rect2 bounds;
+    Size2i size;
+    Ref<FlashTextureRect> texture;
+
+    FlashFlattenJob():
+        frame(0){}
+};
+
+static FlashColorEffect _frame_color_effect(const Ref<FlashFrame> &p_frame) {
+    FlashColorEffect effect;
+    PoolColorArray colors = p_frame->get_color_effect();
+    if (colors.size() > 0) effect.add = colors[0];
+    if (colors.size() > 1) effect.mult = colors[1];
+    return effect;
+}
+
+static bool _is_static_symbol(FlashTimeline *p_symbol, int p_depth);
+
+static bool _is_static_drawing(const Ref<FlashDrawing> &p_drawing, int p_depth) {
+    FlashBitmapInstance *bitmap = Object::cast_to<FlashBitmapInstance>(p_drawing.ptr());
+    if (bitmap != NULL) {
+        FlashDocument *document = bitmap->get_document();
+        return document != NULL && document->get_bitmaps().has(bitmap->get_library_item_name());
+    }
+    FlashGroup *group = Object::cast_to<FlashGroup>(p_drawing.ptr());
+    if (group != NULL) {
+        List<Ref<FlashDrawing>> members = group->all_members();
+        for (List<Ref<FlashDrawing>>::Element *E = members.front(); E; E = E->next()) {
+            if (!_is_static_drawing(E->get(), p_depth)) return false;
+        }
+        return true;
+    }
+    FlashInstance *instance = Object::cast_to<FlashInstance>(p_drawing.ptr());
+    if (instance != NULL) {
+        FlashTimeline *symbol = instance->get_timeline();
+        return symbol == NULL || _is_static_symbol(symbol, p_depth + 1);
+    }
+    // shapes are never drawn
+    return true;
+}
+
+static bool _is_static_layer(const Ref<FlashLayer> &p_layer, int p_depth) {
+    FlashLayer::Type type = p_layer->get_layer_type();
+    if (type == FlashLayer::TYPE_MASK || type == FlashLayer::TYPE_GUIDE || type == FlashLayer::TYPE_FOLDER) return false;
+    if (p_layer->get_mask_id()) return false;
+    Array frames = p_layer->get_frames();
+    if (frames.size() != 1) return false;
+    Ref<FlashFrame> frame = frames[0];
+    if (frame->get_index() != 0) return false;
+    if (frame->get_tweens().size() > 0) return false;
+    if (frame->get_frame_name() != String()) return false;
+    Array elements = frame->get_elements();
+    for (int i=0; i<elements.size(); i++) {
+        if (!_is_static_drawing(elements[i], p_depth)) return false;
+    }
+    return true;
+}
+
+static bool _is_static_symbol(FlashTimeline *p_symbol, int p_depth) {
+    if (p_depth > 32) return false;
+    if (p_symbol->get_clips().size() > 0) return false;
+    if (p_symbol->get_events().size() > 0) return false;
+    if (p_symbol->get_variants().size() > 0) return false;
+    Array layers = p_symbol->get_layers();
+    for (int i=0; i<layers.size(); i++) {
+        Ref<FlashLayer> layer = layers[i];
+        if (layer->get_layer_type() == FlashLayer::TYPE_FOLDER) continue;
+        if (!_is_static_layer(layer, p_depth)) return false;
+    }
+    return true;
+}
+
+static void _collect_symbol(FlashTimeline *p_symbol, const Transform2D &p_transform, const FlashColorEffect &p_effect, Vector<FlashFlattenItem> *r_items);
+
+static void _collect_drawing(const Ref<FlashDrawing> &p_drawing, const Transform2D &p_transform, const FlashColorEffect &p_effect, Vector<FlashFlattenItem> *r_items) {
+    FlashBitmapInstance *bitmap = Object::cast_to<FlashBitmapInstance>(p_drawing.ptr());
+    if (bitmap != NULL) {
+        Ref<FlashTextureRect> texture = bitmap->get_texture();
+        if (texture.is_null()) return;
+        FlashFlattenItem item;
+        item.transform = p_transform;
+        item.size = texture->get_original_size();
+        item.region = texture->get_region();
+        item.texture_idx = texture->get_index();
+        item.effect = p_effect;
+        r_items->push_back(item);
+        return;
+    }
+    // mirrors `FlashGroup::animation_process`, members drawn with group transform
+    FlashGroup *group = Object::cast_to<FlashGroup>(p_drawing.ptr());
+    if (group != NULL) {
+        List<Ref<FlashDrawing>> members = group->all_members();
+        for (List<Ref<FlashDrawing>>::Element *E = members.front(); E; E = E->next()) {
+            _collect_drawing(E->get(), p_transform, p_effect, r_items);
+        }
+        return;
+    }
+    FlashInstance *instance = Object::cast_to<FlashInstance>(p_drawing.ptr());
+    if (instance != NULL && instance->get_timeline() != NULL) {
+        _collect_symbol(instance->get_timeline(), p_transform, p_effect, r_items);
+    }
+}
+
+static void _collect_layer(const Ref<FlashLayer> &p_layer, const Transform2D &p_transform, const FlashColorEffect &p_effect, Vector<FlashFlattenItem> *r_items) {
+    if (p_layer->get_layer_type() == FlashLayer::TYPE_FOLDER) return;
+    Array frames = p_layer->get_frames();
+    if (frames.size() == 0) return;
+    Ref<FlashFrame> frame = frames[0];
+    Array elements = frame->get_elements();
+    for (int i=0; i<elements.size(); i++) {
+        Ref<FlashDrawing> elem = elements[i];
+        FlashColorEffect effect = _frame_color_effect(frame);
+        FlashInstance *instance = Object::cast_to<FlashInstance>(elem.ptr());
+        if (instance != NULL) {
+            effect = instance->color_effect * effect;
+        }
+        _collect_drawing(elem, p_transform * elem->get_transform(), effect * p_effect, r_items);
+    }
+}
+
+static void _collect_symbol(FlashTimeline *p_symbol, const Transform2D &p_transform, const FlashColorEffect &p_effect, Vector<FlashFlattenItem> *r_items) {
+    // same paint order as `FlashTimeline::animation_process`
+    Array layers = p_symbol->get_layers();
+    for (int i=layers.size()-1; i>=0; i--) {
+        _collect_layer(layers[i], p_transform, p_effect, r_items);
+    }
+}
+
+static Rect2 _items_bounds(const Vector<FlashFlattenItem> &p_items) {
+    Rect2 bounds;
+    for (int i=0; i<p_items.size(); i++) {
+        const FlashFlattenItem &item = p_items[i];
+        Vector2 size = item.size;
+        Vector2 corners[4] = { Vector2(), Vector2(size.x, 0), size, Vector2(0, size.y) };
+        for (int j=0; j<4; j++) {
+            Vector2 p = item.transform.xform(corners[j]);
+            if (i == 0 && j == 0) {
+                bounds = Rect2(p, Vector2());
+            } else {
+                bounds.expand_to(p);
+            }
+        }
+    }
+    return bounds;
+}
+
+static Color _sample_bilinear(Ref<Image> p_image, const Vector2 &p_pos, const Rect2 &p_region) {
+    Vector2 pos = p_pos - Vector2(0.5, 0.5);
+    int x0 = (int)Math::floor(pos.x);
+    int y0 = (int)Math::floor(pos.y);
+    float fx = pos.x - x0;
+    float fy = pos.y - y0;
+    int min_x = (int)p_region.position.x;
+    int min_y = (int)p_region.position.y;
+    int max_x = MIN((int)(p_region.position.x + p_region.size.x), p_image->get_width()) - 1;
+    int max_y = MIN((int)(p_region.position.y + p_region.size.y), p_image->get_height()) - 1;
+    int x1 = CLAMP(x0 + 1, min_x, max_x);
+    int y1 = CLAMP(y0 + 1, min_y, max_y);
+    x0 = CLAMP(x0, min_x, max_x);
+    y0 = CLAMP(y0, min_y, max_y);
+    Color top = p_image->get_pixel(x0, y0).linear_interpolate(p_image->get_pixel(x1, y0), fx);
+    Color bottom = p_image->get_pixel(x0, y1).linear_interpolate(p_image->get_pixel(x1, y1), fx);
+    return top.linear_interpolate(bottom, fy);
+}
+
+// Composites items over transparent image of `p_size` pixels covering `p_bounds`
+// in symbol space. Color effects are applied same way as in flash shader.
+static Ref<Image> _rasterize_items(const Vector<FlashFlattenItem> &p_items, const Vector<Ref<Image>> &p_pages, const Rect2 &p_bounds, const Size2i &p_size) {
+    Ref<Image> image;
+    image.instance();
+    image->create(p_size.x, p_size.y, false, Image::FORMAT_RGBA8);
+    image->fill(Color(0, 0, 0, 0));
+    Vector2 pixel_size = p_bounds.size / Vector2(p_size.x, p_size.y);
+
+    image->lock();
+    for (int i=0; i<p_items.size(); i++) {
+        const FlashFlattenItem &item = p_items[i];
+        if (item.texture_idx < 0 || item.texture_idx >= p_pages.size()) continue;
+        Ref<Image> page = p_pages[item.texture_idx];
+        Rect2 region = item.region;
+        Vector2 original_size = item.size;
+        if (original_size.x <= 0 || original_size.y <= 0) continue;
+        Vector2 texel_scale = region.size / original_size;
+        Transform2D inverse = item.transform.affine_inverse();
+
+        Rect2 item_rect = Rect2(item.transform.xform(Vector2()), Vector2());
+        item_rect.expand_to(item.transform.xform(Vector2(original_size.x, 0)));
+        item_rect.expand_to(item.transform.xform(original_size));
+        item_rect.expand_to(item.transform.xform(Vector2(0, original_size.y)));
+        int from_x = MAX(0, (int)Math::floor((item_rect.position.x - p_bounds.position.x) / pixel_size.x));
+        int from_y = MAX(0, (int)Math::floor((item_rect.position.y - p_bounds.position.y) / pixel_size.y));
+        int to_x = MIN(p_size.x, (int)Math::ceil((item_rect.position.x + item_rect.size.x - p_bounds.position.x) / pixel_size.x));
+        int to_y = MIN(p_size.y, (int)Math::ceil((item_rect.position.y + item_rect.size.y - p_bounds.position.y) / pixel_size.y));
+
+        page->lock();
+        for (int y=from_y; y<to_y; y++) {
+            for (int x=from_x; x<to_x; x++) {
+                Vector2 local = inverse.xform(p_bounds.position + (Vector2(x, y) + Vector2(0.5, 0.5)) * pixel_size);
+                if (local.x < 0 || local.y < 0 || local.x >= original_size.x || local.y >= original_size.y) continue;
+                Color c = _sample_bilinear(page, region.position + local * texel_scale, region);
+                if (c.a <= 0) continue;
+                Color src = Color(
+                    CLAMP(c.r * item.effect.mult.r + item.effect.add.r, 0, 1),
+                    CLAMP(c.g * item.effect.mult.g + item.effect.add.g, 0, 1),
+                    CLAMP(c.b * item.effect.mult.b + item.effect.add.b, 0, 1),
+                    CLAMP(c.a * item.effect.mult.a + item.effect.add.a, 0, 1)
+                );
+                image->set_pixel(x, y, image->get_pixel(x, y).blend(src));
+            }
+        }
+        page->unlock();
+    }
+    image->unlock();
+    return image;
+}
+
+// Simple shelf packer: places images to pages of fixed size,
+// returns page index (relative to first new page) for every image or -1
+// if image does not fit into page at all.
+static int _pack_images(const Vector<Size2i> &p_sizes, const Size2i &p_page_size, Vector<int> &r_pages, Vector<Point2i> &r_positions) {
+    r_pages.resize(p_sizes.size());
+    r_positions.resize(p_sizes.size());
+    Vector<int> order;
+    for (int i=0; i<p_sizes.size(); i++) {
+        order.push_back(i);
+    }
+    // tallest first gives denser shelves
+    for (int i=1; i<order.size(); i++) {
+        int j = i;
+        while (j > 0 && p_sizes[order[j-1]].y < p_sizes[order[j]].y) {
+            int tmp = order[j];
+            order.write[j] = order[j-1];
+            order.write[j-1] = tmp;
+            j--;
+        }
+    }
+
+    int page = -1;
+    Point2i cursor;
+    int shelf_height = 0;
+    for (int i=0; i<order.size(); i++) {
+        int idx = order[i];
+        Size2i size = p_sizes[idx] + Size2i(ATLAS_PADDING * 2, ATLAS_PADDING * 2);
+        if (size.x > p_page_size.x || size.y > p_page_size.y) {
+            r_pages.write[idx] = -1;
+            continue;
+        }
+        if (page >= 0 && cursor.x + size.x > p_page_size.x) {
+            cursor = Point2i(0, cursor.y + shelf_height);
+            shelf_height = 0;
+        }
+        if (page < 0 || cursor.y + size.y > p_page_size.y) {
+            page++;
+            cursor = Point2i();
+            shelf_height = 0;
+        }
+        r_pages.write[idx] = page;
+        r_positions.write[idx] = cursor + Point2i(ATLAS_PADDING, ATLAS_PADDING);
+        cursor.x += size.x;
+        shelf_height = MAX(shelf_height, size.y);
+    }
+    return page + 1;
+}
 
 String ResourceImporterFlash::get_importer_name() const {
     return "flash";
@@ -47,7 +327,7 @@ void ResourceImporterFlash::get_recognized_extensions(List<String> *p_extensions
 }
 
 String ResourceImporterFlash::get_save_extension() const {
-	return "res";
+	return "fdoc";
 }
 
 String ResourceImporterFlash::get_resource_type() const {
@@ -62,6 +342,16 @@ void ResourceImporterFlash::get_import_options(List<ImportOption> *r_options, in
 
     r_options->push_back(ImportOption(PropertyInfo(Variant::INT, "process/downscale", PROPERTY_HINT_ENUM, "Disabled,x2,x4"), 0));
 	r_options->push_back(ImportOption(PropertyInfo(Variant::BOOL, "process/fix_alpha_border"), true));
+	r_options->push_back(ImportOption(PropertyInfo(Variant::BOOL, "process/flatten_static_layers"), false));
+	r_options->push_back(ImportOption(PropertyInfo(Variant::STRING, "flipbook/symbols"), ""));
+	r_options->push_back(ImportOption(PropertyInfo(Variant::REAL, "flipbook/scale", PROPERTY_HINT_RANGE, "0.05,1,0.05"), 1.0));
+	r_options->push_back(ImportOption(PropertyInfo(Variant::INT, "flipbook/frame_step", PROPERTY_HINT_RANGE, "1,10,1"), 1));
+	r_options->push_back(ImportOption(PropertyInfo(Variant::STRING, "baked_tracks/symbols"), ""));
+	r_options->push_back(ImportOption(PropertyInfo(Variant::BOOL, "baked_tracks/variant_alternatives"), true));
+	r_options->push_back(ImportOption(PropertyInfo(Variant::BOOL, "prune/enabled"), false));
+	r_options->push_back(ImportOption(PropertyInfo(Variant::STRING, "prune/root_symbols"), ""));
+	r_options->push_back(ImportOption(PropertyInfo(Variant::INT, "document/compression", PROPERTY_HINT_ENUM, "None,FastLZ,Deflate,Zstd"), 0));
+	r_options->push_back(ImportOption(PropertyInfo(Variant::INT, "document/frame_chunk_size", PROPERTY_HINT_RANGE, "0,2400,1"), 0));
 	r_options->push_back(ImportOption(PropertyInfo(Variant::INT, "compress/mode", PROPERTY_HINT_ENUM, "Lossless (PNG),Video RAM (S3TC/ETC/BPTC),Uncompressed", PROPERTY_USAGE_DEFAULT | PROPERTY_USAGE_UPDATE_ALL_IF_MODIFIED), 1));
 	r_options->push_back(ImportOption(PropertyInfo(Variant::INT, "flags/repeat", PROPERTY_HINT_ENUM, "Disabled,Enabled,Mirrored"), 0));
 	r_options->push_back(ImportOption(PropertyInfo(Variant::BOOL, "flags/filter"), true));
@@ -120,6 +410,34 @@ Error ResourceImporterFlash::import(const String &p_source_file, const String &p
 	int srgb = p_options["flags/srgb"];
     int downscale = p_options["process/downscale"];
     bool fix_alpha_border = p_options["process/fix_alpha_border"];
+    bool flatten_static_layers = p_options["process/flatten_static_layers"];
+    Vector<String> flipbook_symbols = String(p_options["flipbook/symbols"]).split(",", false);
+    for (int i=0; i<flipbook_symbols.size(); i++) {
+        flipbook_symbols.write[i] = FlashDocument::validate_token(flipbook_symbols[i].strip_edges());
+    }
+    float flipbook_scale = p_options["flipbook/scale"];
+    int flipbook_frame_step = p_options["flipbook/frame_step"];
+    Vector<String> baked_tracks = String(p_options["baked_tracks/symbols"]).split(",", false);
+    for (int i=0; i<baked_tracks.size(); i++) {
+        String token = baked_tracks[i].strip_edges();
+        baked_tracks.write[i] = token == "*" || token == "[document]" ? token : FlashDocument::validate_token(token);
+    }
+    bool baked_variant_alternatives = p_options["baked_tracks/variant_alternatives"];
+    bool prune = p_options["prune/enabled"];
+    // symbols baked by name are roots as well
+    PoolStringArray prune_roots;
+    Vector<String> root_symbols = String(p_options["prune/root_symbols"]).split(",", false);
+    for (int i=0; i<root_symbols.size(); i++) {
+        prune_roots.push_back(FlashDocument::validate_token(root_symbols[i].strip_edges()));
+    }
+    for (int i=0; i<flipbook_symbols.size(); i++) {
+        prune_roots.push_back(flipbook_symbols[i]);
+    }
+    for (int i=0; i<baked_tracks.size(); i++) {
+        if (baked_tracks[i] != "*" && baked_tracks[i] != "[document]") prune_roots.push_back(baked_tracks[i]);
+    }
+    FlashDocumentFormat::Compression document_compression = (FlashDocumentFormat::Compression)(int)p_options["document/compression"];
+    int frame_chunk_size = p_options["document/frame_chunk_size"];
 
     int tex_flags = 0;
 	if (repeat > 0)
@@ -297,6 +615,31 @@ Error ResourceImporterFlash::import(const String &p_source_file, const String &p
         item->set_texture(frame);
     }
 
+    Dictionary import_report;
+    if (prune) {
+        Dictionary pruned;
+        _prune_unreachable(doc, spritesheet_images, prune_roots, fix_alpha_border, pruned);
+        import_report["pruned"] = pruned;
+    }
+    int first_baked_page = spritesheet_images.size();
+    Array flipbooks;
+    _bake_flipbooks(doc, spritesheet_images, downscale, flipbook_symbols, flipbook_scale, flipbook_frame_step, flipbooks);
+    if (flipbooks.size() > 0) {
+        import_report["flipbooks"] = flipbooks;
+    }
+    if (flatten_static_layers) {
+        Array flattened;
+        _flatten_static_layers(doc, spritesheet_images, downscale, flattened);
+        import_report["flattened"] = flattened;
+    }
+    if (fix_alpha_border) {
+        for (int i=first_baked_page; i<spritesheet_images.size(); i++) {
+            spritesheet_images.write[i]->fix_alpha_edges();
+        }
+    }
+    doc->set_import_report(import_report);
+    doc->set_frame_chunk_size(frame_chunk_size);
+
     String extension = get_save_extension();
     Array formats_imported;
     if (compress_mode == COMPRESS_VIDEO_RAM) {
@@ -310,7 +653,8 @@ Error ResourceImporterFlash::import(const String &p_source_file, const String &p
 			_save_tex(p_save_path + ".s3tc.ftex", spritesheet_images,
                 compress_mode, Image::COMPRESS_S3TC, mipmaps, tex_flags);
             doc->set_atlas(ResourceLoader::load(p_save_path + ".s3tc.ftex"));
-            ResourceSaver::save(p_save_path + ".s3tc." + extension, doc);
+            _bake_tracks(doc, baked_tracks, baked_variant_alternatives, import_report);
+            FlashDocumentFormat::save(p_save_path + ".s3tc." + extension, doc, document_compression);
 			r_platform_variants->push_back("s3tc");
 			ok_on_pc = true;
 			formats_imported.push_back("s3tc");
@@ -320,7 +664,8 @@ Error ResourceImporterFlash::import(const String &p_source_file, const String &p
             _save_tex(p_save_path + ".etc2.ftex", spritesheet_images,
                 compress_mode, Image::COMPRESS_ETC2, mipmaps, tex_flags);
             doc->set_atlas(ResourceLoader::load(p_save_path + ".etc2.ftex"));
-            ResourceSaver::save(p_save_path + ".etc2." + extension, doc);
+            _bake_tracks(doc, baked_tracks, baked_variant_alternatives, import_report);
+            FlashDocumentFormat::save(p_save_path + ".etc2." + extension, doc, document_compression);
 			r_platform_variants->push_back("etc2");
 			formats_imported.push_back("etc2");
 		}
@@ -329,7 +674,8 @@ Error ResourceImporterFlash::import(const String &p_source_file, const String &p
             _save_tex(p_save_path + ".etc.ftex", spritesheet_images,
                 compress_mode, Image::COMPRESS_ETC, mipmaps, tex_flags);
             doc->set_atlas(ResourceLoader::load(p_save_path + ".etc.ftex"));
-            ResourceSaver::save(p_save_path + ".etc." + extension, doc);
+            _bake_tracks(doc, baked_tracks, baked_variant_alternatives, import_report);
+            FlashDocumentFormat::save(p_save_path + ".etc." + extension, doc, document_compression);
 			r_platform_variants->push_back("etc");
 			formats_imported.push_back("etc");
 		}
@@ -338,7 +684,8 @@ Error ResourceImporterFlash::import(const String &p_source_file, const String &p
             _save_tex(p_save_path + ".pvrtc.ftex", spritesheet_images,
                 compress_mode, Image::COMPRESS_PVRTC4, mipmaps, tex_flags);
             doc->set_atlas(ResourceLoader::load(p_save_path + ".pvrtc.ftex"));
-            ResourceSaver::save(p_save_path + ".pvrtc." + extension, doc);
+            _bake_tracks(doc, baked_tracks, baked_variant_alternatives, import_report);
+            FlashDocumentFormat::save(p_save_path + ".pvrtc." + extension, doc, document_compression);
 			r_platform_variants->push_back("pvrtc");
 			formats_imported.push_back("pvrtc");
 		}
@@ -351,7 +698,8 @@ Error ResourceImporterFlash::import(const String &p_source_file, const String &p
         _save_tex(p_save_path + ".ftex", spritesheet_images,
                 compress_mode, Image::COMPRESS_S3TC /*this is ignored */, mipmaps, tex_flags);
         doc->set_atlas(ResourceLoader::load(p_save_path + ".ftex"));
-        ResourceSaver::save(p_save_path + "." + extension, doc);
+        _bake_tracks(doc, baked_tracks, baked_variant_alternatives, import_report);
+        FlashDocumentFormat::save(p_save_path + "." + extension, doc, document_compression);
 	}
 
 	if (r_metadata) {
@@ -410,6 +758,375 @@ Error ResourceImporterFlash::import(const String &p_source_file, const String &p
     return OK;
 }
 
+// Rasterizes items of every job into new atlas pages, `texture` of job
+// stays empty if it does not fit the page. Returns number of added pages.
+static int _bake_jobs(Vector<FlashFlattenJob> &r_jobs, Vector<Ref<Image>> &r_spritesheets, float p_texel_size) {
+    Size2i page_size = Size2i(r_spritesheets[0]->get_width(), r_spritesheets[0]->get_height());
+    Vector<Size2i> sizes;
+    for (int i=0; i<r_jobs.size(); i++) {
+        FlashFlattenJob &job = r_jobs.write[i];
+        Rect2 bounds = _items_bounds(job.items);
+        job.size = Size2i(MAX(1, (int)Math::ceil(bounds.size.x / p_texel_size)), MAX(1, (int)Math::ceil(bounds.size.y / p_texel_size)));
+        job.bounds = Rect2(bounds.position, Vector2(job.size.x, job.size.y) * p_texel_size);
+        sizes.push_back(job.size);
+    }
+    Vector<int> pages;
+    Vector<Point2i> positions;
+    int pages_count = _pack_images(sizes, page_size, pages, positions);
+    int first_page = r_spritesheets.size();
+    for (int i=0; i<pages_count; i++) {
+        Ref<Image> page;
+        page.instance();
+        page->create(page_size.x, page_size.y, false, Image::FORMAT_RGBA8);
+        page->fill(Color(0, 0, 0, 0));
+        r_spritesheets.push_back(page);
+    }
+    for (int i=0; i<r_jobs.size(); i++) {
+        FlashFlattenJob &job = r_jobs.write[i];
+        if (pages[i] < 0) continue;
+        Ref<Image> image = _rasterize_items(job.items, r_spritesheets, job.bounds, job.size);
+        r_spritesheets.write[first_page + pages[i]]->blit_rect(image, Rect2(Vector2(), image->get_size()), positions[i]);
+        job.texture.instance();
+        job.texture->set_index(first_page + pages[i]);
+        job.texture->set_region(Rect2(positions[i], Vector2(job.size.x, job.size.y)));
+        job.texture->set_original_size(job.bounds.size);
+    }
+    return pages_count;
+}
+
+// Registers baked texture as library bitmap and returns instance of it
+// placed at top left corner of job bounds.
+static Ref<FlashBitmapInstance> _make_baked_bitmap(Ref<FlashDocument> p_document, Dictionary &r_bitmaps, const String &p_name, const FlashFlattenJob &p_job, FlashElement *p_parent) {
+    Ref<FlashBitmapItem> item;
+    item.instance();
+    item->set_texture(p_job.texture);
+    r_bitmaps[p_name] = item;
+
+    Ref<FlashBitmapInstance> bitmap;
+    bitmap.instance();
+    bitmap->set_library_item_name(p_name);
+    bitmap->set_transform(Transform2D(0, p_job.bounds.position));
+    bitmap->setup(p_document.ptr(), p_parent);
+    return bitmap;
+}
+
+void ResourceImporterFlash::_bake_flipbooks(Ref<FlashDocument> p_document, Vector<Ref<Image>> &r_spritesheets, int p_downscale, const Vector<String> &p_symbols, float p_scale, int p_frame_step, Array &r_report) {
+    if (r_spritesheets.size() == 0) return;
+    float texel_size = (1 << p_downscale) / CLAMP(p_scale, 0.05, 1.0);
+    int frame_step = MAX(1, p_frame_step);
+
+    Vector<Ref<FlashTimeline>> symbols;
+    Array symbols_array = p_document->get_symbols().values();
+    for (int i=0; i<symbols_array.size(); i++) {
+        Ref<FlashTimeline> symbol = symbols_array[i];
+        String token = symbol->get_token();
+        if (p_symbols.find(token) < 0 && !token.ends_with("_flipbook")) continue;
+        // masks can't be composited, variants and clips can't be fixed at import time
+        int flags = symbol->get_subtree_flags();
+        if (symbol->get_variants().size() > 0 || (flags & FlashTimeline::SUBTREE_HAS_VARIANTS)) {
+            r_report.push_back(token + " skipped, variated symbols can't be baked");
+        } else if (flags & FlashTimeline::SUBTREE_HAS_CLIPS) {
+            r_report.push_back(token + " skipped, symbols with clips can't be baked");
+        } else if (flags & FlashTimeline::SUBTREE_HAS_MASKS) {
+            r_report.push_back(token + " skipped, masked symbols can't be baked");
+        } else {
+            symbols.push_back(symbol);
+        }
+    }
+    if (symbols.size() == 0) return;
+
+    // draw every frame with temporary player, recording bitmaps instead of geometry
+    Vector<FlashFlattenJob> jobs;
+    Vector<FlashDrawItem> recorded;
+    FlashPlayer *player = memnew(FlashPlayer);
+    player->set_cache_enabled(false);
+    player->set_resource(p_document);
+    player->set_draw_recorder(&recorded);
+    for (int i=0; i<symbols.size(); i++) {
+        player->set_active_symbol(symbols[i]->get_token());
+        for (int frame=0; frame<symbols[i]->get_duration(); frame += frame_step) {
+            recorded.clear();
+            player->set_frame(frame);
+            player->_animation_process();
+            FlashFlattenJob job;
+            job.timeline = symbols[i];
+            job.frame = frame;
+            for (int j=0; j<recorded.size(); j++) {
+                FlashFlattenItem item;
+                item.transform = recorded[j].transform;
+                item.size = recorded[j].size;
+                item.region = recorded[j].texture_region;
+                item.texture_idx = recorded[j].texture_idx;
+                item.effect.mult = recorded[j].mult;
+                item.effect.add = recorded[j].add;
+                job.items.push_back(item);
+            }
+            jobs.push_back(job);
+        }
+    }
+    memdelete(player);
+
+    Vector<FlashFlattenJob> drawn_jobs;
+    for (int i=0; i<jobs.size(); i++) {
+        if (jobs[i].items.size() > 0) drawn_jobs.push_back(jobs[i]);
+    }
+    int pages_count = _bake_jobs(drawn_jobs, r_spritesheets, texel_size);
+
+    // replace every symbol with single layer, one keyframe per baked frame;
+    // labels and events stay in timeline, so clips and signals still work
+    Dictionary bitmaps = p_document->get_bitmaps();
+    int drawn_idx = 0;
+    for (int i=0; i<symbols.size(); i++) {
+        Ref<FlashTimeline> symbol = symbols[i];
+        Ref<FlashLayer> layer;
+        layer.instance();
+        layer->set_layer_name("flipbook");
+        layer->set_layer_type(FlashLayer::TYPE_NORMAL);
+        layer->set_duration(symbol->get_duration());
+        Array frames;
+        bool baked = true;
+        for (int j=0; j<jobs.size(); j++) {
+            if (jobs[j].timeline != symbol) continue;
+            Ref<FlashFrame> frame;
+            frame.instance();
+            frame->set_index(jobs[j].frame);
+            frame->set_duration(MIN(frame_step, symbol->get_duration() - jobs[j].frame));
+            if (jobs[j].items.size() > 0) {
+                const FlashFlattenJob &drawn = drawn_jobs[drawn_idx++];
+                if (drawn.texture.is_null()) {
+                    baked = false;
+                    continue;
+                }
+                Array elements;
+                String bitmap_name = "flipbook/" + symbol->get_token() + "/" + itos(drawn.frame);
+                elements.push_back(_make_baked_bitmap(p_document, bitmaps, bitmap_name, drawn, frame.ptr()));
+                frame->set_elements(elements);
+            }
+            frames.push_back(frame);
+        }
+        if (!baked) {
+            r_report.push_back(symbol->get_token() + " skipped, frames does not fit atlas");
+            continue;
+        }
+        layer->set_frames(frames);
+        Array layers;
+        layers.push_back(layer);
+        symbol->set_layers(layers);
+        symbol->setup(p_document.ptr(), p_document.ptr());
+        r_report.push_back(symbol->get_token() + " -> " + itos(frames.size()) + " frames");
+    }
+    p_document->set_bitmaps(bitmaps);
+    print_verbose("Flash: baked " + itos(symbols.size()) + " flipbook symbols into " + itos(pages_count) + " atlas pages");
+}
+
+// Baked tracks depends on atlas size only, so they are evaluated once
+// for the first imported texture format and shared by the rest.
+void ResourceImporterFlash::_bake_tracks(Ref<FlashDocument> p_document, const Vector<String> &p_symbols, bool p_variant_alternatives, Dictionary &r_report) {
+    if (p_symbols.size() == 0 || p_document->get_baked_tracks().size() > 0) return;
+    Vector<String> symbols;
+    for (int i=0; i<p_symbols.size(); i++) {
+        if (p_symbols[i] == "*") {
+            symbols.push_back("[document]");
+            Array tokens = p_document->get_symbols().keys();
+            for (int j=0; j<tokens.size(); j++) {
+                symbols.push_back(tokens[j]);
+            }
+        } else if (symbols.find(p_symbols[i]) < 0) {
+            symbols.push_back(p_symbols[i]);
+        }
+    }
+
+    Array report;
+    Dictionary variants = p_document->get_variants();
+    for (int i=0; i<symbols.size(); i++) {
+        String name = symbols[i];
+        Ref<FlashTimeline> symbol = name == "[document]" ? p_document->get_main_timeline() : Ref<FlashTimeline>(p_document->get_symbols().get(name, Variant()));
+        if (symbol.is_null()) {
+            report.push_back(name + " skipped, no such symbol");
+            continue;
+        }
+
+        FlashPlayer *player = memnew(FlashPlayer);
+        player->set_resource(p_document);
+        p_document->set_baked_track(name, String(), String(), player->bake_track(name));
+        memdelete(player);
+        int tracks_count = 1;
+
+        if (p_variant_alternatives && (symbol->get_subtree_flags() & FlashTimeline::SUBTREE_HAS_VARIANTS)) {
+            for (int j=0; j<variants.size(); j++) {
+                String variant = variants.get_key_at_index(j);
+                Dictionary values = variants.get_value_at_index(j);
+                for (int k=0; k<values.size(); k++) {
+                    String value = values.get_key_at_index(k);
+                    if (value == "[default]") continue;
+                    player = memnew(FlashPlayer);
+                    player->set_resource(p_document);
+                    p_document->set_baked_track(name, variant, value, player->bake_track(name, variant, value));
+                    memdelete(player);
+                    tracks_count++;
+                }
+            }
+        }
+        report.push_back(name + " -> " + itos(tracks_count) + " tracks, " + itos(symbol->get_duration()) + " frames");
+    }
+    r_report["baked_tracks"] = report;
+}
+
+void ResourceImporterFlash::_flatten_static_layers(Ref<FlashDocument> p_document, Vector<Ref<Image>> &r_spritesheets, int p_downscale, Array &r_report) {
+    if (r_spritesheets.size() == 0) return;
+    float texel_size = 1 << p_downscale;
+
+    Array timelines = p_document->get_symbols().values();
+    for (int i=0; i<p_document->get_timelines_count(); i++) {
+        timelines.push_back(p_document->get_timeline(i));
+    }
+
+    // find runs of adjacent static layers
+    Vector<FlashFlattenJob> jobs;
+    for (int i=0; i<timelines.size(); i++) {
+        Ref<FlashTimeline> timeline = timelines[i];
+        Array layers = timeline->get_layers();
+        FlashFlattenJob job;
+        job.timeline = timeline;
+        for (int j=0; j<=layers.size(); j++) {
+            Ref<FlashLayer> layer = j < layers.size() ? Ref<FlashLayer>(layers[j]) : Ref<FlashLayer>();
+            if (layer.is_valid() && layer->get_layer_type() == FlashLayer::TYPE_FOLDER) continue;
+            if (layer.is_valid() && _is_static_layer(layer, 0)) {
+                job.layers.push_back(layer);
+                continue;
+            }
+            if (job.layers.size() > 0) {
+                for (int k=job.layers.size()-1; k>=0; k--) {
+                    _collect_layer(job.layers[k], Transform2D(), FlashColorEffect(), &job.items);
+                }
+                // single quad can't be drawn cheaper
+                if (job.items.size() > 1) {
+                    jobs.push_back(job);
+                }
+            }
+            job.layers.clear();
+            job.items.clear();
+        }
+    }
+
+    int pages_count = _bake_jobs(jobs, r_spritesheets, texel_size);
+    Dictionary bitmaps = p_document->get_bitmaps();
+    for (int i=0; i<jobs.size(); i++) {
+        FlashFlattenJob &job = jobs.write[i];
+        String layer_names;
+        for (int j=0; j<job.layers.size(); j++) {
+            layer_names += (j > 0 ? ", " : "") + job.layers[j]->get_layer_name();
+        }
+        String description = job.timeline->get_token() + ": " + layer_names;
+        if (job.texture.is_null()) {
+            r_report.push_back(description + " skipped, " + itos(job.size.x) + "x" + itos(job.size.y) + " does not fit atlas");
+            continue;
+        }
+
+        // keep the bottom layer of the run, drop the rest
+        Ref<FlashLayer> target = job.layers[job.layers.size()-1];
+        Array target_frames = target->get_frames();
+        Ref<FlashFrame> frame = target_frames[0];
+        String bitmap_name = "flattened/" + itos(i) + "/" + job.timeline->get_token();
+        Array elements;
+        elements.push_back(_make_baked_bitmap(p_document, bitmaps, bitmap_name, job, frame.ptr()));
+        frame->set_elements(elements);
+        frame->set_color_effect(PoolColorArray());
+        Array layers = job.timeline->get_layers();
+        for (int j=0; j<job.layers.size()-1; j++) {
+            layers.erase(job.layers[j]);
+        }
+        job.timeline->set_layers(layers);
+
+        r_report.push_back(description + " -> " + bitmap_name + " (" + itos(job.items.size()) + " bitmaps)");
+    }
+    p_document->set_bitmaps(bitmaps);
+    print_verbose("Flash: flattened " + itos(r_report.size()) + " static layer runs into " + itos(pages_count) + " atlas pages");
+}
+
+// Repacks atlas regions of bitmaps left in document into new pages, bitmaps
+// sharing a region keep sharing it. Fractional (downscaled) region offsets
+// are kept, so sampling doesn't shift. Atlas is left as is if some region
+// doesn't fit the page with padding or repacking takes more pages.
+static bool _compact_atlas(Ref<FlashDocument> p_document, Vector<Ref<Image>> &r_spritesheets, bool p_fix_alpha_border) {
+    if (r_spritesheets.size() == 0) return false;
+    Size2i page_size = Size2i(r_spritesheets[0]->get_width(), r_spritesheets[0]->get_height());
+    Vector<Ref<FlashTextureRect>> textures;
+    Vector<int> texture_regions;
+    Map<String, int> region_ids;
+    Vector<int> source_pages;
+    Vector<Rect2> source_regions;
+    Vector<Size2i> sizes;
+    Array items = p_document->get_bitmaps().values();
+    for (int i=0; i<items.size(); i++) {
+        Ref<FlashBitmapItem> item = items[i];
+        Ref<FlashTextureRect> texture = item.is_valid() ? item->get_texture() : Ref<FlashTextureRect>();
+        if (texture.is_null() || texture->get_index() < 0 || texture->get_index() >= r_spritesheets.size()) continue;
+        Rect2 region = texture->get_region();
+        String key = itos(texture->get_index()) + ":" + String(region);
+        if (!region_ids.has(key)) {
+            Vector2 offset = region.position - region.position.floor();
+            region_ids[key] = sizes.size();
+            source_pages.push_back(texture->get_index());
+            source_regions.push_back(region);
+            sizes.push_back(Size2i(Math::ceil(offset.x + region.size.x), Math::ceil(offset.y + region.size.y)));
+        }
+        textures.push_back(texture);
+        texture_regions.push_back(region_ids[key]);
+    }
+    if (sizes.size() == 0) return false;
+
+    Vector<int> pages;
+    Vector<Point2i> positions;
+    int pages_count = _pack_images(sizes, page_size, pages, positions);
+    if (pages_count > r_spritesheets.size()) return false;
+    for (int i=0; i<pages.size(); i++) {
+        if (pages[i] < 0) return false;
+    }
+    Vector<Ref<Image>> compacted;
+    for (int i=0; i<pages_count; i++) {
+        Ref<Image> page;
+        page.instance();
+        page->create(page_size.x, page_size.y, false, Image::FORMAT_RGBA8);
+        page->fill(Color(0, 0, 0, 0));
+        compacted.push_back(page);
+    }
+    for (int i=0; i<sizes.size(); i++) {
+        Rect2 source = Rect2(source_regions[i].position.floor(), Vector2(sizes[i].x, sizes[i].y));
+        compacted.write[pages[i]]->blit_rect(r_spritesheets[source_pages[i]], source, positions[i]);
+    }
+    for (int i=0; i<textures.size(); i++) {
+        int idx = texture_regions[i];
+        Rect2 region = source_regions[idx];
+        Vector2 offset = region.position - region.position.floor();
+        textures[i]->set_index(pages[idx]);
+        textures[i]->set_region(Rect2(Vector2(positions[idx].x, positions[idx].y) + offset, region.size));
+    }
+    if (p_fix_alpha_border) {
+        for (int i=0; i<compacted.size(); i++) {
+            compacted.write[i]->fix_alpha_edges();
+        }
+    }
+    r_spritesheets = compacted;
+    return true;
+}
+
+// Runs before flipbooks and flattening, so nothing is baked for symbols
+// no exported timeline uses.
+void ResourceImporterFlash::_prune_unreachable(Ref<FlashDocument> p_document, Vector<Ref<Image>> &r_spritesheets, const PoolStringArray &p_roots, bool p_fix_alpha_border, Dictionary &r_report) {
+    r_report = p_document->prune_unreachable(p_roots);
+    PoolStringArray symbols = r_report["symbols"];
+    PoolStringArray bitmaps = r_report["bitmaps"];
+    // atlas regions are freed by removed bitmaps only
+    int pages_before = r_spritesheets.size();
+    bool compacted = bitmaps.size() > 0 && _compact_atlas(p_document, r_spritesheets, p_fix_alpha_border);
+    r_report["atlas_pages"] = itos(pages_before) + " -> " + itos(r_spritesheets.size()) + (compacted ? "" : " (not compacted)");
+    print_verbose("Flash: pruned " + itos(symbols.size()) + " symbols and " + itos(bitmaps.size()) + " bitmaps, atlas pages " + String(r_report["atlas_pages"]));
+}
+
+// Writes atlas in chunked `.ftex` layout, see `ResourceFormatLoaderFlashTexture`.
+// Video RAM compressed layers are stored raw, they barely compress
+// further and may be read straight into the upload buffer.
 Error ResourceImporterFlash::_save_tex(
     const String &p_path,
     const Vector<Ref<Image>> &p_spritesheets,
@@ -420,19 +1137,7 @@ Error ResourceImporterFlash::_save_tex(
 ) {
     Error error;
 
-    Dictionary info;
-    info["flags"] = p_texture_flags;
-    if (p_spritesheets.size() == 0){
-        info["width"] = 0;
-        info["height"] = 0;
-        info["format"] = Image::FORMAT_RGBA8;
-    } else {
-        info["format"] = p_spritesheets[0]->get_format();
-        info["width"] = p_spritesheets[0]->get_width();
-        info["height"] = p_spritesheets[0]->get_height();
-    }
-
-    Array images;
+    Vector<Ref<Image>> images;
     for (int i = 0; i < p_spritesheets.size(); i++) {
         Ref<Image> image = p_spritesheets[i]->duplicate();
 		switch (p_compress_mode) {
@@ -449,29 +1154,61 @@ Error ResourceImporterFlash::_save_tex(
                 images.push_back(image);
 			} break;
 		}
-        info["format"] = image->get_format();
 	}
-    info["images"] = images;
-    PoolByteArray buff;
-    Variant info_var = info;
-    int len;
-    encode_variant(info_var, NULL, len, true);
-    buff.resize(len);
-    {
-        PoolByteArray::Write w = buff.write();
-        encode_variant(info_var, w.ptr(), len, true);
-    }
-
-    PoolVector<uint8_t> compressed;
-    compressed.resize(Compression::get_max_compressed_buffer_size(len, Compression::MODE_FASTLZ));
-    int compressed_size = Compression::compress(compressed.write().ptr(), buff.read().ptr(), len, Compression::MODE_FASTLZ);
+    uint32_t chunk_compression = p_compress_mode == COMPRESS_VIDEO_RAM ?
+        ResourceFormatLoaderFlashTexture::CHUNK_RAW :
+        ResourceFormatLoaderFlashTexture::CHUNK_FASTLZ;
 
 	FileAccess *f = FileAccess::open(p_path, FileAccess::WRITE, &error);
 	ERR_FAIL_COND_V(error, error);
-    {
-        f->store_32(len);
-        PoolByteArray::Read r = compressed.read();
-        f->store_buffer(r.ptr(), compressed_size);
+    f->store_buffer((const uint8_t *)ResourceFormatLoaderFlashTexture::MAGIC, 4);
+    f->store_32(ResourceFormatLoaderFlashTexture::FTEX_VERSION);
+    if (images.size() == 0) {
+        f->store_32(0);
+        f->store_32(0);
+        f->store_32(0);
+        f->store_32(Image::FORMAT_RGBA8);
+        f->store_32(p_texture_flags);
+        f->store_32(0);
+        memdelete(f);
+        return OK;
+    }
+    f->store_32(images[0]->get_width());
+    f->store_32(images[0]->get_height());
+    f->store_32(images.size());
+    f->store_32(images[0]->get_format());
+    f->store_32(p_texture_flags);
+    f->store_32(images[0]->has_mipmaps());
+
+    // offset table is filled after chunks are written
+    uint64_t table_position = f->get_position();
+    for (int i = 0; i < images.size() * 4; i++) {
+        f->store_32(0);
+    }
+    Vector<uint32_t> table;
+    for (int i = 0; i < images.size(); i++) {
+        while (f->get_position() % ResourceFormatLoaderFlashTexture::FTEX_CHUNK_ALIGN) {
+            f->store_8(0);
+        }
+        PoolVector<uint8_t> data = images[i]->get_data();
+        uint32_t offset = f->get_position();
+        uint32_t stored_size = data.size();
+        if (chunk_compression == ResourceFormatLoaderFlashTexture::CHUNK_RAW) {
+            f->store_buffer(data.read().ptr(), data.size());
+        } else {
+            PoolVector<uint8_t> compressed;
+            compressed.resize(Compression::get_max_compressed_buffer_size(data.size(), Compression::MODE_FASTLZ));
+            stored_size = Compression::compress(compressed.write().ptr(), data.read().ptr(), data.size(), Compression::MODE_FASTLZ);
+            f->store_buffer(compressed.read().ptr(), stored_size);
+        }
+        table.push_back(offset);
+        table.push_back(stored_size);
+        table.push_back(data.size());
+        table.push_back(chunk_compression);
+    }
+    f->seek(table_position);
+    for (int i = 0; i < table.size(); i++) {
+        f->store_32(table[i]);
     }
     memdelete(f);
     return OK;
@@ -25,6 +25,8 @@
 
 #include <editor/import/resource_importer_texture.h>
 
+class FlashDocument;
+
 class ResourceImporterFlash: public ResourceImporter {
     GDCLASS(ResourceImporterFlash, ResourceImporter);
 
@@ -40,6 +42,34 @@ protected:
 		bool p_mipmaps,
 		int p_texture_flags
 	);
+	void _bake_flipbooks(
+		Ref<FlashDocument> p_document,
+		Vector<Ref<Image>> &r_spritesheets,
+		int p_downscale,
+		const Vector<String> &p_symbols,
+		float p_scale,
+		int p_frame_step,
+		Array &r_report
+	);
+	void _bake_tracks(
+		Ref<FlashDocument> p_document,
+		const Vector<String> &p_symbols,
+		bool p_variant_alternatives,
+		Dictionary &r_report
+	);
+	void _flatten_static_layers(
+		Ref<FlashDocument> p_document,
+		Vector<Ref<Image>> &r_spritesheets,
+		int p_downscale,
+		Array &r_report
+	);
+	void _prune_unreachable(
+		Ref<FlashDocument> p_document,
+		Vector<Ref<Image>> &r_spritesheets,
+		const PoolStringArray &p_roots,
+		bool p_fix_alpha_border,
+		Dictionary &r_report
+	);
 
 public:
 	enum CompressMode {